@@ -0,0 +1,227 @@
+/*
+ * File: account.c
+ * Author: agent
+ * Purpose: This file contains the account module, which measures the CPU
+ *         time and system calls each request costs, and adds them up by
+ *         kind of request.
+ *         Please see account.h for documentation on how to use this module.
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+
+#include "account.h"
+
+#define MIN_STATUS 100 /* lowest status code */
+#define STATUSES 500 /* # of status codes, 100 to 599 */
+
+/* What the requests of one kind, or class and status, have cost. */
+struct totals {
+	atomic_llong requests; /* # of requests */
+	atomic_llong quanta;   /* quanta served */
+	atomic_llong bytes;    /* bytes of body sent or stored */
+	atomic_llong cpu_ns;   /* CPU time used */
+	atomic_llong syscalls; /* system calls made */
+};
+
+static const char *kind_names[ACCOUNT_KINDS] = {
+	"hit", "miss", "disk", "listing", "head", "upload", "error"
+};
+static const char *class_names[ACCOUNT_CLASSES] = { "high", "normal", "low" };
+static struct totals by_kind[ACCOUNT_KINDS]; /* totals by kind */
+static struct totals by_status[ACCOUNT_CLASSES][STATUSES]; /* totals by class and status */
+static atomic_int counting = -1; /* are system calls counted? -1 until known */
+static _Thread_local int counter = -2; /* thread's system call counter, -2 until opened */
+
+
+/* This function returns the CPU time used by the calling thread.
+ * Parameters: None
+ * Returns: The time, in nanoseconds.
+ */
+static long long cpu_now() {
+	struct timespec now; /* thread's CPU clock */
+
+	clock_gettime( CLOCK_THREAD_CPUTIME_ID, &now );
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+/* This function opens a perf event counting the system calls the calling
+ *    thread enters.  The event's id is read from tracefs, wherever it is
+ *    mounted.
+ * Parameters: None
+ * Returns: The event, or -1 if the kernel does not allow it.
+ */
+static int counter_open() {
+	static const char *ids[] = { "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+	                             "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id" };
+	struct perf_event_attr attr; /* what to count */
+	unsigned long long id = 0; /* tracepoint id */
+	FILE *f; /* id file */
+	int fd = -1; /* the event */
+	int i; /* id file index */
+
+	for( i = 0; ( i < 2 ) && !id; i++ ) {
+		f = fopen( ids[i], "r" );
+		if( f ) {
+			if( fscanf( f, "%llu", &id ) != 1 ) {
+				id = 0;
+			}
+			fclose( f );
+		}
+	}
+	if( id ) {
+		memset( &attr, 0, sizeof( attr ) );
+		attr.size = sizeof( attr );
+		attr.type = PERF_TYPE_TRACEPOINT;
+		attr.config = id;
+		fd = syscall( SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC );
+	}
+	atomic_store( &counting, fd >= 0 );
+	return fd;
+}
+
+
+/* This function reads the calling thread's count of system calls.
+ * Parameters: None
+ * Returns: The count, including the read() that reads it, or 0 if system
+ *          calls are not counted.
+ */
+static long long calls_now() {
+	unsigned long long count = 0; /* system calls entered */
+
+	if( counter == -2 ) { /* thread's first quantum */
+		counter = counter_open();
+	}
+	if( ( counter >= 0 ) && ( read( counter, &count, sizeof( count ) ) != sizeof( count ) ) ) {
+		count = 0;
+	}
+	return count;
+}
+
+
+/* This function starts measuring a quantum of a request, on the thread
+ *    serving it.
+ * Parameters:
+ *    acct : the request's usage
+ * Returns: None
+ */
+extern void account_start( struct account *acct ) {
+	acct->start_ns = cpu_now();
+	acct->start_calls = calls_now(); /* last, so no measuring is counted */
+}
+
+
+/* This function stops measuring a quantum of a request, and adds what it
+ *    cost to the request's usage.
+ * Parameters:
+ *    acct : the request's usage
+ * Returns: None
+ */
+extern void account_stop( struct account *acct ) {
+	long long calls = calls_now(); /* first, so no measuring is counted */
+
+	acct->cpu_ns += cpu_now() - acct->start_ns;
+	if( calls ) {
+		acct->syscalls += calls - acct->start_calls - 1; /* the read() of calls */
+	}
+	acct->quanta++;
+}
+
+
+/* This function adds usage to totals.
+ * Parameters:
+ *    t     : the totals
+ *    acct  : the usage
+ *    bytes : bytes of body sent or stored
+ * Returns: None
+ */
+static void add( struct totals *t, const struct account *acct, size_t bytes ) {
+	atomic_fetch_add_explicit( &t->requests, 1, memory_order_relaxed );
+	atomic_fetch_add_explicit( &t->quanta, acct->quanta, memory_order_relaxed );
+	atomic_fetch_add_explicit( &t->bytes, bytes, memory_order_relaxed );
+	atomic_fetch_add_explicit( &t->cpu_ns, acct->cpu_ns, memory_order_relaxed );
+	atomic_fetch_add_explicit( &t->syscalls, acct->syscalls, memory_order_relaxed );
+}
+
+
+/* This function adds a finished request's usage to the totals.
+ * Parameters:
+ *    acct   : the request's usage
+ *    class  : its priority class
+ *    kind   : its kind, ACCOUNT_HIT, ACCOUNT_MISS, ...
+ *    status : its HTTP status code
+ *    bytes  : bytes of body sent or stored
+ * Returns: None
+ */
+extern void account_add( const struct account *acct, int class, int kind, int status,
+                         size_t bytes ) {
+	add( &by_kind[kind], acct, bytes );
+	if( ( status >= MIN_STATUS ) && ( status < MIN_STATUS + STATUSES ) ) {
+		add( &by_status[class][status - MIN_STATUS], acct, bytes );
+	}
+}
+
+
+/* This function renders totals as the rest of a line.
+ * Parameters:
+ *    buf  : buffer to render into
+ *    size : size of the buffer
+ *    t    : the totals
+ * Returns: The number of bytes rendered, or would have been.
+ */
+static int render( char *buf, int size, struct totals *t ) {
+	long long n = atomic_load( &t->requests ); /* # of requests */
+	long long bytes = atomic_load( &t->bytes ); /* bytes sent */
+	long long cpu = atomic_load( &t->cpu_ns ); /* CPU used */
+	long long calls = atomic_load( &t->syscalls ); /* system calls made */
+
+	return snprintf( buf, size, " requests %lld quanta %lld bytes %lld cpu_ns %lld syscalls %lld"
+	                 " cpu_ns_per_request %lld cpu_ns_per_kb %.1f syscalls_per_request %.1f\n",
+	                 n, atomic_load( &t->quanta ), bytes, cpu, calls, n ? cpu / n : 0,
+	                 bytes ? cpu * 1024.0 / bytes : 0, n ? (double)calls / n : 0 );
+}
+
+
+/* This function renders the totals as text, a line per kind of request,
+ *    and a line per class and status code seen, e.g.,
+ *
+ *      kind hit requests 10 quanta 10 bytes 20480 cpu_ns 95000 syscalls 30
+ *        cpu_ns_per_request 9500 cpu_ns_per_kb 4750.0 syscalls_per_request 3.0
+ *
+ *    all on one line.
+ * Parameters:
+ *    buf  : buffer to render into
+ *    size : size of the buffer
+ * Returns: The number of bytes rendered, at most size - 1.
+ */
+extern int account_render( char *buf, int size ) {
+	int len; /* bytes rendered */
+	int c, s; /* class, status index */
+
+	len = snprintf( buf, size, "syscalls_counted %d\n", atomic_load( &counting ) > 0 );
+	for( c = 0; ( c < ACCOUNT_KINDS ) && ( len < size ); c++ ) {
+		len += snprintf( buf + len, size - len, "kind %s", kind_names[c] );
+		if( len < size ) {
+			len += render( buf + len, size - len, &by_kind[c] );
+		}
+	}
+	for( c = 0; c < ACCOUNT_CLASSES; c++ ) {
+		for( s = 0; ( s < STATUSES ) && ( len < size ); s++ ) {
+			if( !atomic_load( &by_status[c][s].requests ) ) {
+				continue;
+			}
+			len += snprintf( buf + len, size - len, "class %s status %d", class_names[c],
+			                 s + MIN_STATUS );
+			if( len < size ) {
+				len += render( buf + len, size - len, &by_status[c][s] );
+			}
+		}
+	}
+	return len < size ? len : size - 1;
+}
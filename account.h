@@ -0,0 +1,100 @@
+/*
+ * File: account.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          account module, which measures the CPU time and system calls
+ *          each request costs, and adds them up by kind of request.
+ */
+
+#ifndef ACCOUNT_H
+#define ACCOUNT_H
+
+#include <stddef.h>
+
+#define ACCOUNT_HIT 0 /* file sent from the cache */
+#define ACCOUNT_MISS 1 /* file read into the cache, then sent */
+#define ACCOUNT_DISK 2 /* file too large to cache, read as it is sent */
+#define ACCOUNT_LISTING 3 /* directory listing */
+#define ACCOUNT_HEAD 4 /* header only */
+#define ACCOUNT_UPLOAD 5 /* file stored */
+#define ACCOUNT_ERROR 6 /* status only, e.g., a 404 or a redirect */
+#define ACCOUNT_KINDS 7
+#define ACCOUNT_CLASSES 3 /* priority classes, see priority.h */
+
+/*
+ * This module has four functions:
+ *   account_start()  : start measuring a quantum of a request
+ *   account_stop()   : stop measuring it, and add it to the request's usage
+ *   account_add()    : add a finished request's usage to the totals
+ *   account_render() : render the totals as text
+ *
+ * A worker brackets each quantum it serves with account_start() and
+ * account_stop(), which read the thread's CPU clock
+ * (CLOCK_THREAD_CPUTIME_ID) and, where the kernel allows it, a perf event
+ * per worker thread counting the system calls it enters
+ * (raw_syscalls:sys_enter); this needs perf_event_paranoid 1 or less, or
+ * CAP_PERFMON, and without it system calls are not counted.  Only what
+ * happens between the two calls is charged, so the worker's own queueing
+ * and sleeping is not.  When a request is finished, its usage is added to
+ * totals by priority class and status code, and by kind of request, so
+ * that, e.g., the CPU cost per byte of cache hits, misses and 404s can be
+ * compared.  Totals are kept with relaxed atomics, so all functions are
+ * thread safe.
+ */
+
+/* What a request has cost so far. */
+struct account {
+	long long cpu_ns;      /* CPU time used */
+	long long syscalls;    /* system calls made */
+	int quanta;            /* quanta served */
+	long long start_ns;    /* CPU clock at the start of the quantum */
+	long long start_calls; /* system call count at the start of the quantum */
+};
+
+
+/* This function starts measuring a quantum of a request, on the thread
+ *    serving it.
+ * Parameters:
+ *    acct : the request's usage
+ * Returns: None
+ */
+extern void account_start( struct account *acct );
+
+
+/* This function stops measuring a quantum of a request, and adds what it
+ *    cost to the request's usage.
+ * Parameters:
+ *    acct : the request's usage
+ * Returns: None
+ */
+extern void account_stop( struct account *acct );
+
+
+/* This function adds a finished request's usage to the totals.
+ * Parameters:
+ *    acct   : the request's usage
+ *    class  : its priority class
+ *    kind   : its kind, ACCOUNT_HIT, ACCOUNT_MISS, ...
+ *    status : its HTTP status code
+ *    bytes  : bytes of body sent or stored
+ * Returns: None
+ */
+extern void account_add( const struct account *acct, int class, int kind, int status,
+                         size_t bytes );
+
+
+/* This function renders the totals as text, a line per kind of request,
+ *    and a line per class and status code seen, e.g.,
+ *
+ *      kind hit requests 10 quanta 10 bytes 20480 cpu_ns 95000 syscalls 30
+ *        cpu_ns_per_request 9500 cpu_ns_per_kb 4750.0 syscalls_per_request 3.0
+ *
+ *    all on one line.
+ * Parameters:
+ *    buf  : buffer to render into
+ *    size : size of the buffer
+ * Returns: The number of bytes rendered, at most size - 1.
+ */
+extern int account_render( char *buf, int size );
+
+#endif
@@ -0,0 +1,255 @@
+/*
+ * File: admin.c
+ * Author: agent
+ * Purpose: This file contains the admin module, which answers requests for
+ *         the server's own state.
+ *         Please see admin.h for documentation on how to use this module.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "account.h"
+#include "admin.h"
+#include "buffer.h"
+#include "cache.h"
+#include "conn.h"
+#include "listing.h"
+#include "meta.h"
+#include "network.h"
+#include "pace.h"
+#include "probes.h"
+#include "profile.h"
+#include "rate.h"
+#include "settings.h"
+#include "site.h"
+#include "slow.h"
+#include "stats.h"
+#include "upload.h"
+#include "worker.h"
+#include "zcopy.h"
+
+#define ADMIN_SIZE 4096 /* size of response buffer */
+#define PROFILE_SECS 10 /* default length of a profile */
+
+
+/* This function checks whether a client is connected over loopback.
+ * Parameters:
+ *    fd : the file descriptor to the client connection
+ * Returns: 1 if the client is local, 0 otherwise
+ */
+static int is_local( int fd ) {
+	struct sockaddr_storage addr; /* addr of client */
+	socklen_t len = sizeof( addr ); /* length of addr */
+
+	if( getpeername( fd, (struct sockaddr *)&addr, &len ) ) {
+		return 0;
+	} else if( addr.ss_family == AF_INET ) {
+		return ( ntohl( ( (struct sockaddr_in *)&addr )->sin_addr.s_addr ) >> 24 ) == 127;
+	} else if( addr.ss_family == AF_INET6 ) {
+		return !memcmp( &( (struct sockaddr_in6 *)&addr )->sin6_addr, &in6addr_loopback,
+		                sizeof( struct in6_addr ) );
+	}
+	return 0;
+}
+
+
+/* This function renders the server's counters as text.
+ * Parameters:
+ *    buf  : buffer to render into
+ *    size : size of the buffer
+ * Returns: the number of bytes rendered
+ */
+static int render_stats( char *buf, int size ) {
+	struct conn_stats cs; /* connection counters */
+	struct buffer_stats bs; /* buffer pool counters */
+	struct worker_stats ws; /* worker counters */
+	struct network_stats ns; /* network counters */
+	struct cache_stats cas; /* cache counters */
+	struct zcopy_stats zs; /* zero-copy counters */
+	struct upload_stats us; /* upload counters */
+	struct meta_stats ms; /* header cache counters */
+	struct site_stats ss; /* site counters */
+	struct listing_stats ls; /* listing cache counters */
+	struct rate_stats rs; /* rate limit counters */
+	struct pace_stats ps; /* pacing counters */
+	struct settings_stats sts; /* reload counters */
+	struct stats_startup st; /* startup times */
+
+	settings_stats( &sts );
+	site_stats( &ss );
+	rate_stats( &rs );
+	pace_stats( &ps );
+	cache_stats( &cas );
+	meta_stats( &ms );
+	listing_stats( &ls );
+	zcopy_stats( &zs );
+	upload_stats( &us );
+	conn_stats( &cs );
+	buffer_stats( &bs );
+	worker_stats( &ws );
+	network_stats( &ns );
+	stats_startup( &st );
+
+	return snprintf( buf, size,
+	                 "poll_mode %s\n"
+	                 "probes %d\n"
+	                 "settings_generation %llu\n"
+	                 "settings_pending %zu\n"
+	                 "settings_freed %zu\n"
+	                 "net_accepted %zu\n"
+	                 "net_busy_poll_usecs %d\n"
+	                 "net_busy_poll_failed %zu\n"
+	                 "net_inherited %d\n"
+	                 "startup_ready_us %lld\n"
+	                 "startup_first_response_us %lld\n"
+	                 "site_sites %zu\n"
+	                 "site_hosts %zu\n"
+	                 "site_unknown_host %zu\n"
+	                 "site_requests %zu\n"
+	                 "site_refused %zu\n"
+	                 "rate_clients %zu\n"
+	                 "rate_admitted %zu\n"
+	                 "rate_limited %zu\n"
+	                 "rate_paced %zu\n"
+	                 "rate_evictions %zu\n"
+	                 "pace_classes %zu\n"
+	                 "pace_kernel %zu\n"
+	                 "pace_bucket %zu\n"
+	                 "pace_waits %zu\n"
+	                 "conn_open %zu\n"
+	                 "conn_idle %zu\n"
+	                 "conn_bytes %zu\n"
+	                 "conn_idle_bytes %zu\n"
+	                 "conn_idle_bytes_each %zu\n"
+	                 "conn_buffers %zu\n"
+	                 "buffer_in_use %zu\n"
+	                 "buffer_pooled %zu\n"
+	                 "buffer_bytes %zu\n"
+	                 "worker_threads %d\n"
+	                 "worker_busy_threads %d\n"
+	                 "worker_sleeping %d\n"
+	                 "worker_spinning %d\n"
+	                 "worker_queue_depth %zu\n"
+	                 "worker_arrival_gap_ns %ld\n"
+	                 "worker_submitted %zu\n"
+	                 "worker_quanta %zu\n"
+	                 "worker_wakeups %zu\n"
+	                 "worker_parks %zu\n"
+	                 "worker_spin_hits %zu\n"
+	                 "worker_high_depth %zu\n"
+	                 "worker_high_quanta %zu\n"
+	                 "worker_normal_depth %zu\n"
+	                 "worker_normal_quanta %zu\n"
+	                 "worker_low_depth %zu\n"
+	                 "worker_low_quanta %zu\n"
+	                 "worker_started %d\n"
+	                 "worker_max %d\n"
+	                 "worker_queue_delay_ns %ld\n"
+	                 "worker_utilisation_pct %d\n"
+	                 "worker_grows %zu\n"
+	                 "worker_shrinks %zu\n"
+	                 "cache_entries %zu\n"
+	                 "cache_bytes %zu\n"
+	                 "cache_budget %zu\n"
+	                 "cache_pinned_bytes %zu\n"
+	                 "cache_hits %zu\n"
+	                 "cache_misses %zu\n"
+	                 "cache_uncached %zu\n"
+	                 "cache_evictions %zu\n"
+	                 "meta_entries %zu\n"
+	                 "meta_hits %zu\n"
+	                 "meta_misses %zu\n"
+	                 "meta_invalidations %zu\n"
+	                 "listing_entries %zu\n"
+	                 "listing_hits %zu\n"
+	                 "listing_renders %zu\n"
+	                 "listing_invalidations %zu\n"
+	                 "zcopy_sends %zu\n"
+	                 "zcopy_bytes %zu\n"
+	                 "zcopy_reaped %zu\n"
+	                 "zcopy_copied %zu\n"
+	                 "zcopy_refused %zu\n"
+	                 "upload_started %zu\n"
+	                 "upload_completed %zu\n"
+	                 "upload_failed %zu\n"
+	                 "upload_bytes %zu\n"
+	                 "upload_spliced_bytes %zu\n",
+	                 ns.busy_poll ? "busy" : "sleep", probes_enabled(), sts.generation,
+	                 sts.pending, sts.freed, ns.accepted, ns.busy_poll,
+	                 ns.busy_poll_failed, ns.inherited, st.ready / 1000, st.first_response / 1000,
+	                 ss.sites, ss.hosts, ss.unknown, ss.requests,
+	                 ss.refused, rs.clients, rs.admitted, rs.limited, rs.paced, rs.evictions,
+	                 ps.classes, ps.kernel, ps.bucket, ps.waits,
+	                 cs.open, cs.idle, cs.bytes, cs.idle_bytes,
+	                 cs.idle ? cs.idle_bytes / cs.idle : 0, cs.buffers,
+	                 bs.in_use, bs.pooled, bs.bytes,
+	                 ws.workers, ws.busy, ws.sleeping, ws.spinning, ws.depth, ws.arrival_gap,
+	                 ws.submitted, ws.quanta, ws.wakeups, ws.parks, ws.spin_hits,
+	                 ws.class_depth[0], ws.class_quanta[0], ws.class_depth[1],
+	                 ws.class_quanta[1], ws.class_depth[2], ws.class_quanta[2],
+	                 ws.threads, ws.max, ws.queue_delay, ws.utilisation, ws.grows, ws.shrinks,
+	                 cas.entries, cas.bytes, cas.budget, cas.pinned, cas.hits,
+	                 cas.misses, cas.uncached, cas.evictions,
+	                 ms.entries, ms.hits, ms.misses, ms.invalidations,
+	                 ls.entries, ls.hits, ls.renders, ls.invalidations,
+	                 zs.sends, zs.bytes, zs.reaped, zs.copied, zs.refused,
+	                 us.started, us.completed, us.failed, us.bytes, us.spliced );
+}
+
+
+/* This function answers an admin request and sends the response to the
+ *    client.  The connection is not closed.
+ * Parameters:
+ *    fd   : the file descriptor to the client connection
+ *    path : the requested path, including ADMIN_PREFIX
+ * Returns: None
+ */
+extern void admin_serve( int fd, char *path ) {
+	char buffer[ADMIN_SIZE]; /* response buffer */
+	char *out = buffer; /* response, in buffer unless it is large */
+	int size = ADMIN_SIZE; /* size of out */
+	int len; /* length of response */
+	int secs = PROFILE_SECS; /* length of profile */
+
+	path += strlen( ADMIN_PREFIX );
+	if( is_local( fd ) && !strcmp( path, "stats" ) ) {
+		len = sprintf( buffer, "HTTP/1.1 200 OK\n\n" );
+		len += render_stats( buffer + len, ADMIN_SIZE - len );
+	} else if( is_local( fd ) && !strcmp( path, "account" ) ) {
+		len = sprintf( buffer, "HTTP/1.1 200 OK\n\n" );
+		len += account_render( buffer + len, ADMIN_SIZE - len );
+	} else if( is_local( fd ) && !strcmp( path, "slow" ) ) {
+		size = SLOW_DUMP_SIZE;
+		out = malloc( size );
+		if( !out ) { /* error check */
+			perror( "Error while allocating memory" );
+			abort();
+		}
+		len = sprintf( out, "HTTP/1.1 200 OK\n\n" );
+		len += slow_render( out + len, size - len );
+	} else if( is_local( fd ) && ( !strcmp( path, "profile" ) ||
+	                               ( sscanf( path, "profile?seconds=%d", &secs ) == 1 ) ) ) {
+		if( !profile_start( fd, secs ) ) {
+			return; /* the profiler answers when done */
+		}
+		len = sprintf( buffer, "HTTP/1.1 503 Profile already running\n\n" );
+	} else { /* unknown or not allowed */
+		len = sprintf( buffer, "HTTP/1.1 404 File not found\n\n" );
+	}
+
+	if( len > size - 1 ) { /* output was cut short */
+		len = size - 1;
+	}
+	if( write( fd, out, len ) < len ) { /* check for errors */
+		perror( "Error while writing to client" );
+	}
+	if( out != buffer ) {
+		free( out );
+	}
+}
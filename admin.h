@@ -0,0 +1,43 @@
+/*
+ * File: admin.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          admin module, which answers requests for the server's own state.
+ */
+
+#ifndef ADMIN_H
+#define ADMIN_H
+
+#define ADMIN_PREFIX "/_sws/" /* paths handled by this module */
+
+/*
+ * This module has one function:
+ *   admin_serve() : answer an admin request
+ *
+ * Requests whose path starts with ADMIN_PREFIX are admin requests.  They are
+ * only answered for clients connecting over the loopback interface; anyone
+ * else gets a 404, as if the path did not exist.  Admin requests are
+ * answered by the thread that reads requests, which owns most of the
+ * counters being reported.  The following paths are understood:
+ *   /_sws/stats   : plain text counters, one "name value" pair per line
+ *   /_sws/account : CPU time and system calls used by requests, by kind of
+ *                   request and by class and status (see account.h)
+ *   /_sws/slow    : the slowest requests of the last and current intervals,
+ *                   each with the timeline of its life (see slow.h)
+ *   /_sws/profile : folded call stacks of the server's threads, sampled for
+ *                   10 seconds, or ?seconds=N (see profile.h); the response
+ *                   comes when the profile is done, and the server carries
+ *                   on serving meanwhile
+ */
+
+
+/* This function answers an admin request and sends the response to the
+ *    client.  The connection is not closed.
+ * Parameters:
+ *    fd   : the file descriptor to the client connection
+ *    path : the requested path, including ADMIN_PREFIX
+ * Returns: None
+ */
+extern void admin_serve( int fd, char *path );
+
+#endif
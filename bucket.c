@@ -0,0 +1,84 @@
+/*
+ * File: bucket.c
+ * Author: agent
+ * Purpose: This file contains the bucket module, the token bucket that
+ *         limits how fast responses are sent.
+ *         Please see bucket.h for documentation on how to use this module.
+ */
+
+#include "bucket.h"
+
+
+/* This function sets how many tokens a bucket holds, as of now.
+ * Parameters:
+ *    b      : the bucket
+ *    tokens : tokens it is to hold
+ *    now    : the time, in ns
+ * Returns: None
+ */
+extern void bucket_fill( struct bucket *b, double tokens, long long now ) {
+	b->tokens = tokens;
+	b->last = now;
+}
+
+
+/* This function adds the tokens a bucket has earned since it was last
+ *    refilled.
+ * Parameters:
+ *    b    : the bucket
+ *    rate : tokens earned per second
+ *    most : most tokens the bucket holds
+ *    now  : the time, in ns
+ * Returns: None
+ */
+extern void bucket_refill( struct bucket *b, double rate, double most, long long now ) {
+	b->tokens += ( now - b->last ) / 1e9 * rate;
+	if( b->tokens > most ) {
+		b->tokens = most;
+	}
+	b->last = now;
+}
+
+
+/* This function refills a bucket of bytes, holding at most a second's
+ *    worth, and takes tokens from it for a send.
+ * Parameters:
+ *    b    : the bucket
+ *    rate : bytes per second
+ *    want : the bytes the caller would like to send
+ *    now  : the time, in ns
+ *    wait : if nothing may be sent, set to the ns until something may
+ * Returns: The bytes that may be sent, at most want, or 0 if the caller is
+ *          to try again in *wait ns.
+ */
+extern size_t bucket_grant( struct bucket *b, size_t rate, size_t want, long long now,
+                            long long *wait ) {
+	size_t least = rate / BUCKET_SENDS + 1; /* smallest send worth making */
+
+	if( least > want ) {
+		least = want;
+	}
+	bucket_refill( b, rate, rate, now );
+
+	if( b->tokens >= least ) {
+		if( want > b->tokens ) {
+			want = b->tokens;
+		}
+		b->tokens -= want;
+		return want;
+	}
+	*wait = ( least - b->tokens ) * 1e9 / rate + 1; /* round up */
+	return 0;
+}
+
+
+/* This function gives back tokens taken for a send that was not made in
+ *    full.
+ * Parameters:
+ *    b      : the bucket
+ *    tokens : tokens to give back
+ * Returns: None
+ */
+extern void bucket_refund( struct bucket *b, double tokens ) {
+	b->tokens += tokens;
+}
@@ -0,0 +1,88 @@
+/*
+ * File: bucket.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          bucket module, the token bucket that limits how fast responses
+ *          are sent.
+ */
+
+#ifndef BUCKET_H
+#define BUCKET_H
+
+#include <stddef.h>
+
+#define BUCKET_SENDS 16 /* a bucket grants at most this many sends a second */
+
+/*
+ * This module has four functions:
+ *   bucket_fill()   : set how many tokens a bucket holds
+ *   bucket_refill() : add the tokens a bucket has earned since last refilled
+ *   bucket_grant()  : take tokens for a send, or say how long until it may
+ *   bucket_refund() : give back tokens taken for a send not made in full
+ *
+ * A bucket holds tokens, e.g., bytes or requests, that are added at a set
+ * rate up to a most, and taken out as they are spent.  bucket_grant() is
+ * for sends of bytes: it grants a send only once it can be worth making,
+ * at least 1/BUCKET_SENDS of a second's worth of bytes, so that a paced
+ * response goes out in at most BUCKET_SENDS pieces a second rather than a
+ * trickle of tiny ones.  When it grants nothing it gives the time until it
+ * would, so the caller can put the send aside rather than wait for it.
+ * A send limited by more than one bucket gives back to each the tokens
+ * the others would not let it spend.  The caller passes in the time and
+ * does any locking.
+ */
+
+/* A token bucket. */
+struct bucket {
+	double tokens;  /* tokens that may be spent now */
+	long long last; /* when tokens were last added, in ns */
+};
+
+
+/* This function sets how many tokens a bucket holds, as of now.
+ * Parameters:
+ *    b      : the bucket
+ *    tokens : tokens it is to hold
+ *    now    : the time, in ns
+ * Returns: None
+ */
+extern void bucket_fill( struct bucket *b, double tokens, long long now );
+
+
+/* This function adds the tokens a bucket has earned since it was last
+ *    refilled.
+ * Parameters:
+ *    b    : the bucket
+ *    rate : tokens earned per second
+ *    most : most tokens the bucket holds
+ *    now  : the time, in ns
+ * Returns: None
+ */
+extern void bucket_refill( struct bucket *b, double rate, double most, long long now );
+
+
+/* This function refills a bucket of bytes, holding at most a second's
+ *    worth, and takes tokens from it for a send.
+ * Parameters:
+ *    b    : the bucket
+ *    rate : bytes per second
+ *    want : the bytes the caller would like to send
+ *    now  : the time, in ns
+ *    wait : if nothing may be sent, set to the ns until something may
+ * Returns: The bytes that may be sent, at most want, or 0 if the caller is
+ *          to try again in *wait ns.
+ */
+extern size_t bucket_grant( struct bucket *b, size_t rate, size_t want, long long now,
+                            long long *wait );
+
+
+/* This function gives back tokens taken for a send that was not made in
+ *    full.
+ * Parameters:
+ *    b      : the bucket
+ *    tokens : tokens to give back
+ * Returns: None
+ */
+extern void bucket_refund( struct bucket *b, double tokens );
+
+#endif
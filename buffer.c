@@ -0,0 +1,108 @@
+/*
+ * File: buffer.c
+ * Author: agent
+ * Purpose: This file contains the buffer module, a pool of receive buffers.
+ *         Please see buffer.h for documentation on how to use this module.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "buffer.h"
+
+#define POOL_MAX 1024 /* most buffers kept on the free list */
+
+static struct buffer *pool; /* free list of buffers */
+static size_t pooled; /* # of buffers on free list */
+static size_t in_use; /* # of buffers handed out */
+
+
+/* This function takes a buffer from the pool, allocating a new one if the
+ *    pool is empty.  The returned buffer is empty (len is 0).  This function
+ *    will abort the program if memory cannot be allocated.
+ * Parameters: None
+ * Returns: A pointer to the buffer.
+ */
+extern struct buffer *buffer_get() {
+	struct buffer *buf; /* buffer to return */
+
+	if( pool ) { /* reuse a pooled buffer */
+		buf = pool;
+		pool = buf->next;
+		pooled--;
+	} else { /* pool is empty, alloc one */
+		buf = malloc( sizeof( struct buffer ) );
+		if( !buf ) { /* error check */
+			perror( "Error while allocating memory" );
+			abort();
+		}
+	}
+
+	buf->next = NULL;
+	buf->len = 0;
+	in_use++;
+	return buf;
+}
+
+
+/* This function returns a buffer to the pool.  Buffers beyond the pool's
+ *    limit are freed instead of being kept.
+ * Parameters:
+ *    buf : the buffer to return, may be NULL
+ * Returns: None
+ */
+extern void buffer_put( struct buffer *buf ) {
+	if( !buf ) { /* nothing to do */
+		return;
+	}
+
+	in_use--;
+	if( pooled < POOL_MAX ) { /* keep it for later */
+		buf->next = pool;
+		pool = buf;
+		pooled++;
+	} else { /* pool is full */
+		free( buf );
+	}
+}
+
+
+/* This function copies bytes out of a chain of buffers.  It only reads the
+ *    chain, so it may be called from any thread that owns the chain.
+ * Parameters:
+ *    chain : the first buffer of the chain
+ *    off   : offset within the chain of the first byte to copy
+ *    dst   : where to copy the bytes to
+ *    len   : the most bytes to copy
+ * Returns: the number of bytes copied, less than len if the chain ends first
+ */
+extern size_t buffer_copy( struct buffer *chain, size_t off, char *dst, size_t len ) {
+	size_t done = 0; /* bytes copied */
+	size_t n; /* bytes from this buffer */
+
+	for( ; chain && ( done < len ); chain = chain->next ) {
+		if( off >= chain->len ) { /* skip whole buffer */
+			off -= chain->len;
+			continue;
+		}
+		n = chain->len - off;
+		n = n < len - done ? n : len - done;
+		memcpy( dst + done, chain->data + off, n );
+		done += n;
+		off = 0;
+	}
+	return done;
+}
+
+
+/* This function reports the state of the pool.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void buffer_stats( struct buffer_stats *stats ) {
+	stats->in_use = in_use;
+	stats->pooled = pooled;
+	stats->bytes = ( in_use + pooled ) * sizeof( struct buffer );
+}
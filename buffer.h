@@ -0,0 +1,86 @@
+/*
+ * File: buffer.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          buffer module, which hands out receive buffers from a pool.
+ */
+
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stddef.h>
+
+#define BUFFER_SIZE 1024 /* bytes of data in each buffer */
+
+/*
+ * This module has four functions:
+ *   buffer_get()   : take a buffer from the pool
+ *   buffer_put()   : return a buffer to the pool
+ *   buffer_copy()  : copy bytes out of a chain of buffers
+ *   buffer_stats() : report how many buffers are in use and pooled
+ *
+ * Connections do not own a buffer while they are idle.  A buffer is taken
+ * with buffer_get() only once data is ready to be read, and is given back
+ * with buffer_put() as soon as the request has been parsed.  Buffers that
+ * are returned are kept on a free list, so a busy server does not go back
+ * to malloc() for every request.
+ *
+ * Buffers are small, so a typical request fits in one.  A longer request is
+ * held in a chain of buffers linked through their next field; the chain is
+ * grown a buffer at a time, only as more of the request arrives.
+ *
+ * The pool is not thread safe; all calls must be made from the thread that
+ * reads client requests.
+ */
+
+struct buffer {
+	struct buffer *next;    /* next buffer in chain or free list */
+	size_t len;             /* number of bytes of data held */
+	char data[BUFFER_SIZE]; /* the data itself */
+};
+
+struct buffer_stats {
+	size_t in_use;  /* buffers currently attached to connections */
+	size_t pooled;  /* buffers waiting on the free list */
+	size_t bytes;   /* total memory held by the pool, in bytes */
+};
+
+
+/* This function takes a buffer from the pool, allocating a new one if the
+ *    pool is empty.  The returned buffer is empty (len is 0).  This function
+ *    will abort the program if memory cannot be allocated.
+ * Parameters: None
+ * Returns: A pointer to the buffer.
+ */
+extern struct buffer *buffer_get();
+
+
+/* This function returns a buffer to the pool.  Buffers beyond the pool's
+ *    limit are freed instead of being kept.
+ * Parameters:
+ *    buf : the buffer to return, may be NULL
+ * Returns: None
+ */
+extern void buffer_put( struct buffer *buf );
+
+
+/* This function copies bytes out of a chain of buffers.  It only reads the
+ *    chain, so it may be called from any thread that owns the chain.
+ * Parameters:
+ *    chain : the first buffer of the chain
+ *    off   : offset within the chain of the first byte to copy
+ *    dst   : where to copy the bytes to
+ *    len   : the most bytes to copy
+ * Returns: the number of bytes copied, less than len if the chain ends first
+ */
+extern size_t buffer_copy( struct buffer *chain, size_t off, char *dst, size_t len );
+
+
+/* This function reports the state of the pool.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void buffer_stats( struct buffer_stats *stats );
+
+#endif
@@ -0,0 +1,366 @@
+/*
+ * File: cache.c
+ * Author: agent
+ * Purpose: This file contains the cache module, which keeps the contents of
+ *         recently served files in memory.
+ *         Please see cache.h for documentation on how to use this module.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "probes.h"
+#include "util.h"
+
+#define BUCKETS 4096 /* # of hash chains, a power of two */
+#define PAGE_SIZE 4096 /* alignment of entry data */
+
+/* A partition of the cache, with its own budget and LRU list. */
+struct cache {
+	struct cache_entry *newest; /* head of LRU list */
+	struct cache_entry *oldest; /* tail of LRU list */
+	size_t budget;              /* most bytes to cache */
+	size_t max_entry;           /* largest file to cache */
+	size_t bytes;               /* bytes cached */
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; /* guards all below */
+static struct cache_entry *table[BUCKETS]; /* hash chains */
+static size_t budget; /* most bytes to cache, all partitions */
+static size_t entries; /* counters for cache_stats() */
+static size_t bytes;
+static size_t hits;
+static size_t misses;
+static size_t evictions;
+static atomic_size_t uncached;
+static atomic_size_t pinned;
+
+
+/* This function finds an entry in a partition.  The lock must be held.
+ * Parameters:
+ *    cache : the partition
+ *    hash  : hash of path
+ *    path  : path of the file
+ * Returns: The entry, or NULL if not cached.
+ */
+static struct cache_entry *find( struct cache *cache, unsigned hash, const char *path ) {
+	struct cache_entry *e; /* entry in chain */
+
+	for( e = table[hash & ( BUCKETS - 1 )]; e; e = e->next ) {
+		if( ( e->hash == hash ) && ( e->cache == cache ) && !strcmp( e->path, path ) ) {
+			break;
+		}
+	}
+	return e;
+}
+
+
+/* This function unlinks an entry from its partition's LRU list.  The lock
+ *    must be held.
+ * Parameters:
+ *    e : the entry
+ * Returns: None
+ */
+static void lru_unlink( struct cache_entry *e ) {
+	if( e->newer ) {
+		e->newer->older = e->older;
+	} else {
+		e->cache->newest = e->older;
+	}
+	if( e->older ) {
+		e->older->newer = e->newer;
+	} else {
+		e->cache->oldest = e->newer;
+	}
+}
+
+
+/* This function links an entry at the most recent end of its partition's
+ *    LRU list.  The lock must be held.
+ * Parameters:
+ *    e : the entry
+ * Returns: None
+ */
+static void lru_push( struct cache_entry *e ) {
+	e->newer = NULL;
+	e->older = e->cache->newest;
+	if( e->cache->newest ) {
+		e->cache->newest->newer = e;
+	} else {
+		e->cache->oldest = e;
+	}
+	e->cache->newest = e;
+}
+
+
+/* This function frees an entry and its data.
+ * Parameters:
+ *    e : the entry
+ * Returns: None
+ */
+static void entry_free( struct cache_entry *e ) {
+	free( e->data );
+	free( e );
+}
+
+
+/* This function removes an entry from the cache and drops the cache's own
+ *    reference to it.  The entry is freed now if no one else holds it, or
+ *    later by cache_put().  The lock must be held.
+ * Parameters:
+ *    e : the entry
+ * Returns: None
+ */
+static void evict( struct cache_entry *e ) {
+	struct cache_entry **p; /* link to entry */
+
+	for( p = &table[e->hash & ( BUCKETS - 1 )]; *p != e; p = &( *p )->next );
+	*p = e->next;
+	lru_unlink( e );
+
+	e->cached = 0;
+	entries--;
+	bytes -= e->size;
+	e->cache->bytes -= e->size;
+	evictions++;
+	atomic_fetch_add( &pinned, e->size );
+	cache_put( e, 1 );
+}
+
+
+/* This function reads a whole file into a new entry.
+ * Parameters:
+ *    cache : the partition the entry is for
+ *    dir   : directory the path is relative to
+ *    path  : path of the file
+ *    st    : the file's status, from stat()
+ *    hash  : hash of path
+ * Returns: The entry, with one reference for the cache and one for the
+ *          caller, or NULL if the file could not be read.
+ */
+static struct cache_entry *load( struct cache *cache, int dir, const char *path,
+                                 struct stat *st, unsigned hash ) {
+	struct cache_entry *e; /* new entry */
+	size_t done = 0; /* bytes read */
+	ssize_t len; /* length of data read */
+	int fd; /* file being read */
+
+	e = malloc( sizeof( struct cache_entry ) + strlen( path ) + 1 );
+	if( !e || posix_memalign( (void **)&e->data, PAGE_SIZE, st->st_size ? st->st_size : 1 ) ) {
+		free( e );
+		return NULL;
+	}
+
+	fd = openat( dir, path, O_RDONLY );
+	while( ( fd >= 0 ) && ( done < (size_t)st->st_size ) ) { /* read it all */
+		len = read( fd, e->data + done, st->st_size - done );
+		if( ( len < 0 ) && ( errno == EINTR ) ) {
+			continue;
+		} else if( len <= 0 ) { /* error, or file shrank */
+			break;
+		}
+		done += len;
+	}
+	if( fd >= 0 ) {
+		close( fd );
+	}
+	if( done < (size_t)st->st_size ) { /* check for errors */
+		entry_free( e );
+		return NULL;
+	}
+
+	atomic_init( &e->refs, 2 );
+	e->cache = cache;
+	e->cached = 1;
+	e->hash = hash;
+	e->size = st->st_size;
+	e->mtime = st->st_mtim;
+	strcpy( e->path, path );
+	return e;
+}
+
+
+/* This function checks whether an entry still matches its file.
+ * Parameters:
+ *    e  : the entry
+ *    st : the file's status, from stat()
+ * Returns: 1 if the entry is current, 0 if the file has changed
+ */
+static int current( struct cache_entry *e, struct stat *st ) {
+	return ( e->size == (size_t)st->st_size ) && ( e->mtime.tv_sec == st->st_mtim.tv_sec ) &&
+	       ( e->mtime.tv_nsec == st->st_mtim.tv_nsec );
+}
+
+
+/* This function creates a partition of the cache.  A budget of 0 creates a
+ *    partition that caches nothing.  This function will abort the program
+ *    if memory cannot be allocated.
+ * Parameters:
+ *    size  : the most bytes of file data to keep in memory
+ *    limit : the largest file to cache, in bytes
+ * Returns: The partition.
+ */
+extern struct cache *cache_new( size_t size, size_t limit ) {
+	struct cache *cache; /* new partition */
+
+	cache = calloc( 1, sizeof( struct cache ) );
+	if( !cache ) { /* error check */
+		perror( "Error while allocating memory" );
+		abort();
+	}
+	cache->budget = size;
+	cache->max_entry = limit < size ? limit : size;
+
+	pthread_mutex_lock( &lock );
+	budget += size;
+	pthread_mutex_unlock( &lock );
+	return cache;
+}
+
+
+/* This function looks up a file in a partition, loading it if it is not
+ *    there or has changed.  A reference to the entry is held for the caller.
+ * Parameters:
+ *    cache : the partition
+ *    dir   : directory the path is relative to
+ *    path  : path of the file
+ *    hit   : if not NULL, set to 1 if the entry was already cached, and to
+ *            0 if it was read in
+ * Returns: The entry, or NULL if the file cannot be cached (it does not
+ *          exist, is not a regular file, is too large, or could not be read).
+ */
+extern struct cache_entry *cache_get( struct cache *cache, int dir, const char *path,
+                                      int *hit ) {
+	struct cache_entry *e; /* entry found */
+	struct cache_entry *fresh; /* entry loaded */
+	struct stat st; /* file status */
+	unsigned hash; /* hash of path */
+
+	if( !cache->budget || fstatat( dir, path, &st, 0 ) || !S_ISREG( st.st_mode ) ||
+	    ( (size_t)st.st_size > cache->max_entry ) ) { /* not cacheable */
+		atomic_fetch_add( &uncached, 1 );
+		return NULL;
+	}
+	hash = util_hash_str( UTIL_HASH_BASIS, path );
+
+	pthread_mutex_lock( &lock );
+	e = find( cache, hash, path );
+	if( e && current( e, &st ) ) { /* hit */
+		cache_hold( e );
+		lru_unlink( e );
+		lru_push( e );
+		hits++;
+		pthread_mutex_unlock( &lock );
+		PROBE( cache_hit, PROBE_PTR( path ), e->size );
+		if( hit ) {
+			*hit = 1;
+		}
+		return e;
+	}
+	pthread_mutex_unlock( &lock );
+
+	fresh = load( cache, dir, path, &st, hash ); /* miss, read without lock */
+	if( !fresh ) {
+		atomic_fetch_add( &uncached, 1 );
+		return NULL;
+	}
+	PROBE( cache_miss, PROBE_PTR( path ), fresh->size );
+	if( hit ) {
+		*hit = 0;
+	}
+
+	pthread_mutex_lock( &lock );
+	e = find( cache, hash, path );
+	if( e && current( e, &st ) ) { /* someone beat us to it */
+		cache_hold( e );
+		pthread_mutex_unlock( &lock );
+		entry_free( fresh );
+		return e;
+	} else if( e ) { /* stale, replace it */
+		evict( e );
+	}
+
+	fresh->next = table[hash & ( BUCKETS - 1 )];
+	table[hash & ( BUCKETS - 1 )] = fresh;
+	lru_push( fresh );
+	entries++;
+	bytes += fresh->size;
+	cache->bytes += fresh->size;
+	misses++;
+	while( ( cache->bytes > cache->budget ) && ( cache->oldest != fresh ) ) { /* make room */
+		evict( cache->oldest );
+	}
+	pthread_mutex_unlock( &lock );
+	return fresh;
+}
+
+
+/* This function takes another reference to an entry.
+ * Parameters:
+ *    entry : the entry
+ * Returns: None
+ */
+extern void cache_hold( struct cache_entry *entry ) {
+	atomic_fetch_add_explicit( &entry->refs, 1, memory_order_relaxed );
+}
+
+
+/* This function gives back references to an entry, freeing it if it has
+ *    been evicted and these were the last.
+ * Parameters:
+ *    entry : the entry
+ *    refs  : the number of references to give back
+ * Returns: None
+ */
+extern void cache_put( struct cache_entry *entry, int refs ) {
+	if( atomic_fetch_sub_explicit( &entry->refs, refs, memory_order_acq_rel ) == refs ) {
+		atomic_fetch_sub( &pinned, entry->size ); /* last one, must be evicted */
+		entry_free( entry );
+	}
+}
+
+
+/* This function drops a file from a partition, if it is there.  Requests
+ *    still sending the old entry keep it until they are done.
+ * Parameters:
+ *    cache : the partition
+ *    path  : path of the file
+ * Returns: None
+ */
+extern void cache_invalidate( struct cache *cache, const char *path ) {
+	struct cache_entry *e; /* entry found */
+	unsigned hash = util_hash_str( UTIL_HASH_BASIS, path ); /* hash of path */
+
+	pthread_mutex_lock( &lock );
+	e = find( cache, hash, path );
+	if( e ) {
+		evict( e );
+	}
+	pthread_mutex_unlock( &lock );
+}
+
+
+/* This function reports how the cache is doing, over all partitions.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void cache_stats( struct cache_stats *stats ) {
+	pthread_mutex_lock( &lock );
+	stats->entries = entries;
+	stats->bytes = bytes;
+	stats->budget = budget;
+	stats->hits = hits;
+	stats->misses = misses;
+	stats->evictions = evictions;
+	pthread_mutex_unlock( &lock );
+	stats->uncached = atomic_load( &uncached );
+	stats->pinned = atomic_load( &pinned );
+}
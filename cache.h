@@ -0,0 +1,137 @@
+/*
+ * File: cache.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          cache module, which keeps the contents of recently served files
+ *          in memory.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <time.h>
+
+/*
+ * This module has six functions:
+ *   cache_new()        : create a partition of the cache
+ *   cache_get()        : look up a file, loading it into the cache if needed
+ *   cache_hold()       : take another reference to an entry
+ *   cache_put()        : give back a reference to an entry
+ *   cache_invalidate() : drop a file from the cache
+ *   cache_stats()      : report how the cache is doing
+ *
+ * The cache is split into partitions, one per site, so that a busy site
+ * cannot push a quiet one's files out.  Each partition has its own budget
+ * and LRU list; a file is looked up by its path within a partition and is
+ * read relative to a directory given by file descriptor, the site's root.
+ * All partitions share one hash table.
+ *
+ * Entries are reference counted.  cache_get() returns an entry with a
+ * reference held for the caller, who must give it back with cache_put()
+ * when done with the entry's data.  Anyone else who needs the data to stay
+ * put for a while, such as the kernel during a zero-copy send, is covered
+ * by another reference taken with cache_hold().  When a partition is over
+ * budget, its least recently used entries are evicted: they are removed
+ * from the cache at once, so later lookups miss, but their memory is only
+ * freed when the last reference is given back.
+ *
+ * An entry is checked against the file with stat() on each lookup, and is
+ * replaced if the file's size or modification time have changed.  When
+ * the server itself replaces a file, it drops the old entry at once with
+ * cache_invalidate() rather than relying on this check.  Files that are
+ * not regular files, or larger than the entry limit, are never cached.
+ * All functions are thread safe.
+ */
+
+struct cache;
+
+struct cache_entry {
+	struct cache *cache;        /* partition holding entry */
+	struct cache_entry *next;   /* next entry in hash chain */
+	struct cache_entry *newer;  /* LRU list, toward most recent */
+	struct cache_entry *older;  /* LRU list, toward least recent */
+	atomic_int refs;            /* # of references held */
+	int cached;                 /* still in the cache? */
+	unsigned hash;              /* hash of path */
+	size_t size;                /* bytes of data */
+	struct timespec mtime;      /* modification time of file */
+	char *data;                 /* file contents, page aligned */
+	char path[];                /* path of file */
+};
+
+struct cache_stats {
+	size_t entries;   /* # of entries cached */
+	size_t bytes;     /* bytes of data cached */
+	size_t pinned;    /* bytes held by evicted entries still in use */
+	size_t budget;    /* most bytes of data to cache, in all partitions */
+	size_t hits;      /* # of lookups found in the cache */
+	size_t misses;    /* # of lookups loaded into the cache */
+	size_t uncached;  /* # of lookups for files that cannot be cached */
+	size_t evictions; /* # of entries evicted */
+};
+
+
+/* This function creates a partition of the cache.  A budget of 0 creates a
+ *    partition that caches nothing.  This function will abort the program
+ *    if memory cannot be allocated.
+ * Parameters:
+ *    size  : the most bytes of file data to keep in memory
+ *    limit : the largest file to cache, in bytes
+ * Returns: The partition.
+ */
+extern struct cache *cache_new( size_t size, size_t limit );
+
+
+/* This function looks up a file in a partition, loading it if it is not
+ *    there or has changed.  A reference to the entry is held for the caller.
+ * Parameters:
+ *    cache : the partition
+ *    dir   : directory the path is relative to
+ *    path  : path of the file
+ *    hit   : if not NULL, set to 1 if the entry was already cached, and to
+ *            0 if it was read in
+ * Returns: The entry, or NULL if the file cannot be cached (it does not
+ *          exist, is not a regular file, is too large, or could not be read).
+ */
+extern struct cache_entry *cache_get( struct cache *cache, int dir, const char *path,
+                                      int *hit );
+
+
+/* This function takes another reference to an entry.
+ * Parameters:
+ *    entry : the entry
+ * Returns: None
+ */
+extern void cache_hold( struct cache_entry *entry );
+
+
+/* This function gives back references to an entry, freeing it if it has
+ *    been evicted and these were the last.
+ * Parameters:
+ *    entry : the entry
+ *    refs  : the number of references to give back
+ * Returns: None
+ */
+extern void cache_put( struct cache_entry *entry, int refs );
+
+
+/* This function drops a file from a partition, if it is there.  Requests
+ *    still sending the old entry keep it until they are done.
+ * Parameters:
+ *    cache : the partition
+ *    path  : path of the file
+ * Returns: None
+ */
+extern void cache_invalidate( struct cache *cache, const char *path );
+
+
+/* This function reports how the cache is doing, over all partitions.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void cache_stats( struct cache_stats *stats );
+
+#endif
@@ -0,0 +1,117 @@
+/*
+ * File: config.c
+ * Author: agent
+ * Purpose: This file contains the config module, which reads the server's
+ *         configuration file.
+ *         Please see config.h for documentation on how to use this module.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+
+#define LINE_MAX_LEN 1024 /* longest line of a configuration file */
+
+
+/* This function reads a configuration file, handing each directive to a
+ *    function that applies it.  If the file cannot be read or a directive
+ *    is refused, an error naming the line is printed.
+ * Parameters:
+ *    file      : path of the file
+ *    directive : function that applies a directive, given its words, and
+ *                returns 0, or -1 if the directive is malformed
+ * Returns: 0 on success, or -1 on error.
+ */
+extern int config_load( const char *file, int (*directive)( int argc, char **argv ) ) {
+	char line[LINE_MAX_LEN]; /* line being read */
+	char *argv[CONFIG_ARGS]; /* words of line */
+	char *word; /* next word */
+	int argc; /* # of words */
+	int num = 0; /* line number */
+	FILE *fin; /* file being read */
+
+	fin = fopen( file, "r" );
+	if( !fin ) {
+		perror( file );
+		return -1;
+	}
+
+	while( fgets( line, LINE_MAX_LEN, fin ) ) {
+		num++;
+		line[strcspn( line, "#\n" )] = '\0'; /* drop comment */
+
+		argc = 0;
+		for( word = strtok( line, " \t\r" ); word; word = strtok( NULL, " \t\r" ) ) {
+			if( argc == CONFIG_ARGS ) { /* too many, refuse line */
+				argc = -1;
+				break;
+			}
+			argv[argc++] = word;
+		}
+
+		if( ( argc < 0 ) || ( ( argc > 0 ) && directive( argc, argv ) ) ) {
+			fprintf( stderr, "%s:%d: bad directive\n", file, num );
+			fclose( fin );
+			return -1;
+		}
+	}
+
+	fclose( fin );
+	return 0;
+}
+
+
+/* This function parses a size: a number of bytes, optionally followed by
+ *    k, m or g for KB, MB or GB.
+ * Parameters:
+ *    str  : the size, e.g., "64m"
+ *    size : set to the size in bytes
+ * Returns: 0 on success, or -1 if the size is malformed.
+ */
+extern int config_size( const char *str, size_t *size ) {
+	char unit = '\0'; /* size suffix */
+	size_t val; /* number given */
+
+	if( sscanf( str, "%zu%c", &val, &unit ) < 1 ) {
+		return -1;
+	} else if( ( unit == 'k' ) || ( unit == 'K' ) ) {
+		val <<= 10;
+	} else if( ( unit == 'm' ) || ( unit == 'M' ) ) {
+		val <<= 20;
+	} else if( ( unit == 'g' ) || ( unit == 'G' ) ) {
+		val <<= 30;
+	} else if( unit != '\0' ) {
+		return -1;
+	}
+	*size = val;
+	return 0;
+}
+
+
+/* This function checks whether a path matches a pattern, as used by the
+ *    directives that sort paths into classes: a pattern starting with / is
+ *    a prefix of the paths it matches, and one of the form *.ext is the
+ *    extension they end with.
+ * Parameters:
+ *    pattern : the pattern, e.g., "/downloads" or "*.html"
+ *    path    : the path, or NULL to only check that the pattern is valid
+ * Returns: 1 if the path matches, 0 if not, or -1 if the pattern is
+ *          malformed.
+ */
+extern int config_match( const char *pattern, const char *path ) {
+	size_t len; /* length of path */
+	size_t ext; /* length of extension, with the . */
+
+	if( ( pattern[0] != '/' ) && strncmp( pattern, "*.", 2 ) ) {
+		return -1;
+	} else if( !path ) {
+		return 0;
+	} else if( pattern[0] == '/' ) { /* by prefix */
+		return !strncmp( path, pattern, strlen( pattern ) );
+	}
+
+	len = strlen( path ); /* by extension */
+	ext = strlen( pattern + 1 );
+	return ( len >= ext ) && !strcmp( path + len - ext, pattern + 1 );
+}
@@ -0,0 +1,68 @@
+/*
+ * File: config.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          config module, which reads the server's configuration file.
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stddef.h>
+
+#define CONFIG_ARGS 16 /* most words on a line */
+
+/*
+ * This module has three functions:
+ *   config_load()  : read a configuration file, a directive at a time
+ *   config_size()  : parse a size, such as 64m
+ *   config_match() : check whether a path matches a pattern, such as *.html
+ *
+ * A configuration file holds one directive per line.  A directive is a
+ * list of words separated by spaces or tabs, the first of which names it,
+ * e.g.,
+ *
+ *   # host[,alias...]   root            options
+ *   site example.com    /srv/example    cache=16m upload=1m requests=64
+ *
+ * Blank lines, and everything from a # to the end of a line, are ignored.
+ * This module only splits the file into directives; what they mean is up
+ * to the function config_load() hands them to.
+ */
+
+
+/* This function reads a configuration file, handing each directive to a
+ *    function that applies it.  If the file cannot be read or a directive
+ *    is refused, an error naming the line is printed.
+ * Parameters:
+ *    file      : path of the file
+ *    directive : function that applies a directive, given its words, and
+ *                returns 0, or -1 if the directive is malformed
+ * Returns: 0 on success, or -1 on error.
+ */
+extern int config_load( const char *file, int (*directive)( int argc, char **argv ) );
+
+
+/* This function parses a size: a number of bytes, optionally followed by
+ *    k, m or g for KB, MB or GB.
+ * Parameters:
+ *    str  : the size, e.g., "64m"
+ *    size : set to the size in bytes
+ * Returns: 0 on success, or -1 if the size is malformed.
+ */
+extern int config_size( const char *str, size_t *size );
+
+
+/* This function checks whether a path matches a pattern, as used by the
+ *    directives that sort paths into classes: a pattern starting with / is
+ *    a prefix of the paths it matches, and one of the form *.ext is the
+ *    extension they end with.
+ * Parameters:
+ *    pattern : the pattern, e.g., "/downloads" or "*.html"
+ *    path    : the path, or NULL to only check that the pattern is valid
+ * Returns: 1 if the path matches, 0 if not, or -1 if the pattern is
+ *          malformed.
+ */
+extern int config_match( const char *pattern, const char *path );
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ * File: conn.c
+ * Author: agent
+ * Purpose: This file contains the connection module, which tracks clients
+ *         that have not yet sent a complete request.
+ *         Please see conn.h for documentation on how to use this module.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "conn.h"
+#include "util.h"
+
+static size_t open_conns; /* # of connections open */
+static size_t attached; /* # of connections with a buffer */
+static size_t buffers; /* # of buffers attached */
+static size_t conn_bytes; /* memory held by conn structs */
+
+
+/* This function creates a connection for a newly accepted client and puts
+ *    the socket into non-blocking mode.  This function will abort the
+ *    program if memory cannot be allocated.
+ * Parameters:
+ *    fd : the file descriptor to the client connection
+ * Returns: A pointer to the new connection.
+ */
+extern struct conn *conn_new( int fd ) {
+	struct conn *conn; /* new connection */
+
+	conn = malloc( sizeof( struct conn ) );
+	if( !conn ) { /* error check */
+		perror( "Error while allocating memory" );
+		abort();
+	}
+
+	fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+	conn->fd = fd;
+	conn->accepted = util_now_ns();
+	conn->state = HTTP_SCAN_INIT;
+	conn->len = 0;
+	conn->head = NULL; /* idle until readable */
+	conn->tail = NULL;
+
+	open_conns++;
+	conn_bytes += malloc_usable_size( conn );
+	return conn;
+}
+
+
+/* This function reads as much of the client's request as is available,
+ *    attaching buffers from the pool as they are needed.
+ * Parameters:
+ *    conn  : the connection to read from
+ *    limit : the most bytes a request may take
+ * Returns: 1 if a complete request has been read or the limit was reached,
+ *          0 if more data is needed, or -1 if the client closed the
+ *          connection or an error occurred.
+ */
+extern int conn_read( struct conn *conn, size_t limit ) {
+	struct buffer *buf; /* buffer being filled */
+	size_t room; /* space left for request */
+	ssize_t len; /* length of data read */
+	int done; /* request complete? */
+
+	for( ;; ) {
+		if( conn->len >= limit ) { /* request too large, even if the buffer has room */
+			conn->state = HTTP_OVERFLOW;
+			return 1;
+		}
+
+		buf = conn->tail;
+		if( !buf || ( buf->len == BUFFER_SIZE ) ) { /* attach buffer on demand */
+			buf = buffer_get();
+			if( conn->tail ) { /* grow the chain */
+				conn->tail->next = buf;
+			} else {
+				conn->head = buf;
+				attached++;
+			}
+			conn->tail = buf;
+			buffers++;
+		}
+
+		room = BUFFER_SIZE - buf->len;
+		if( room > limit - conn->len ) { /* stop at the limit */
+			room = limit - conn->len;
+		}
+
+		len = read( conn->fd, buf->data + buf->len, room );
+		if( len > 0 ) { /* got more of the request */
+			done = http_scan( &conn->state, buf->data + buf->len, len );
+			buf->len += len;
+			conn->len += len;
+			if( done ) {
+				return 1;
+			}
+		} else if( len == 0 ) { /* client shut down its end */
+			return conn->len > 0 ? 1 : -1;
+		} else if( errno == EINTR ) { /* try again */
+			continue;
+		} else if( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) ) {
+			if( conn->len == 0 ) { /* nothing read, stay idle */
+				conn_release( conn );
+			}
+			return 0;
+		} else { /* check for errors */
+			perror( "Error while reading request" );
+			return -1;
+		}
+	}
+}
+
+
+/* This function returns the connection's buffers to the pool, leaving the
+ *    connection idle and ready for a new request.
+ * Parameters:
+ *    conn : the connection
+ * Returns: None
+ */
+extern void conn_release( struct conn *conn ) {
+	struct buffer *buf; /* buffer to return */
+
+	if( conn->head ) {
+		attached--;
+	}
+	while( conn->head ) {
+		buf = conn->head;
+		conn->head = buf->next;
+		buffer_put( buf );
+		buffers--;
+	}
+	conn->tail = NULL;
+	conn->len = 0;
+	conn->state = HTTP_SCAN_INIT;
+}
+
+
+/* This function releases a connection and its buffers.  The socket itself is
+ *    not closed, since it may have been handed off to serve a request.
+ * Parameters:
+ *    conn : the connection to release
+ * Returns: None
+ */
+extern void conn_free( struct conn *conn ) {
+	conn_release( conn );
+	open_conns--;
+	conn_bytes -= malloc_usable_size( conn );
+	free( conn );
+}
+
+
+/* This function reports how many connections exist and how much memory they
+ *    hold, counting the connection itself and any attached buffers.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void conn_stats( struct conn_stats *stats ) {
+	size_t each = open_conns ? conn_bytes / open_conns : 0; /* avg struct size */
+
+	stats->open = open_conns;
+	stats->idle = open_conns - attached;
+	stats->buffers = buffers;
+	stats->bytes = conn_bytes + buffers * sizeof( struct buffer );
+	stats->idle_bytes = stats->idle * each;
+}
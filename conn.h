@@ -0,0 +1,102 @@
+/*
+ * File: conn.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          connection module, which tracks client connections that have not
+ *          yet sent a complete request.
+ */
+
+#ifndef CONN_H
+#define CONN_H
+
+#include <stddef.h>
+
+#include "buffer.h"
+#include "http.h"
+
+/*
+ * This module has five functions:
+ *   conn_new()     : create a connection for a newly accepted client
+ *   conn_read()    : read whatever the client has sent so far
+ *   conn_release() : give the connection's buffer back to the pool
+ *   conn_free()    : release a connection
+ *   conn_stats()   : report how many connections exist and their memory use
+ *
+ * A connection holds no buffer while it is idle.  conn_read() attaches a
+ * buffer from the buffer pool only when the socket is readable, and gives
+ * it back if no data was actually there.  If the request does not fit in
+ * one buffer, further buffers are chained on as it arrives, up to a limit
+ * on the size of the request.  Once conn_read() reports that a request is
+ * complete, the caller parses the chain with http_parse() and then calls
+ * conn_release() to hand the buffers back before doing any file work.  A
+ * request that hits the limit before it is complete is also reported as
+ * done, with its state set to HTTP_OVERFLOW.
+ */
+
+struct conn {
+	int fd;              /* client socket, non-blocking */
+	long long accepted;  /* when accepted, ns on the monotonic clock */
+	int state;           /* http_scan() state of request */
+	size_t len;          /* bytes of request read so far */
+	struct buffer *head; /* first buffer of request, NULL while idle */
+	struct buffer *tail; /* buffer being filled */
+};
+
+struct conn_stats {
+	size_t open;       /* # of connections open */
+	size_t idle;       /* # of connections without a buffer */
+	size_t buffers;    /* # of buffers attached to connections */
+	size_t bytes;      /* memory held by all connections, in bytes */
+	size_t idle_bytes; /* memory held by idle connections, in bytes */
+};
+
+
+/* This function creates a connection for a newly accepted client and puts
+ *    the socket into non-blocking mode.  This function will abort the
+ *    program if memory cannot be allocated.
+ * Parameters:
+ *    fd : the file descriptor to the client connection
+ * Returns: A pointer to the new connection.
+ */
+extern struct conn *conn_new( int fd );
+
+
+/* This function reads as much of the client's request as is available,
+ *    attaching buffers from the pool as they are needed.
+ * Parameters:
+ *    conn  : the connection to read from
+ *    limit : the most bytes a request may take
+ * Returns: 1 if a complete request has been read or the limit was reached,
+ *          0 if more data is needed, or -1 if the client closed the
+ *          connection or an error occurred.
+ */
+extern int conn_read( struct conn *conn, size_t limit );
+
+
+/* This function returns the connection's buffers to the pool, leaving the
+ *    connection idle and ready for a new request.
+ * Parameters:
+ *    conn : the connection
+ * Returns: None
+ */
+extern void conn_release( struct conn *conn );
+
+
+/* This function releases a connection and its buffers.  The socket itself is
+ *    not closed, since it may have been handed off to serve a request.
+ * Parameters:
+ *    conn : the connection to release
+ * Returns: None
+ */
+extern void conn_free( struct conn *conn );
+
+
+/* This function reports how many connections exist and how much memory they
+ *    hold, counting the connection itself and any attached buffers.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void conn_stats( struct conn_stats *stats );
+
+#endif
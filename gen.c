@@ -0,0 +1,376 @@
+/*
+ * File: gen.c
+ * Author: agent
+ * Purpose: This file contains sws-gen, which makes workloads for the web
+ *          server that look more like production than the few files of the
+ *          repository do.  It does up to three things, in this order:
+ *
+ *          With -n files, it creates a document root in dir: a tree of
+ *          directories -D deep, -F to a directory, with the files spread
+ *          over it at random.  File sizes are drawn from a distribution:
+ *            lognormal : median -m, sigma -s (1.5)
+ *            pareto    : least size -m, alpha -s (1.2), heavy tailed
+ *            bimodal   : lognormal, sigma -s, around -m, except for -B
+ *                        percent (10) of files, around -M (1m)
+ *          and capped at -x (64m).  Files up to 16k end in .html, up to 1m
+ *          in .jpg, and larger ones in .bin, so that path classes by
+ *          extension have something to match.
+ *
+ *          With -r requests, it writes a script of that many requests for
+ *          the files under dir, in the format hydra.py and sws-load read,
+ *          to stdout.  Popularity follows a Zipf law with exponent -z (1):
+ *          the k-th most popular file is asked for in proportion to
+ *          1 / k^z, and the ranks are shuffled, so popularity and size are
+ *          independent.  Requests arrive as a Poisson process at -R (100)
+ *          a second, each pausing -w seconds (0) before sending.
+ *
+ *          With -c, it evicts every file under dir from the page cache,
+ *          with posix_fadvise(DONTNEED), so that a run that follows starts
+ *          cold.
+ *
+ *          The same seed (-S) gives the same tree and the same script.
+ */
+
+#define _XOPEN_SOURCE 700 /* for nftw() */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "config.h"
+
+#define FILL_SIZE 65536 /* bytes written per write() */
+#define PATH_MAX_LEN 4096 /* longest path made */
+#define MAX_DEPTH 16 /* deepest tree */
+#define OPEN_FDS 64 /* descriptors nftw() may use */
+
+#define D_LOGNORMAL 0 /* size distributions */
+#define D_PARETO 1
+#define D_BIMODAL 2
+
+static char *root; /* document root */
+static char **files; /* paths of files, relative to root */
+static int num_files;
+static int max_files; /* room in files */
+static int dist = D_LOGNORMAL; /* size distribution */
+static size_t scale = 8 << 10; /* median, or least size */
+static size_t large = 1 << 20; /* median of large files */
+static double shape = -1; /* sigma or alpha, -1 for default */
+static double large_pct = 10; /* % of large files */
+static size_t max_size = 64 << 20; /* largest file */
+static int cold; /* evict files from the page cache? */
+static int evicted; /* # of files evicted */
+
+
+/* This function draws a number from the standard normal distribution.
+ * Parameters: None
+ * Returns: The number.
+ */
+static double normal() {
+	return sqrt( -2 * log( 1 - drand48() ) ) * cos( 2 * M_PI * drand48() );
+}
+
+
+/* This function draws the size of a file from the distribution.
+ * Parameters: None
+ * Returns: The size, in bytes.
+ */
+static size_t draw_size() {
+	double size; /* size drawn */
+
+	if( dist == D_PARETO ) {
+		size = scale / pow( 1 - drand48(), 1 / shape );
+	} else if( ( dist == D_BIMODAL ) && ( drand48() * 100 < large_pct ) ) {
+		size = large * exp( shape * normal() );
+	} else {
+		size = scale * exp( shape * normal() );
+	}
+	return size < max_size ? (size_t)size : max_size;
+}
+
+
+/* This function creates a file of a size.
+ * Parameters:
+ *    path : path of the file
+ *    size : its size, in bytes
+ * Returns: 0 on success, or -1 on error.
+ */
+static int make_file( const char *path, size_t size ) {
+	static char fill[FILL_SIZE]; /* contents */
+	ssize_t len; /* bytes written */
+	int fd; /* the file */
+	int i; /* byte index */
+
+	if( !fill[0] ) {
+		for( i = 0; i < FILL_SIZE; i++ ) {
+			fill[i] = i % 64 == 63 ? '\n' : 'a' + i % 26;
+		}
+	}
+	fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	if( fd < 0 ) {
+		return -1;
+	}
+	for( ; size > 0; size -= len ) {
+		len = write( fd, fill, size < FILL_SIZE ? size : FILL_SIZE );
+		if( len <= 0 ) {
+			close( fd );
+			return -1;
+		}
+	}
+	return close( fd );
+}
+
+
+/* This function creates the document root: a tree of directories, and
+ *    files spread over it at random.  Each file goes down a random branch
+ *    to a random depth, and the directories on the way are made as needed.
+ * Parameters:
+ *    count  : # of files
+ *    depth  : depth of the tree, 0 for none
+ *    fanout : subdirectories of each directory
+ * Returns: 0 on success, or -1 on error.
+ */
+static int make_root( int count, int depth, int fanout ) {
+	char path[PATH_MAX_LEN]; /* path made */
+	size_t size; /* size of file */
+	int len; /* length of path */
+	int d, down; /* depth, depth of file */
+	int k; /* file index */
+
+	if( mkdir( root, 0755 ) && ( errno != EEXIST ) ) {
+		return -1;
+	}
+	for( k = 0; k < count; k++ ) {
+		len = snprintf( path, PATH_MAX_LEN, "%s", root );
+		down = (int)( drand48() * ( depth + 1 ) );
+		for( d = 0; d < down; d++ ) {
+			len += snprintf( path + len, PATH_MAX_LEN - len, "/d%d", (int)( drand48() * fanout ) );
+			if( mkdir( path, 0755 ) && ( errno != EEXIST ) ) {
+				return -1;
+			}
+		}
+		size = draw_size();
+		snprintf( path + len, PATH_MAX_LEN - len, "/f%06d.%s", k,
+		          size <= 16 << 10 ? "html" : size <= 1 << 20 ? "jpg" : "bin" );
+		if( make_file( path, size ) ) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+/* This function notes a file found under the document root, and evicts it
+ *    from the page cache if asked to.  It is called by nftw().  This
+ *    function will abort the program if memory cannot be allocated.
+ * Parameters:
+ *    path : path of the file
+ *    st   : its attributes
+ *    type : its type, FTW_F for a file
+ *    ftw  : where its name starts in path
+ * Returns: 0, to keep walking.
+ */
+static int find_file( const char *path, const struct stat *st, int type, struct FTW *ftw ) {
+	int fd; /* the file */
+
+	(void)st;
+	(void)ftw;
+	if( type != FTW_F ) {
+		return 0;
+	}
+	if( num_files == max_files ) {
+		max_files = max_files ? 2 * max_files : 1024;
+		files = realloc( files, max_files * sizeof( char * ) );
+		if( !files ) {
+			perror( "Error while allocating memory" );
+			abort();
+		}
+	}
+	files[num_files] = strdup( path + strlen( root ) + 1 );
+	if( !files[num_files++] ) {
+		perror( "Error while allocating memory" );
+		abort();
+	}
+
+	if( cold ) {
+		fd = open( path, O_RDONLY );
+		if( ( fd >= 0 ) && !fdatasync( fd ) && /* dirty pages stay */
+		    !posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED ) ) {
+			evicted++;
+		}
+		if( fd >= 0 ) {
+			close( fd );
+		}
+	}
+	return 0;
+}
+
+
+/* This function compares two paths, for qsort().
+ * Parameters:
+ *    a : the first path
+ *    b : the second path
+ * Returns: less than, equal to, or greater than 0, as a is before, the same
+ *          as, or after b.
+ */
+static int compare_paths( const void *a, const void *b ) {
+	return strcmp( *(char * const *)a, *(char * const *)b );
+}
+
+
+/* This function writes a script of requests for the files, to stdout.
+ *    This function will abort the program if memory cannot be allocated.
+ * Parameters:
+ *    count : # of requests
+ *    port  : port of the server
+ *    zipf  : exponent of popularity
+ *    rate  : requests a second
+ *    pause : seconds each request pauses before sending
+ * Returns: None
+ */
+static void write_script( int count, int port, double zipf, double rate, double pause ) {
+	double *cdf; /* chance of each rank or more popular */
+	double at = 0; /* time of request */
+	double u; /* uniform draw */
+	char *tmp; /* file swapped */
+	int i, j; /* rank, file index */
+	int lo, hi; /* bounds of search */
+
+	cdf = malloc( num_files * sizeof( double ) );
+	if( !cdf ) {
+		perror( "Error while allocating memory" );
+		abort();
+	}
+	qsort( files, num_files, sizeof( char * ), compare_paths ); /* same order every walk */
+	for( i = num_files - 1; i > 0; i-- ) { /* shuffle into ranks */
+		j = (int)( drand48() * ( i + 1 ) );
+		tmp = files[i];
+		files[i] = files[j];
+		files[j] = tmp;
+	}
+	for( i = 0; i < num_files; i++ ) {
+		cdf[i] = ( i ? cdf[i - 1] : 0 ) + 1 / pow( i + 1, zipf );
+	}
+
+	printf( "%d\n", port );
+	for( i = 0; i < count; i++ ) {
+		u = drand48() * cdf[num_files - 1];
+		for( lo = 0, hi = num_files - 1; lo < hi; ) { /* first rank with cdf > u */
+			j = ( lo + hi ) / 2;
+			if( cdf[j] > u ) {
+				hi = j;
+			} else {
+				lo = j + 1;
+			}
+		}
+		printf( "%.6f %g %s\n", at, pause, files[lo] );
+		at += -log( 1 - drand48() ) / rate; /* Poisson arrivals */
+	}
+	free( cdf );
+}
+
+
+/* This function is where the program starts running.  It reads the
+ *    options, then creates the document root, writes the script and
+ *    evicts the files, as asked.
+ * Parameters:
+ *    argc : number of command line parameters (including program name
+ *    argv : array of pointers to command line parameters
+ * Returns: an integer status code, 0 for success, something else for error.
+ */
+int main( int argc, char **argv ) {
+	int count = 0; /* # of files to create */
+	int depth = 2; /* depth of tree */
+	int fanout = 4; /* subdirectories of each directory */
+	int requests = 0; /* # of requests to write */
+	int port = 8080; /* port of server */
+	double zipf = 1; /* exponent of popularity */
+	double rate = 100; /* requests a second */
+	double pause = 0; /* pause of each request */
+	long seed = 1; /* random seed */
+	int opt; /* command line option */
+
+	while( ( opt = getopt( argc, argv, "n:D:F:d:m:s:M:B:x:r:z:R:p:w:cS:" ) ) != -1 ) {
+		if( ( opt == 'n' ) && ( sscanf( optarg, "%d", &count ) == 1 ) && ( count >= 0 ) ) {
+			continue; /* files to create */
+		} else if( ( opt == 'D' ) && ( sscanf( optarg, "%d", &depth ) == 1 ) &&
+		           ( depth >= 0 ) && ( depth <= MAX_DEPTH ) ) {
+			continue; /* depth of tree */
+		} else if( ( opt == 'F' ) && ( sscanf( optarg, "%d", &fanout ) == 1 ) && ( fanout > 0 ) ) {
+			continue; /* subdirectories */
+		} else if( ( opt == 'd' ) && !strcmp( optarg, "lognormal" ) ) {
+			dist = D_LOGNORMAL;
+		} else if( ( opt == 'd' ) && !strcmp( optarg, "pareto" ) ) {
+			dist = D_PARETO;
+		} else if( ( opt == 'd' ) && !strcmp( optarg, "bimodal" ) ) {
+			dist = D_BIMODAL;
+		} else if( ( opt == 'm' ) && !config_size( optarg, &scale ) && scale ) {
+			continue; /* median, or least size */
+		} else if( ( opt == 's' ) && ( sscanf( optarg, "%lf", &shape ) == 1 ) && ( shape > 0 ) ) {
+			continue; /* sigma or alpha */
+		} else if( ( opt == 'M' ) && !config_size( optarg, &large ) && large ) {
+			continue; /* median of large files */
+		} else if( ( opt == 'B' ) && ( sscanf( optarg, "%lf", &large_pct ) == 1 ) ) {
+			continue; /* % of large files */
+		} else if( ( opt == 'x' ) && !config_size( optarg, &max_size ) ) {
+			continue; /* largest file */
+		} else if( ( opt == 'r' ) && ( sscanf( optarg, "%d", &requests ) == 1 ) && ( requests >= 0 ) ) {
+			continue; /* requests to write */
+		} else if( ( opt == 'z' ) && ( sscanf( optarg, "%lf", &zipf ) == 1 ) && ( zipf >= 0 ) ) {
+			continue; /* popularity */
+		} else if( ( opt == 'R' ) && ( sscanf( optarg, "%lf", &rate ) == 1 ) && ( rate > 0 ) ) {
+			continue; /* arrival rate */
+		} else if( ( opt == 'p' ) && ( sscanf( optarg, "%d", &port ) == 1 ) ) {
+			continue; /* server port */
+		} else if( ( opt == 'w' ) && ( sscanf( optarg, "%lf", &pause ) == 1 ) && ( pause >= 0 ) ) {
+			continue; /* pause before sending */
+		} else if( opt == 'c' ) {
+			cold = 1; /* evict files */
+		} else if( ( opt == 'S' ) && ( sscanf( optarg, "%ld", &seed ) == 1 ) ) {
+			continue; /* random seed */
+		} else {
+			break;
+		}
+	}
+	if( ( opt != -1 ) || ( optind != argc - 1 ) ) {
+		printf( "usage: sws-gen [-n files] [-D depth] [-F fanout] [-d lognormal|pareto|bimodal]\n"
+		        "               [-m size] [-s shape] [-M size] [-B large_pct] [-x max_size]\n"
+		        "               [-r requests] [-z zipf] [-R rate] [-p port] [-w pause]\n"
+		        "               [-c] [-S seed] dir\n" );
+		return 1;
+	}
+	root = argv[optind];
+	for( opt = strlen( root ); ( opt > 1 ) && ( root[opt - 1] == '/' ); opt-- ) {
+		root[opt - 1] = '\0'; /* paths under it are root/... */
+	}
+	if( shape < 0 ) {
+		shape = dist == D_PARETO ? 1.2 : 1.5;
+	}
+
+	srand48( seed );
+	if( count && make_root( count, depth, fanout ) ) {
+		perror( "Error while creating document root" );
+		return 1;
+	}
+	if( ( requests || cold ) && nftw( root, find_file, OPEN_FDS, FTW_PHYS ) ) {
+		perror( "Error while reading document root" );
+		return 1;
+	}
+	if( requests && !num_files ) {
+		fprintf( stderr, "sws-gen: no files under %s\n", root );
+		return 1;
+	} else if( requests ) {
+		srand48( seed ); /* same script, whether or not the root was just made */
+		write_script( requests, port, zipf, rate, pause );
+	}
+	if( cold ) {
+		fprintf( stderr, "sws-gen: evicted %d of %d files from the page cache\n", evicted, num_files );
+	}
+	return 0;
+}
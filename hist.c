@@ -0,0 +1,137 @@
+/*
+ * File: hist.c
+ * Author: agent
+ * Purpose: This file contains the histogram module, which records values,
+ *         such as response times, for percentiles to be read off later.
+ *         Please see hist.h for documentation on how to use this module.
+ */
+
+#include <string.h>
+
+#include "hist.h"
+
+#define SUB_BITS 6 /* log2 of HIST_SUB */
+
+
+/* This function finds the bucket of a value.  Values below 2 * HIST_SUB
+ *    are their own bucket; above, the top SUB_BITS + 1 bits of the value
+ *    and how far they are shifted pick the bucket.
+ * Parameters:
+ *    value : the value
+ * Returns: The index of the bucket.
+ */
+static int bucket_of( uint64_t value ) {
+	int shift; /* bits dropped */
+
+	if( value < 2 * HIST_SUB ) {
+		return (int)value;
+	}
+	shift = 63 - __builtin_clzll( value ) - SUB_BITS;
+	return shift * HIST_SUB + (int)( value >> shift );
+}
+
+
+/* This function finds the largest value in a bucket.
+ * Parameters:
+ *    index : the index of the bucket
+ * Returns: The largest value that falls in the bucket.
+ */
+static uint64_t top_of( int index ) {
+	int shift; /* bits dropped */
+
+	if( index < 2 * HIST_SUB ) {
+		return (uint64_t)index;
+	}
+	shift = index / HIST_SUB - 1;
+	return ( ( (uint64_t)( index % HIST_SUB + HIST_SUB + 1 ) ) << shift ) - 1;
+}
+
+
+/* This function empties a histogram.
+ * Parameters:
+ *    h : the histogram
+ * Returns: None
+ */
+extern void hist_init( struct hist *h ) {
+	memset( h, 0, sizeof( struct hist ) );
+	h->min = UINT64_MAX;
+}
+
+
+/* This function records a value.
+ * Parameters:
+ *    h     : the histogram
+ *    value : the value
+ * Returns: None
+ */
+extern void hist_add( struct hist *h, uint64_t value ) {
+	h->counts[bucket_of( value )]++;
+	h->count++;
+	h->sum += value;
+	if( value < h->min ) {
+		h->min = value;
+	}
+	if( value > h->max ) {
+		h->max = value;
+	}
+}
+
+
+/* This function adds the values of one histogram to another.
+ * Parameters:
+ *    dst : the histogram added to
+ *    src : the histogram added
+ * Returns: None
+ */
+extern void hist_merge( struct hist *dst, const struct hist *src ) {
+	int i; /* bucket index */
+
+	for( i = 0; i < HIST_BUCKETS; i++ ) {
+		dst->counts[i] += src->counts[i];
+	}
+	dst->count += src->count;
+	dst->sum += src->sum;
+	if( src->min < dst->min ) {
+		dst->min = src->min;
+	}
+	if( src->max > dst->max ) {
+		dst->max = src->max;
+	}
+}
+
+
+/* This function reads a percentile off a histogram.
+ * Parameters:
+ *    h   : the histogram
+ *    pct : the percentile, from 0 to 100
+ * Returns: The largest value in the bucket holding the percentile, but no
+ *          more than the largest value recorded, or 0 if h is empty.
+ */
+extern uint64_t hist_percentile( const struct hist *h, double pct ) {
+	uint64_t rank = (uint64_t)( pct / 100 * h->count + 0.5 ); /* values at or below */
+	uint64_t seen = 0; /* values in buckets so far */
+	int i; /* bucket index */
+
+	if( !h->count ) {
+		return 0;
+	} else if( rank < 1 ) {
+		rank = 1;
+	}
+	for( i = 0; i < HIST_BUCKETS; i++ ) {
+		seen += h->counts[i];
+		if( seen >= rank ) {
+			break;
+		}
+	}
+	return top_of( i ) < h->max ? top_of( i ) : h->max;
+}
+
+
+/* This function gets the mean of the values recorded.
+ * Parameters:
+ *    h : the histogram
+ * Returns: The mean, or 0 if h is empty.
+ */
+extern double hist_mean( const struct hist *h ) {
+	return h->count ? (double)h->sum / h->count : 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * File: hist.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          histogram module, which records values, such as response times,
+ *          for percentiles to be read off later.
+ */
+
+#ifndef HIST_H
+#define HIST_H
+
+#include <stdint.h>
+
+#define HIST_SUB 64 /* buckets per power of two, for ~1.5% precision */
+#define HIST_BUCKETS ( 59 * HIST_SUB ) /* enough for any 64-bit value */
+
+/*
+ * This module has five functions:
+ *   hist_init()       : empty a histogram
+ *   hist_add()        : record a value
+ *   hist_merge()      : add one histogram's values to another
+ *   hist_percentile() : read a percentile off a histogram
+ *   hist_mean()       : get the mean of the values recorded
+ *
+ * The histogram is log-linear, in the manner of HDR histograms: values
+ * below 2 * HIST_SUB each get a bucket of their own, and each power of two
+ * above that is split into HIST_SUB equal buckets, so every value is kept
+ * to within 1 part in HIST_SUB, from nanoseconds to centuries, in a fixed
+ * HIST_BUCKETS counters.  Recording is a few shifts and an increment.
+ * Because the buckets are the same for every histogram, histograms kept
+ * apart, e.g., by separate client processes, are merged exactly by adding
+ * their counters, and a histogram can be passed through a pipe as is.
+ */
+
+struct hist {
+	uint64_t count;                  /* # of values recorded */
+	uint64_t sum;                    /* sum of values recorded */
+	uint64_t min;                    /* smallest value recorded */
+	uint64_t max;                    /* largest value recorded */
+	uint64_t counts[HIST_BUCKETS];   /* # of values in each bucket */
+};
+
+
+/* This function empties a histogram.
+ * Parameters:
+ *    h : the histogram
+ * Returns: None
+ */
+extern void hist_init( struct hist *h );
+
+
+/* This function records a value.
+ * Parameters:
+ *    h     : the histogram
+ *    value : the value
+ * Returns: None
+ */
+extern void hist_add( struct hist *h, uint64_t value );
+
+
+/* This function adds the values of one histogram to another.
+ * Parameters:
+ *    dst : the histogram added to
+ *    src : the histogram added
+ * Returns: None
+ */
+extern void hist_merge( struct hist *dst, const struct hist *src );
+
+
+/* This function reads a percentile off a histogram.
+ * Parameters:
+ *    h   : the histogram
+ *    pct : the percentile, from 0 to 100
+ * Returns: The largest value in the bucket holding the percentile, but no
+ *          more than the largest value recorded, or 0 if h is empty.
+ */
+extern uint64_t hist_percentile( const struct hist *h, double pct );
+
+
+/* This function gets the mean of the values recorded.
+ * Parameters:
+ *    h : the histogram
+ * Returns: The mean, or 0 if h is empty.
+ */
+extern double hist_mean( const struct hist *h );
+
+#endif
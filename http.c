@@ -0,0 +1,350 @@
+/*
+ * File: http.c
+ * Author: agent
+ * Purpose: This file contains the http module, which recognizes and parses
+ *         client requests held in a chain of buffers.
+ *         Please see http.h for documentation on how to use this module.
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "http.h"
+
+/* The scan state packs four fields into one int, so that it costs an idle
+ * connection no more than the int itself. */
+#define PHASE(s) ( (s) & 0x3 )           /* where we are in the request */
+#define MATCH(s) ( ( (s) >> 4 ) & 0xf )  /* chars of " HTTP/" matched */
+#define VERSIONED(s) ( ( (s) >> 8 ) & 1 ) /* first line has a version */
+#define NEWLINE(s) ( ( (s) >> 12 ) & 0x3 ) /* chars of a blank line seen */
+#define STATE(p, m, v, n) ( (p) | ( (m) << 4 ) | ( (v) << 8 ) | ( (n) << 12 ) )
+
+#define PHASE_LINE 0 /* reading the first line */
+#define PHASE_HEADERS 1 /* reading the headers */
+#define PHASE_DONE 2 /* request is complete */
+
+static const char version[] = " HTTP/"; /* marks a versioned request */
+
+#define NAME_MAX_LEN 32 /* longest header name kept */
+#define VALUE_MAX_LEN 256 /* longest header value kept */
+
+/* Cursor used to walk a chain of buffers one character at a time. */
+struct cursor {
+	struct buffer *buf; /* current buffer */
+	size_t off; /* offset within buffer */
+	size_t pos; /* offset within request */
+	int last; /* last char returned */
+};
+
+
+/* This function scans newly read bytes of a request.
+ * Parameters:
+ *    state : scan state, HTTP_SCAN_INIT before the first call
+ *    data  : the new bytes
+ *    len   : the number of new bytes
+ * Returns: 1 if the request is now complete, 0 otherwise
+ */
+extern int http_scan( int *state, const char *data, size_t len ) {
+	int phase = PHASE( *state ); /* unpack state */
+	int match = MATCH( *state );
+	int versioned = VERSIONED( *state );
+	int newline = NEWLINE( *state );
+	size_t i; /* data index */
+	char c; /* current char */
+
+	for( i = 0; ( i < len ) && ( phase != PHASE_DONE ); i++ ) {
+		c = data[i];
+		if( phase == PHASE_LINE ) { /* look for the version */
+			if( c == '\n' ) { /* end of first line */
+				phase = versioned ? PHASE_HEADERS : PHASE_DONE;
+				newline = 1;
+			} else if( !versioned ) {
+				match = ( c == version[match] ) ? match + 1 : ( c == ' ' );
+				versioned = ( version[match] == '\0' );
+			}
+		} else if( c == '\n' ) { /* look for a blank line */
+			phase = newline ? PHASE_DONE : phase;
+			newline = 1;
+		} else {
+			newline = ( ( c == '\r' ) && ( newline == 1 ) ) ? 2 : 0;
+		}
+	}
+
+	*state = STATE( phase, match, versioned, newline );
+	return phase == PHASE_DONE;
+}
+
+
+/* This function returns the next char under a cursor and advances it.
+ * Parameters:
+ *    cur : the cursor
+ * Returns: the next char, or -1 at the end of the chain
+ */
+static int next_char( struct cursor *cur ) {
+	while( cur->buf && ( cur->off == cur->buf->len ) ) { /* skip to next buf */
+		cur->buf = cur->buf->next;
+		cur->off = 0;
+	}
+	if( !cur->buf ) { /* end of chain */
+		return cur->last = -1;
+	}
+	cur->pos++;
+	return cur->last = (unsigned char)cur->buf->data[cur->off++];
+}
+
+
+/* This function copies the next token of the first line of a request.
+ *    Leading spaces are skipped; the token ends at a space or end of line.
+ * Parameters:
+ *    cur  : cursor at the start of the token
+ *    tok  : buffer to copy the token to
+ *    size : size of tok, including the NUL
+ * Returns: the length of the token, or -1 if it does not fit in tok
+ */
+static int next_token( struct cursor *cur, char *tok, int size ) {
+	int len = 0; /* length of token */
+	int c; /* current char */
+
+	do { /* skip leading spaces */
+		c = next_char( cur );
+	} while( c == ' ' );
+
+	for( ; ( c >= 0 ) && ( c != ' ' ) && ( c != '\r' ) && ( c != '\n' ); c = next_char( cur ) ) {
+		if( len == size - 1 ) { /* token too long */
+			return -1;
+		}
+		tok[len++] = c;
+	}
+	tok[len] = '\0';
+	return len;
+}
+
+
+/* This function skips to the start of the next line.
+ * Parameters:
+ *    cur : the cursor
+ * Returns: None
+ */
+static void skip_line( struct cursor *cur ) {
+	while( ( cur->last >= 0 ) && ( cur->last != '\n' ) ) {
+		next_char( cur );
+	}
+}
+
+
+/* This function reads the next header line of a request.  The name is
+ *    lowercased and the value has surrounding spaces removed; both are cut
+ *    short if they do not fit.
+ * Parameters:
+ *    cur   : cursor at the start of a line
+ *    name  : buffer for the name, NAME_MAX_LEN bytes
+ *    value : buffer for the value, VALUE_MAX_LEN bytes
+ * Returns: 0 if a header was read, or -1 at the blank line ending the
+ *          headers (or the end of the request).
+ */
+static int next_header( struct cursor *cur, char *name, char *value ) {
+	int len = 0; /* length of name or value */
+	int c; /* current char */
+
+	c = next_char( cur );
+	if( c == '\r' ) {
+		c = next_char( cur );
+	}
+	if( ( c == '\n' ) || ( c < 0 ) ) { /* blank line */
+		return -1;
+	}
+
+	for( ; ( c >= 0 ) && ( c != ':' ) && ( c != '\n' ); c = next_char( cur ) ) {
+		if( len < NAME_MAX_LEN - 1 ) {
+			name[len++] = tolower( c );
+		}
+	}
+	name[len] = '\0';
+
+	len = 0;
+	if( c == ':' ) { /* read value */
+		do { /* skip leading spaces */
+			c = next_char( cur );
+		} while( ( c == ' ' ) || ( c == '\t' ) );
+		for( ; ( c >= 0 ) && ( c != '\n' ); c = next_char( cur ) ) {
+			if( len < VALUE_MAX_LEN - 1 ) {
+				value[len++] = c;
+			}
+		}
+		while( ( len > 0 ) && isspace( (unsigned char)value[len - 1] ) ) {
+			len--;
+		}
+	}
+	value[len] = '\0';
+	return 0;
+}
+
+
+/* This function copies the value of a Host header, lowercasing it and
+ *    dropping the port, if any.  A host too long to be valid is dropped.
+ * Parameters:
+ *    host  : buffer for the host, HTTP_HOST_MAX bytes
+ *    value : the value of the header
+ * Returns: None
+ */
+static void copy_host( char *host, const char *value ) {
+	const char *end = strrchr( value, ':' ); /* start of port */
+	size_t len; /* length of host */
+
+	if( !end || strchr( end, ']' ) ) { /* no port, or an IPv6 address */
+		end = value + strlen( value );
+	}
+	len = end - value;
+	if( len >= HTTP_HOST_MAX ) {
+		len = 0;
+	}
+	host[len] = '\0';
+	while( len-- > 0 ) {
+		host[len] = tolower( (unsigned char)value[len] );
+	}
+}
+
+
+/* This function decodes a path in place: its query is dropped, and each
+ *    %xx escape is replaced by the byte it stands for.
+ * Parameters:
+ *    path : the path
+ * Returns: 0 on success, or -1 if an escape is bad or a byte is a control
+ *          character.
+ */
+static int decode_path( char *path ) {
+	char *in, *out; /* next byte to read, and to write */
+	char hex[3] = { 0 }; /* digits of an escape */
+	char *end; /* end of number */
+
+	path[strcspn( path, "?" )] = '\0'; /* drop query */
+	for( in = out = path; *in; in++, out++ ) {
+		*out = *in;
+		if( *in == '%' ) {
+			hex[0] = in[1];
+			hex[1] = hex[0] ? in[2] : '\0';
+			*out = (char)strtol( hex, &end, 16 );
+			if( ( end != hex + 2 ) || !isxdigit( (unsigned char)hex[0] ) ) {
+				return -1; /* bad escape */
+			}
+			in += 2;
+		}
+		if( iscntrl( (unsigned char)*out ) ) {
+			return -1;
+		}
+	}
+	*out = '\0';
+	return 0;
+}
+
+
+/* This function parses a complete request held in a chain of buffers,
+ *    pulling out the method, the path and the Host and Content-Length
+ *    headers.
+ * Parameters:
+ *    chain : the first buffer of the request
+ *    req   : structure to be filled in
+ * Returns: 0 on success, or the HTTP status code to send back if the
+ *          request is malformed (400) or its path is too long (414).
+ */
+extern int http_parse( struct buffer *chain, struct http_req *req ) {
+	struct cursor cur = { chain, 0, 0, 0 }; /* position in request */
+	char name[NAME_MAX_LEN]; /* header name */
+	char value[VALUE_MAX_LEN]; /* header value */
+	char *end; /* end of number */
+	int len; /* token length */
+
+	req->length = -1;
+	req->host[0] = '\0';
+
+	/* standard requests are of the form GET /foo/bar/qux.html HTTP/1.1
+	 * We want the first token (the method) and the second (the path). */
+	if( next_token( &cur, req->method, HTTP_METHOD_MAX ) <= 0 ) {
+		return 400;
+	}
+
+	len = next_token( &cur, req->path, HTTP_PATH_MAX );
+	if( len < 0 ) { /* path too long */
+		return 414;
+	} else if( ( len == 0 ) || decode_path( req->path ) ) { /* no path, or bad */
+		return 400;
+	}
+
+	/* a version means headers follow, up to a blank line */
+	len = ( cur.last == ' ' ) ? next_token( &cur, value, VALUE_MAX_LEN ) : 0;
+	skip_line( &cur );
+	while( ( len != 0 ) && !next_header( &cur, name, value ) ) {
+		if( !strcmp( name, "content-length" ) ) {
+			req->length = strtoll( value, &end, 10 );
+			if( ( end == value ) || *end || ( req->length < 0 ) ) {
+				return 400;
+			}
+		} else if( !strcmp( name, "host" ) ) {
+			copy_host( req->host, value );
+		}
+	}
+
+	req->header_len = cur.pos;
+	return 0;
+}
+
+
+/* This function checks that a path stays inside the root it is served
+ *    from: it must start with /, and have no empty segment (e.g., //etc or
+ *    /a//b) and no . or .. segment.  A trailing /, naming a directory, is
+ *    allowed.
+ * Parameters:
+ *    path : the requested path
+ * Returns: 1 if the path is safe, 0 if not.
+ */
+extern int http_path_safe( const char *path ) {
+	const char *seg; /* start of segment */
+	size_t len; /* its length */
+
+	if( path[0] != '/' ) {
+		return 0;
+	}
+	for( seg = path + 1; *seg; seg += len + 1 ) {
+		len = strcspn( seg, "/" );
+		if( !len || !strncmp( seg, ".", len ) || !strncmp( seg, "..", len ) ) {
+			return 0; /* empty, . or .. */
+		} else if( !seg[len] ) { /* last segment */
+			break;
+		}
+	}
+	return 1;
+}
+
+
+/* This function escapes a path for use in a URL, e.g., in a link or a
+ *    Location header.
+ * Parameters:
+ *    url  : where to put the escaped path
+ *    size : bytes of room at url, including the NUL
+ *    path : the path
+ * Returns: The length of the escaped path, or -1 if it does not fit.
+ */
+extern int http_encode_path( char *url, size_t size, const char *path ) {
+	static const char digits[] = "0123456789ABCDEF"; /* hex digits */
+	unsigned char c; /* byte of path */
+	size_t len = 0; /* length of escaped path */
+
+	for( ; *path; path++ ) {
+		c = *path;
+		if( len + 4 > size ) { /* room for an escape and the NUL */
+			return -1;
+		} else if( isalnum( c ) || strchr( "/-._~", c ) ) {
+			url[len++] = c;
+		} else {
+			url[len++] = '%';
+			url[len++] = digits[c >> 4];
+			url[len++] = digits[c & 0xf];
+		}
+	}
+	if( len >= size ) {
+		return -1;
+	}
+	url[len] = '\0';
+	return len;
+}
@@ -0,0 +1,107 @@
+/*
+ * File: http.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          http module, which recognizes and parses client requests held in
+ *          a chain of buffers.
+ */
+
+#ifndef HTTP_H
+#define HTTP_H
+
+#include <stddef.h>
+
+#include "buffer.h"
+
+#define HTTP_METHOD_MAX 16   /* longest method, including the NUL */
+#define HTTP_PATH_MAX 4096   /* longest path, including the NUL */
+#define HTTP_HOST_MAX 256    /* longest host, including the NUL */
+
+#define HTTP_SCAN_INIT 0     /* scan state of a request not yet started */
+#define HTTP_OVERFLOW -1     /* scan state of a request over the limit */
+
+/*
+ * This module has four functions:
+ *   http_scan()        : look at new bytes to see if the request is complete
+ *   http_parse()       : pull the method, path and headers we use out of a
+ *                        complete request
+ *   http_path_safe()   : check that a path stays inside the root served from
+ *   http_encode_path() : escape a path for use in a URL
+ *
+ * A request is read into a chain of buffers, linked through their next
+ * field, that grows one buffer at a time.  http_scan() is called on each
+ * run of new bytes as it arrives and remembers how far it got in an int of
+ * state, so a request can be split across buffers anywhere, even in the
+ * middle of the blank line that ends it.  A request is complete once its
+ * headers end with a blank line, or once its first line is in if it is a
+ * simple request without an HTTP version.
+ *
+ * http_parse() walks the same chain in place; only the tokens it returns
+ * are copied out, the request itself is never moved into one piece.  Any
+ * bytes read past the headers are the start of the request's body.  The
+ * path is returned decoded: its query, if any, is dropped and each %xx
+ * escape is replaced by the byte it stands for.  A path with a bad escape,
+ * or one that decodes to a control character, is malformed.  Going the
+ * other way, http_encode_path() escapes every byte of a path but letters,
+ * digits, / and -._~, so that a name with, e.g., #, ? or % in it can be
+ * linked to or redirected to.
+ *
+ * Paths are looked up relative to the root they are served from, with the
+ * leading / dropped, so one whose rest is itself absolute, e.g.,
+ * //etc/passwd, or that climbs out with .., would name a file outside it.
+ * http_path_safe() must pass a path before it is used to look anything up.
+ */
+
+struct http_req {
+	char method[HTTP_METHOD_MAX]; /* e.g., GET */
+	char path[HTTP_PATH_MAX];     /* e.g., /foo/bar/qux.html */
+	char host[HTTP_HOST_MAX];     /* Host, lowercase without port, or "" */
+	long long length;             /* Content-Length, -1 if not given */
+	size_t header_len;            /* bytes before the body */
+};
+
+
+/* This function scans newly read bytes of a request.
+ * Parameters:
+ *    state : scan state, HTTP_SCAN_INIT before the first call
+ *    data  : the new bytes
+ *    len   : the number of new bytes
+ * Returns: 1 if the request is now complete, 0 otherwise
+ */
+extern int http_scan( int *state, const char *data, size_t len );
+
+
+/* This function parses a complete request held in a chain of buffers,
+ *    pulling out the method, the path and the Host and Content-Length
+ *    headers.
+ * Parameters:
+ *    chain : the first buffer of the request
+ *    req   : structure to be filled in
+ * Returns: 0 on success, or the HTTP status code to send back if the
+ *          request is malformed (400) or its path is too long (414).
+ */
+extern int http_parse( struct buffer *chain, struct http_req *req );
+
+
+/* This function checks that a path stays inside the root it is served
+ *    from: it must start with /, and have no empty segment (e.g., //etc or
+ *    /a//b) and no . or .. segment.  A trailing /, naming a directory, is
+ *    allowed.
+ * Parameters:
+ *    path : the requested path
+ * Returns: 1 if the path is safe, 0 if not.
+ */
+extern int http_path_safe( const char *path );
+
+
+/* This function escapes a path for use in a URL, e.g., in a link or a
+ *    Location header.
+ * Parameters:
+ *    url  : where to put the escaped path
+ *    size : bytes of room at url, including the NUL
+ *    path : the path
+ * Returns: The length of the escaped path, or -1 if it does not fit.
+ */
+extern int http_encode_path( char *url, size_t size, const char *path );
+
+#endif
@@ -0,0 +1,317 @@
+/*
+ * File: listing.c
+ * Author: agent
+ * Purpose: This file contains the listing module, which renders and caches
+ *         listings of directories.
+ *         Please see listing.h for documentation on how to use this module.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "http.h"
+#include "listing.h"
+#include "util.h"
+
+#define SLOTS 1024 /* # of listings kept, a power of two */
+#define EVENT_SIZE 4096 /* size of inotify read buffer */
+#define WATCH_MASK ( IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                     IN_DELETE_SELF | IN_MOVE_SELF | IN_ONESHOT ) /* changes */
+
+static int notify_fd = -1; /* inotify instance */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; /* guards all below */
+static struct listing *slots[SLOTS]; /* kept listings, by hash */
+static size_t entries; /* counters for listing_stats() */
+static size_t hits;
+static size_t renders;
+static size_t invalidations;
+
+
+/* This function compares two names, for qsort().
+ * Parameters:
+ *    a : pointer to the first name
+ *    b : pointer to the second name
+ * Returns: <0, 0 or >0 as the first sorts before, with or after the second.
+ */
+static int compare_names( const void *a, const void *b ) {
+	return strcmp( *(char * const *)a, *(char * const *)b );
+}
+
+
+/* This function writes text with the characters special to HTML escaped.
+ * Parameters:
+ *    out  : where to write
+ *    text : the text
+ * Returns: None
+ */
+static void put_escaped( FILE *out, const char *text ) {
+	for( ; *text; text++ ) {
+		if( *text == '&' ) {
+			fputs( "&amp;", out );
+		} else if( *text == '<' ) {
+			fputs( "&lt;", out );
+		} else if( *text == '>' ) {
+			fputs( "&gt;", out );
+		} else if( *text == '"' ) {
+			fputs( "&quot;", out );
+		} else {
+			fputc( *text, out );
+		}
+	}
+}
+
+
+/* This function asks inotify to report the next change to a directory.
+ * Parameters:
+ *    dir  : directory the path is relative to
+ *    path : path of the directory
+ * Returns: The watch descriptor, or -1 if the directory cannot be watched.
+ */
+static int watch( int dir, const char *path ) {
+	char name[32]; /* path of descriptor */
+	int fd; /* the directory */
+	int wd = -1; /* watch descriptor */
+
+	fd = openat( dir, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+	if( ( notify_fd >= 0 ) && ( fd >= 0 ) ) { /* inotify wants a path */
+		sprintf( name, "/proc/self/fd/%d", fd );
+		wd = inotify_add_watch( notify_fd, name, WATCH_MASK );
+	}
+	if( fd >= 0 ) {
+		close( fd );
+	}
+	return wd;
+}
+
+
+/* This function reads a directory and renders its listing.
+ * Parameters:
+ *    dir  : directory the path is relative to
+ *    path : path of the directory
+ *    url  : the path the client asked for, shown as the title
+ * Returns: The listing, with no references, or NULL if the directory could
+ *          not be read.
+ */
+static struct listing *render( int dir, const char *path, const char *url ) {
+	struct listing *list; /* new listing */
+	struct dirent *ent; /* directory entry */
+	struct stat st; /* status of entry */
+	char **names = NULL; /* names of entries, / appended to directories */
+	char link[3 * ( NAME_MAX + 1 ) + 1]; /* a name, escaped for a link */
+	char **more; /* grown names */
+	size_t num = 0; /* # of names */
+	size_t i; /* name index */
+	int is_dir; /* entry is a directory? */
+	FILE *out; /* rendered listing */
+	DIR *d; /* directory being read */
+	int fd; /* the directory */
+
+	fd = openat( dir, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+	d = fd >= 0 ? fdopendir( fd ) : NULL;
+	if( !d ) {
+		if( fd >= 0 ) {
+			close( fd );
+		}
+		return NULL;
+	}
+
+	while( ( ent = readdir( d ) ) ) {
+		if( ent->d_name[0] == '.' ) { /* hidden, or . and .. */
+			continue;
+		}
+		is_dir = ent->d_type == DT_DIR;
+		if( ( ent->d_type == DT_UNKNOWN ) || ( ent->d_type == DT_LNK ) ) { /* ask */
+			is_dir = !fstatat( dirfd( d ), ent->d_name, &st, 0 ) && S_ISDIR( st.st_mode );
+		}
+
+		more = realloc( names, ( num + 1 ) * sizeof( char * ) );
+		if( !more ) {
+			break;
+		}
+		names = more;
+		names[num] = malloc( strlen( ent->d_name ) + 2 );
+		if( !names[num] ) {
+			break;
+		}
+		sprintf( names[num++], "%s%s", ent->d_name, is_dir ? "/" : "" );
+	}
+	closedir( d );
+	qsort( names, num, sizeof( char * ), compare_names );
+
+	list = malloc( sizeof( struct listing ) + strlen( path ) + 1 );
+	out = list ? open_memstream( &list->data, &list->size ) : NULL;
+	if( out ) {
+		fputs( "<html><head><title>Index of ", out );
+		put_escaped( out, url );
+		fputs( "</title></head>\n<body><h1>Index of ", out );
+		put_escaped( out, url );
+		fputs( "</h1>\n<ul>\n", out );
+		if( strcmp( url, "/" ) ) { /* not the root, link to parent */
+			fputs( "<li><a href=\"../\">../</a></li>\n", out );
+		}
+		for( i = 0; i < num; i++ ) { /* an escaped URL needs no HTML escapes */
+			http_encode_path( link, sizeof( link ), names[i] );
+			fputs( "<li><a href=\"", out );
+			fputs( link, out );
+			fputs( "\">", out );
+			put_escaped( out, names[i] );
+			fputs( "</a></li>\n", out );
+		}
+		fputs( "</ul></body></html>\n", out );
+	}
+
+	for( i = 0; i < num; i++ ) {
+		free( names[i] );
+	}
+	free( names );
+	if( !out || fclose( out ) ) { /* check for errors */
+		free( list );
+		return NULL;
+	}
+
+	list->dir = dir;
+	list->wd = -1;
+	list->hash = util_hash_str( UTIL_HASH_BASIS ^ (unsigned)dir, path );
+	strcpy( list->path, path );
+	return list;
+}
+
+
+/* This function starts watching for changes to directories.  It must be
+ *    called before any other function in this module.
+ * Parameters: None
+ * Returns: The inotify descriptor to wait on, or -1 if there is none, in
+ *          which case listings are never kept.
+ */
+extern int listing_init() {
+	notify_fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+	if( notify_fd < 0 ) {
+		perror( "Error while starting inotify, listings will not be cached" );
+	}
+	return notify_fd;
+}
+
+
+/* This function gets the listing of a directory, rendering it if it is not
+ *    kept.  A reference to the listing is held for the caller.
+ * Parameters:
+ *    dir  : directory the path is relative to
+ *    path : path of the directory, "." for dir itself
+ *    url  : the path the client asked for, ending in /, shown as the title
+ * Returns: The listing, or NULL if the directory could not be read.
+ */
+extern struct listing *listing_get( int dir, const char *path, const char *url ) {
+	unsigned hash = util_hash_str( UTIL_HASH_BASIS ^ (unsigned)dir, path ); /* hash of path */
+	struct listing **slot = &slots[hash & ( SLOTS - 1 )]; /* where it is kept */
+	struct listing *list; /* listing found */
+	struct listing *old = NULL; /* listing replaced */
+	int wd; /* watch on directory */
+
+	pthread_mutex_lock( &lock );
+	list = *slot;
+	if( list && ( list->hash == hash ) && ( list->dir == dir ) && !strcmp( list->path, path ) ) {
+		atomic_fetch_add( &list->refs, 1 );
+		hits++;
+		pthread_mutex_unlock( &lock );
+		return list;
+	}
+	pthread_mutex_unlock( &lock );
+
+	wd = watch( dir, path ); /* arm first, so no change is missed */
+	list = render( dir, path, url );
+	if( !list ) {
+		return NULL;
+	}
+	list->wd = wd;
+	atomic_init( &list->refs, wd >= 0 ? 2 : 1 ); /* caller, and table if kept */
+
+	pthread_mutex_lock( &lock );
+	renders++;
+	if( wd >= 0 ) { /* keep it */
+		old = *slot;
+		entries += !old;
+		*slot = list;
+	}
+	pthread_mutex_unlock( &lock );
+
+	if( old ) {
+		listing_put( old );
+	}
+	return list;
+}
+
+
+/* This function gives back a reference to a listing, freeing it if it has
+ *    been dropped and this was the last.
+ * Parameters:
+ *    list : the listing
+ * Returns: None
+ */
+extern void listing_put( struct listing *list ) {
+	if( atomic_fetch_sub( &list->refs, 1 ) == 1 ) {
+		free( list->data );
+		free( list );
+	}
+}
+
+
+/* This function reads the changes reported by inotify and drops the
+ *    listings of the directories that have changed.  If inotify's queue
+ *    overflowed, changes were lost, so every listing is dropped.  It is
+ *    called when the descriptor returned by listing_init() is readable.
+ * Parameters: None
+ * Returns: None
+ */
+extern void listing_events() {
+	char buf[EVENT_SIZE] __attribute__( ( aligned( __alignof__( struct inotify_event ) ) ) );
+	struct inotify_event *ev; /* event read */
+	struct listing *dropped[SLOTS]; /* listings to give back */
+	size_t num = 0; /* # of listings dropped */
+	ssize_t len; /* bytes of events read */
+	ssize_t off; /* offset of event */
+	size_t i; /* slot index */
+
+	while( ( len = read( notify_fd, buf, EVENT_SIZE ) ) > 0 ) {
+		pthread_mutex_lock( &lock );
+		for( off = 0; off < len; off += sizeof( struct inotify_event ) + ev->len ) {
+			ev = (struct inotify_event *)( buf + off );
+			for( i = 0; i < SLOTS; i++ ) { /* a dir may be listed by many sites */
+				if( slots[i] && ( ( ev->mask & IN_Q_OVERFLOW ) || ( slots[i]->wd == ev->wd ) ) &&
+				    ( num < SLOTS ) ) {
+					dropped[num++] = slots[i];
+					slots[i] = NULL;
+					entries--;
+					invalidations++;
+				}
+			}
+		}
+		pthread_mutex_unlock( &lock );
+	}
+
+	for( i = 0; i < num; i++ ) {
+		listing_put( dropped[i] );
+	}
+}
+
+
+/* This function reports how the listing cache is doing.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void listing_stats( struct listing_stats *stats ) {
+	pthread_mutex_lock( &lock );
+	stats->entries = entries;
+	stats->hits = hits;
+	stats->renders = renders;
+	stats->invalidations = invalidations;
+	pthread_mutex_unlock( &lock );
+}
@@ -0,0 +1,105 @@
+/*
+ * File: listing.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          listing module, which renders and caches listings of directories.
+ */
+
+#ifndef LISTING_H
+#define LISTING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+/*
+ * This module has five functions:
+ *   listing_init()   : start watching for changes to directories
+ *   listing_get()    : get the listing of a directory, rendering it if needed
+ *   listing_put()    : give back a listing
+ *   listing_events() : drop listings of directories that have changed
+ *   listing_stats()  : report how the listing cache is doing
+ *
+ * A listing is an HTML page linking to the entries of a directory, sorted
+ * by name; hidden entries (those starting with .) are left out.  Rendered
+ * listings are kept, so browsing a large tree does not read a directory
+ * on every request.  Rather than checking a directory on each lookup, the
+ * module asks inotify to report the next change to it: the watch is armed
+ * before the directory is read, so no change can slip in between.  The
+ * inotify descriptor returned by listing_init() becomes readable when a
+ * change is reported, and the thread running the event loop then calls
+ * listing_events() to drop the listings concerned, or all of them if
+ * inotify's queue overflowed and changes were lost.  Names are escaped in
+ * links (see http_encode_path() in http.h) and in the text shown.
+ *
+ * Listings are reference counted like cache entries: listing_get()
+ * returns one with a reference held for the caller, who gives it back
+ * with listing_put().  If inotify is not available, listings are rendered
+ * afresh for each request.  All functions but listing_init() are thread
+ * safe.
+ */
+
+struct listing {
+	atomic_int refs; /* # of references held */
+	int dir;         /* directory path is relative to */
+	int wd;          /* inotify watch on directory, -1 if none */
+	unsigned hash;   /* hash of dir and path */
+	size_t size;     /* bytes of data */
+	char *data;      /* the rendered listing */
+	char path[];     /* path of directory */
+};
+
+struct listing_stats {
+	size_t entries;       /* # of listings kept */
+	size_t hits;          /* # of lookups found kept */
+	size_t renders;       /* # of listings rendered */
+	size_t invalidations; /* # of listings dropped after a change */
+};
+
+
+/* This function starts watching for changes to directories.  It must be
+ *    called before any other function in this module.
+ * Parameters: None
+ * Returns: The inotify descriptor to wait on, or -1 if there is none, in
+ *          which case listings are never kept.
+ */
+extern int listing_init();
+
+
+/* This function gets the listing of a directory, rendering it if it is not
+ *    kept.  A reference to the listing is held for the caller.
+ * Parameters:
+ *    dir  : directory the path is relative to
+ *    path : path of the directory, "." for dir itself
+ *    url  : the path the client asked for, ending in /, shown as the title
+ * Returns: The listing, or NULL if the directory could not be read.
+ */
+extern struct listing *listing_get( int dir, const char *path, const char *url );
+
+
+/* This function gives back a reference to a listing, freeing it if it has
+ *    been dropped and this was the last.
+ * Parameters:
+ *    list : the listing
+ * Returns: None
+ */
+extern void listing_put( struct listing *list );
+
+
+/* This function reads the changes reported by inotify and drops the
+ *    listings of the directories that have changed.  If inotify's queue
+ *    overflowed, changes were lost, so every listing is dropped.  It is
+ *    called when the descriptor returned by listing_init() is readable.
+ * Parameters: None
+ * Returns: None
+ */
+extern void listing_events();
+
+
+/* This function reports how the listing cache is doing.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void listing_stats( struct listing_stats *stats );
+
+#endif
@@ -0,0 +1,720 @@
+/*
+ * File: load.c
+ * Author: agent
+ * Purpose: This file contains sws-load, a load generator for the web
+ *          server.  It replays a test script in the same format as the one
+ *          hydra.py reads, driving every connection from one thread with
+ *          epoll rather than a thread per request, and reports response
+ *          times, slowdowns, fairness and latency percentiles by response
+ *          size, as JSON, so that runs of the server in different modes
+ *          can be compared on the same workload.
+ *
+ *          The script is read from stdin: the first line is the port of
+ *          the server, and each line after is a request, "delay pause
+ *          file", that connects delay seconds after the start, waits pause
+ *          seconds, and then asks for the file.  Each request is its own
+ *          client, as in hydra.py.
+ *
+ *          Slowdown is a request's response time divided by the time an
+ *          ideal server would take to send the response over the link:
+ *          a fixed overhead (-o, in microseconds) plus the size of the
+ *          response over the link's bandwidth (-b, in bytes per second).
+ *          The Jain fairness index, (sum x)^2 / (n * sum x^2), is taken
+ *          over x = 1 / slowdown of each client, and is 1 when every client
+ *          is served equally well relative to its size.
+ *
+ *          On a large machine, one client process runs out of CPU before
+ *          the server does.  With -P n, the script is split among n client
+ *          processes, request i going to process i mod n, each pinned to a
+ *          CPU of its own starting at the one given with -C.  They start
+ *          together, and each sends back its tally, histograms and all,
+ *          through a pipe, to be merged into one report.
+ */
+
+#define _GNU_SOURCE /* for sched_setaffinity() */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "config.h"
+#include "hist.h"
+#include "util.h"
+
+#define MAX_EVENTS 256 /* events handled per epoll_wait() */
+#define READ_SIZE 65536 /* bytes read per read() */
+#define REQUEST_MAX 4200 /* longest request sent */
+#define PATH_MAX_LEN 4096 /* longest path in a script */
+#define MAX_SIZES 8 /* most size buckets */
+#define IDLE_MS 100 /* longest wait with nothing scheduled */
+
+#define J_WAIT 0 /* waiting to connect */
+#define J_CONNECT 1 /* connecting */
+#define J_PAUSE 2 /* connected, waiting to send the request */
+#define J_READ 3 /* reading the response */
+#define J_DONE 4 /* finished, or failed */
+
+/* A request of the script, and the client making it. */
+struct job {
+	double delay;   /* seconds after start to connect */
+	double pause;   /* seconds after connecting to send */
+	char *path;     /* file asked for */
+	int fd;         /* connection */
+	int state;      /* J_WAIT, J_CONNECT, ... */
+	long long sent; /* when the request was sent, in ns */
+	size_t got;     /* bytes of response read */
+	size_t header;  /* bytes of header, 0 until its end is seen */
+	int newlines;   /* newlines in a row, to find the end of the header */
+	int status;     /* status of response */
+};
+
+/* A job waiting for a time to act. */
+struct timer {
+	long long due; /* when, in ns */
+	int job;       /* job index */
+};
+
+/* What the requests came to. */
+struct tally {
+	uint64_t completed;  /* # of responses read with a 2xx status */
+	uint64_t errors;     /* # of responses read with another status */
+	uint64_t failed;     /* # of requests without a response */
+	uint64_t bytes;      /* bytes of responses read */
+	double slowdown_sum; /* sum of slowdowns */
+	double slowdown_max; /* largest slowdown */
+	double fair_sum;     /* sum of 1 / slowdown */
+	double fair_sq_sum;  /* sum of (1 / slowdown)^2 */
+	struct hist all;     /* response times, in ns */
+	struct hist sizes[MAX_SIZES]; /* response times, by size bucket */
+};
+
+static struct job *jobs; /* the script */
+static int num_jobs;
+static int jobs_left; /* # of jobs not done */
+static struct timer *timers; /* heap, soonest first */
+static int num_timers;
+static struct sockaddr_in server; /* where to connect */
+static char *host = "127.0.0.1"; /* server's address, also sent as Host */
+static size_t bandwidth = 1 << 30; /* ideal link, bytes per second */
+static long overhead_us = 100; /* ideal time to serve nothing */
+static size_t bounds[MAX_SIZES - 1] = { 1 << 10, 16 << 10, 256 << 10, 4 << 20 };
+static int num_bounds = 4; /* # of size bucket bounds */
+static double timeout = 60; /* longest run, in seconds */
+static int procs = 1; /* # of client processes */
+static int first_cpu; /* CPU of first client process */
+static struct tally tally; /* results */
+static int epfd; /* epoll instance */
+
+
+/* This function schedules a job to act at a time.  This function will
+ *    abort the program if memory cannot be allocated.
+ * Parameters:
+ *    due : when, in ns
+ *    job : job index
+ * Returns: None
+ */
+static void timer_push( long long due, int job ) {
+	struct timer t = { due, job }; /* new timer */
+	int i = num_timers++; /* hole, sifted up */
+
+	if( !timers ) { /* one per job is all there can ever be */
+		timers = malloc( ( num_jobs + 1 ) * sizeof( struct timer ) );
+		if( !timers ) {
+			perror( "Error while allocating memory" );
+			abort();
+		}
+	}
+	for( ; ( i > 0 ) && ( timers[( i - 1 ) / 2].due > due ); i = ( i - 1 ) / 2 ) {
+		timers[i] = timers[( i - 1 ) / 2];
+	}
+	timers[i] = t;
+}
+
+
+/* This function takes the soonest timer off the heap.
+ * Parameters: None
+ * Returns: The index of its job.
+ */
+static int timer_pop() {
+	struct timer last = timers[--num_timers]; /* moved into the hole */
+	int job = timers[0].job; /* job of soonest */
+	int i = 0, c; /* hole, child */
+
+	for( c = 1; c < num_timers; i = c, c = 2 * c + 1 ) {
+		if( ( c + 1 < num_timers ) && ( timers[c + 1].due < timers[c].due ) ) {
+			c++;
+		}
+		if( timers[c].due >= last.due ) {
+			break;
+		}
+		timers[i] = timers[c];
+	}
+	timers[i] = last;
+	return job;
+}
+
+
+/* This function gives up on a job.
+ * Parameters:
+ *    job : the job
+ * Returns: None
+ */
+static void fail_job( struct job *job ) {
+	if( job->fd >= 0 ) {
+		close( job->fd );
+		job->fd = -1;
+	}
+	job->state = J_DONE;
+	jobs_left--;
+	tally.failed++;
+}
+
+
+/* This function records a job whose response has been read in full.
+ * Parameters:
+ *    job : the job
+ *    now : the time, in ns
+ * Returns: None
+ */
+static void finish_job( struct job *job, long long now ) {
+	uint64_t resp = now - job->sent; /* response time */
+	size_t size = job->header ? job->got - job->header : 0; /* body size */
+	double ideal; /* ideal response time */
+	double slow; /* slowdown */
+	int b; /* size bucket */
+
+	close( job->fd );
+	job->fd = -1;
+	job->state = J_DONE;
+	jobs_left--;
+	if( ( job->status < 200 ) || ( job->status > 299 ) ) {
+		tally.errors++;
+		return;
+	}
+
+	ideal = overhead_us * 1e3 + size * 1e9 / bandwidth;
+	slow = resp / ideal;
+	tally.completed++;
+	tally.bytes += job->got;
+	tally.slowdown_sum += slow;
+	tally.fair_sum += 1 / slow;
+	tally.fair_sq_sum += 1 / ( slow * slow );
+	if( slow > tally.slowdown_max ) {
+		tally.slowdown_max = slow;
+	}
+
+	for( b = 0; ( b < num_bounds ) && ( size > bounds[b] ); b++ );
+	hist_add( &tally.all, resp );
+	hist_add( &tally.sizes[b], resp );
+}
+
+
+/* This function starts connecting a job to the server.
+ * Parameters:
+ *    job : the job
+ *    idx : its index
+ * Returns: None
+ */
+static void start_job( struct job *job, int idx ) {
+	struct epoll_event ev; /* event registration */
+
+	job->fd = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0 );
+	if( job->fd < 0 ) {
+		perror( "Error while creating socket" );
+		fail_job( job );
+		return;
+	}
+	if( connect( job->fd, (struct sockaddr *)&server, sizeof( server ) ) &&
+	    ( errno != EINPROGRESS ) ) {
+		fail_job( job );
+		return;
+	}
+
+	ev.events = EPOLLOUT;
+	ev.data.u32 = idx;
+	if( epoll_ctl( epfd, EPOLL_CTL_ADD, job->fd, &ev ) ) {
+		fail_job( job );
+		return;
+	}
+	job->state = J_CONNECT;
+}
+
+
+/* This function sends a job's request, and closes its side of the
+ *    connection, as hydra.py does.
+ * Parameters:
+ *    job : the job
+ *    idx : its index
+ * Returns: None
+ */
+static void send_job( struct job *job, int idx ) {
+	char req[REQUEST_MAX]; /* the request */
+	struct epoll_event ev; /* event registration */
+	int len; /* length of request */
+
+	len = snprintf( req, REQUEST_MAX, "GET %s%s HTTP/1.1\nHost: %s\n\n",
+	                job->path[0] == '/' ? "" : "/", job->path, host );
+	job->sent = util_now_ns();
+	if( write( job->fd, req, len ) != len ) {
+		fail_job( job );
+		return;
+	}
+	shutdown( job->fd, SHUT_WR );
+
+	ev.events = EPOLLIN;
+	ev.data.u32 = idx;
+	if( epoll_ctl( epfd, job->state == J_PAUSE ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, job->fd, &ev ) ) {
+		fail_job( job ); /* left out of the set while paused */
+		return;
+	}
+	job->state = J_READ;
+}
+
+
+/* This function reads what has arrived of a job's response, noting its
+ *    status and where its header ends.
+ * Parameters:
+ *    job : the job
+ *    buf : buffer to read into, READ_SIZE bytes
+ * Returns: None
+ */
+static void read_job( struct job *job, char *buf ) {
+	ssize_t len; /* bytes read */
+	ssize_t i; /* byte index */
+
+	while( ( len = read( job->fd, buf, READ_SIZE ) ) > 0 ) {
+		if( !job->got ) { /* status line starts the response */
+			buf[len < 32 ? len : 31] = '\0';
+			sscanf( buf, "HTTP/%*s %d", &job->status );
+		}
+		for( i = 0; ( i < len ) && !job->header; i++ ) {
+			if( buf[i] == '\n' ) {
+				job->newlines++;
+				if( job->newlines == 2 ) { /* blank line */
+					job->header = job->got + i + 1;
+				}
+			} else if( buf[i] != '\r' ) {
+				job->newlines = 0;
+			}
+		}
+		job->got += len;
+	}
+
+	if( len == 0 ) { /* server closed, all read */
+		finish_job( job, util_now_ns() );
+	} else if( ( errno != EAGAIN ) && ( errno != EWOULDBLOCK ) ) {
+		fail_job( job );
+	}
+}
+
+
+/* This function handles an event on a job's connection.
+ * Parameters:
+ *    idx : the job's index
+ *    buf : buffer to read into, READ_SIZE bytes
+ * Returns: None
+ */
+static void handle_job( int idx, char *buf ) {
+	struct job *job = &jobs[idx]; /* the job */
+	int err = 0; /* connect result */
+	socklen_t len = sizeof( err ); /* length of result */
+
+	if( job->state == J_CONNECT ) { /* connected, or not */
+		getsockopt( job->fd, SOL_SOCKET, SO_ERROR, &err, &len );
+		if( err ) {
+			fail_job( job );
+		} else if( job->pause > 0 ) { /* wait before sending */
+			epoll_ctl( epfd, EPOLL_CTL_DEL, job->fd, NULL );
+			job->state = J_PAUSE;
+			timer_push( util_now_ns() + (long long)( job->pause * 1e9 ), idx );
+		} else {
+			send_job( job, idx );
+		}
+	} else if( job->state == J_READ ) {
+		read_job( job, buf );
+	}
+}
+
+
+/* This function runs the script: it connects, sends and reads each
+ *    request at the time the script says, until all are done or the
+ *    timeout passes.
+ * Parameters: None
+ * Returns: The time the run took, in seconds.
+ */
+static double run() {
+	struct epoll_event events[MAX_EVENTS]; /* ready connections */
+	static char buf[READ_SIZE]; /* read buffer */
+	long long start = util_now_ns(); /* start of run */
+	long long deadline = start + (long long)( timeout * 1e9 ); /* end of run */
+	long long now; /* current time */
+	int wait; /* ms to wait */
+	int n; /* # of events */
+	int i; /* event or job index */
+
+	epfd = epoll_create1( 0 );
+	if( epfd < 0 ) {
+		perror( "Error while creating epoll instance" );
+		abort();
+	}
+	jobs_left = num_jobs;
+	for( i = 0; i < num_jobs; i++ ) {
+		timer_push( start + (long long)( jobs[i].delay * 1e9 ), i );
+	}
+
+	for( now = start; ( jobs_left > 0 ) && ( now < deadline ); now = util_now_ns() ) {
+		wait = IDLE_MS;
+		if( num_timers && ( timers[0].due - now < wait * 1000000LL ) ) {
+			wait = timers[0].due > now ? ( timers[0].due - now ) / 1000000 + 1 : 0;
+		}
+		n = epoll_wait( epfd, events, MAX_EVENTS, wait );
+		for( i = 0; i < n; i++ ) {
+			handle_job( events[i].data.u32, buf );
+		}
+
+		now = util_now_ns();
+		while( num_timers && ( timers[0].due <= now ) ) { /* act on time */
+			i = timer_pop();
+			if( jobs[i].state == J_WAIT ) {
+				start_job( &jobs[i], i );
+			} else if( jobs[i].state == J_PAUSE ) {
+				send_job( &jobs[i], i );
+			}
+		}
+	}
+
+	for( i = 0; i < num_jobs; i++ ) { /* out of time */
+		if( jobs[i].state != J_DONE ) {
+			fail_job( &jobs[i] );
+		}
+	}
+	return ( util_now_ns() - start ) / 1e9;
+}
+
+
+/* This function moves data through a pipe, all of it, reading or writing.
+ * Parameters:
+ *    fd       : the pipe
+ *    data     : the data
+ *    len      : bytes of data
+ *    write_it : write the data, rather than read it?
+ * Returns: 0 on success, or -1 if the pipe closed or failed first.
+ */
+static int move_all( int fd, void *data, size_t len, int write_it ) {
+	char *p = data; /* next byte */
+	ssize_t n; /* bytes moved */
+
+	while( len > 0 ) {
+		n = write_it ? write( fd, p, len ) : read( fd, p, len );
+		if( ( n < 0 ) && ( errno == EINTR ) ) {
+			continue;
+		} else if( n <= 0 ) {
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+
+/* This function adds one client process's tally to the total.
+ * Parameters:
+ *    part : the process's tally
+ * Returns: None
+ */
+static void merge_tally( const struct tally *part ) {
+	int b; /* size bucket */
+
+	tally.completed += part->completed;
+	tally.errors += part->errors;
+	tally.failed += part->failed;
+	tally.bytes += part->bytes;
+	tally.slowdown_sum += part->slowdown_sum;
+	tally.fair_sum += part->fair_sum;
+	tally.fair_sq_sum += part->fair_sq_sum;
+	if( part->slowdown_max > tally.slowdown_max ) {
+		tally.slowdown_max = part->slowdown_max;
+	}
+	hist_merge( &tally.all, &part->all );
+	for( b = 0; b < MAX_SIZES; b++ ) {
+		hist_merge( &tally.sizes[b], &part->sizes[b] );
+	}
+}
+
+
+/* This function is what each client process runs: it pins itself to its
+ *    CPU, keeps its share of the script, waits for the others to be ready,
+ *    runs, and sends its tally and the time it took back to the parent.
+ * Parameters:
+ *    k     : the process's number, from 0
+ *    start : pipe that reaches end of file when all are to start
+ *    out   : pipe to the parent
+ * Returns: Never returns.
+ */
+static void run_proc( int k, int start, int out ) {
+	cpu_set_t cpus; /* CPU to run on */
+	double secs; /* time the run took */
+	char c; /* start signal */
+	int i, n = 0; /* job index, # of jobs kept */
+
+	CPU_ZERO( &cpus );
+	CPU_SET( ( first_cpu + k ) % sysconf( _SC_NPROCESSORS_ONLN ), &cpus );
+	if( sched_setaffinity( 0, sizeof( cpus ), &cpus ) ) {
+		perror( "Error while pinning client process" );
+	}
+	for( i = k; i < num_jobs; i += procs ) { /* every procs'th, from k */
+		jobs[n++] = jobs[i];
+	}
+	num_jobs = n;
+
+	while( ( read( start, &c, 1 ) < 0 ) && ( errno == EINTR ) );
+	secs = run();
+	if( move_all( out, &tally, sizeof( tally ), 1 ) ||
+	    move_all( out, &secs, sizeof( secs ), 1 ) ) {
+		perror( "Error while reporting to parent" );
+		_exit( 1 );
+	}
+	_exit( 0 );
+}
+
+
+/* This function runs the script split among procs client processes, and
+ *    merges their tallies.  This function will abort the program if the
+ *    processes cannot be created.
+ * Parameters: None
+ * Returns: The time the longest process took, in seconds.
+ */
+static double run_procs() {
+	static struct tally part; /* one process's tally */
+	int start[2]; /* start signal */
+	int out[2]; /* tally of one process */
+	int *fds; /* read end of each process's pipe */
+	double secs, most = 0; /* time taken */
+	int k; /* process number */
+
+	fds = malloc( procs * sizeof( int ) );
+	if( !fds || pipe( start ) ) {
+		perror( "Error while starting client processes" );
+		abort();
+	}
+	for( k = 0; k < procs; k++ ) {
+		if( pipe( out ) ) {
+			perror( "Error while starting client processes" );
+			abort();
+		}
+		switch( fork() ) {
+		case -1:
+			perror( "Error while starting client processes" );
+			abort();
+		case 0:
+			close( start[1] );
+			close( out[0] );
+			run_proc( k, start[0], out[1] );
+		}
+		close( out[1] );
+		fds[k] = out[0];
+	}
+
+	close( start[1] ); /* all ready, go */
+	close( start[0] );
+	for( k = 0; k < procs; k++ ) {
+		if( move_all( fds[k], &part, sizeof( part ), 0 ) ||
+		    move_all( fds[k], &secs, sizeof( secs ), 0 ) ) {
+			fprintf( stderr, "sws-load: client process %d did not report\n", k );
+		} else {
+			merge_tally( &part );
+			most = secs > most ? secs : most;
+		}
+		close( fds[k] );
+	}
+	while( wait( NULL ) > 0 );
+	free( fds );
+	return most;
+}
+
+
+/* This function reads the script from stdin.  This function will abort
+ *    the program if memory cannot be allocated.
+ * Parameters: None
+ * Returns: The port in the script, or -1 if it has none.
+ */
+static int read_script() {
+	char path[PATH_MAX_LEN]; /* file asked for */
+	char line[PATH_MAX_LEN + 64]; /* line of script */
+	struct job job; /* job on line */
+	int port = -1; /* server port */
+	int size = 0; /* # of jobs allocated */
+
+	if( !fgets( line, sizeof( line ), stdin ) || ( sscanf( line, "%d", &port ) != 1 ) ) {
+		return -1;
+	}
+
+	while( fgets( line, sizeof( line ), stdin ) ) {
+		if( sscanf( line, "%lf %lf %4095s", &job.delay, &job.pause, path ) != 3 ) {
+			continue; /* not a request */
+		}
+		if( num_jobs == size ) {
+			size = size ? 2 * size : 1024;
+			jobs = realloc( jobs, size * sizeof( struct job ) );
+		}
+		job.path = strdup( path );
+		if( !jobs || !job.path ) {
+			perror( "Error while allocating memory" );
+			abort();
+		}
+		job.fd = -1;
+		job.state = J_WAIT;
+		job.got = job.header = 0;
+		job.newlines = job.status = 0;
+		jobs[num_jobs++] = job;
+	}
+	return port;
+}
+
+
+/* This function parses the bounds of the size buckets, e.g., "1k,64k,1m".
+ * Parameters:
+ *    str : the bounds, smallest first
+ * Returns: 0 on success, or -1 if the bounds are malformed.
+ */
+static int parse_bounds( char *str ) {
+	char *word; /* next bound */
+
+	num_bounds = 0;
+	for( word = strtok( str, "," ); word; word = strtok( NULL, "," ) ) {
+		if( ( num_bounds == MAX_SIZES - 1 ) || config_size( word, &bounds[num_bounds] ) ||
+		    ( num_bounds && ( bounds[num_bounds] <= bounds[num_bounds - 1] ) ) ) {
+			return -1;
+		}
+		num_bounds++;
+	}
+	return 0;
+}
+
+
+/* This function prints the percentiles of a histogram, as JSON members.
+ * Parameters:
+ *    h : the histogram
+ * Returns: None
+ */
+static void print_latency( const struct hist *h ) {
+	printf( "\"count\": %llu, \"mean_ms\": %.3f, \"p50_ms\": %.3f, \"p90_ms\": %.3f, "
+	        "\"p99_ms\": %.3f, \"p999_ms\": %.3f, \"max_ms\": %.3f",
+	        (unsigned long long)h->count, hist_mean( h ) / 1e6,
+	        hist_percentile( h, 50 ) / 1e6, hist_percentile( h, 90 ) / 1e6,
+	        hist_percentile( h, 99 ) / 1e6, hist_percentile( h, 99.9 ) / 1e6, h->max / 1e6 );
+}
+
+
+/* This function prints the results of the run, as JSON.
+ * Parameters:
+ *    secs : the time the run took, in seconds
+ * Returns: None
+ */
+static void report( double secs ) {
+	uint64_t n = tally.completed; /* # of responses measured */
+	int b; /* size bucket */
+
+	printf( "{\n" );
+	printf( "  \"requests\": %d,\n", num_jobs );
+	printf( "  \"processes\": %d,\n", procs );
+	printf( "  \"completed\": %llu,\n", (unsigned long long)n );
+	printf( "  \"errors\": %llu,\n", (unsigned long long)tally.errors );
+	printf( "  \"failed\": %llu,\n", (unsigned long long)tally.failed );
+	printf( "  \"duration_s\": %.3f,\n", secs );
+	printf( "  \"throughput_rps\": %.1f,\n", n / secs );
+	printf( "  \"throughput_bytes_per_s\": %.0f,\n", tally.bytes / secs );
+	printf( "  \"mean_response_ms\": %.3f,\n", hist_mean( &tally.all ) / 1e6 );
+	printf( "  \"mean_slowdown\": %.3f,\n", n ? tally.slowdown_sum / n : 0 );
+	printf( "  \"max_slowdown\": %.3f,\n", tally.slowdown_max );
+	printf( "  \"jain_fairness\": %.4f,\n",
+	        n ? tally.fair_sum * tally.fair_sum / ( n * tally.fair_sq_sum ) : 0 );
+	printf( "  \"latency\": { " );
+	print_latency( &tally.all );
+	printf( " },\n" );
+	printf( "  \"by_size\": [\n" );
+	for( b = 0; b <= num_bounds; b++ ) {
+		if( b < num_bounds ) {
+			printf( "    { \"max_bytes\": %zu, ", bounds[b] );
+		} else {
+			printf( "    { \"max_bytes\": null, " );
+		}
+		print_latency( &tally.sizes[b] );
+		printf( " }%s\n", b < num_bounds ? "," : "" );
+	}
+	printf( "  ]\n}\n" );
+}
+
+
+/* This function is where the program starts running.  It reads the
+ *    options and the script, runs the script and prints the results.
+ * Parameters:
+ *    argc : number of command line parameters (including program name
+ *    argv : array of pointers to command line parameters
+ * Returns: an integer status code, 0 for success, something else for error.
+ */
+int main( int argc, char **argv ) {
+	struct rlimit lim; /* open file limit */
+	int port = -1; /* server port, if not the script's */
+	int opt; /* command line option */
+	int b; /* size bucket */
+
+	while( ( opt = getopt( argc, argv, "h:p:b:o:s:T:P:C:" ) ) != -1 ) {
+		if( opt == 'h' ) {
+			host = optarg; /* server's address */
+		} else if( ( opt == 'p' ) && ( sscanf( optarg, "%d", &port ) == 1 ) ) {
+			continue; /* server port */
+		} else if( ( opt == 'b' ) && !config_size( optarg, &bandwidth ) && bandwidth ) {
+			continue; /* ideal link */
+		} else if( ( opt == 'o' ) && ( sscanf( optarg, "%ld", &overhead_us ) == 1 ) ) {
+			continue; /* ideal overhead */
+		} else if( ( opt == 's' ) && !parse_bounds( optarg ) ) {
+			continue; /* size buckets */
+		} else if( ( opt == 'T' ) && ( sscanf( optarg, "%lf", &timeout ) == 1 ) ) {
+			continue; /* longest run */
+		} else if( ( opt == 'P' ) && ( sscanf( optarg, "%d", &procs ) == 1 ) && ( procs > 0 ) ) {
+			continue; /* client processes */
+		} else if( ( opt == 'C' ) && ( sscanf( optarg, "%d", &first_cpu ) == 1 ) ) {
+			continue; /* CPU of first process */
+		} else {
+			printf( "usage: sws-load [-h host] [-p port] [-b bandwidth] [-o overhead_us]\n"
+			        "                [-s size,size,...] [-T timeout] [-P procs] [-C cpu]\n"
+			        "                < script\n" );
+			return 1;
+		}
+	}
+
+	opt = read_script();
+	port = port < 0 ? opt : port;
+	memset( &server, 0, sizeof( server ) );
+	server.sin_family = AF_INET;
+	server.sin_port = htons( port );
+	if( ( port < 0 ) || !inet_aton( host, &server.sin_addr ) ) {
+		printf( "sws-load: no port, or bad host address\n" );
+		return 1;
+	}
+
+	getrlimit( RLIMIT_NOFILE, &lim ); /* a descriptor per client */
+	lim.rlim_cur = lim.rlim_max;
+	setrlimit( RLIMIT_NOFILE, &lim );
+
+	hist_init( &tally.all );
+	for( b = 0; b < MAX_SIZES; b++ ) {
+		hist_init( &tally.sizes[b] );
+	}
+
+	report( procs > 1 ? run_procs() : run() );
+	return 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * File: meta.c
+ * Author: agent
+ * Purpose: This file contains the meta module, which renders response
+ *         headers from file metadata and keeps recently rendered ones.
+ *         Please see meta.h for documentation on how to use this module.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "meta.h"
+#include "util.h"
+
+#define SLOTS 4096 /* # of headers kept, a power of two */
+
+/* A kept header. */
+struct meta {
+	int dir;                      /* directory path is relative to */
+	unsigned hash;                /* hash of dir and path */
+	long long checked;            /* when the file was stat()ed, in ns */
+	int len;                      /* length of header */
+	char header[META_HEADER_MAX]; /* the rendered response */
+	char path[];                  /* path of file */
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; /* guards all below */
+static struct meta *slots[SLOTS]; /* kept headers, by hash */
+static size_t entries; /* counters for meta_stats() */
+static size_t hits;
+static size_t misses;
+static size_t invalidations;
+
+
+/* This function renders the header of a 200 response for a file.
+ * Parameters:
+ *    buf   : buffer to render into, META_HEADER_MAX bytes
+ *    size  : the file's size, or -1 if it has none (e.g., a directory)
+ *    mtime : the file's modification time
+ * Returns: the number of bytes rendered
+ */
+extern int meta_header( char *buf, long long size, const struct timespec *mtime ) {
+	struct tm tm; /* mtime, broken down */
+	int len; /* length of header */
+
+	len = sprintf( buf, "HTTP/1.1 200 OK\n" );
+	if( size >= 0 ) {
+		len += sprintf( buf + len, "Content-Length: %lld\n", size );
+	}
+	gmtime_r( &mtime->tv_sec, &tm );
+	len += strftime( buf + len, META_HEADER_MAX - len,
+	                 "Last-Modified: %a, %d %b %Y %H:%M:%S GMT\n\n", &tm );
+	return len;
+}
+
+
+/* This function renders the response to a HEAD request for a file: the
+ *    same header a GET would get, or a 404 if there is no such file or it
+ *    cannot be read.  A directory is not rendered, since a GET of it is
+ *    redirected or served by its index.html or a listing; the caller must
+ *    decide which, as for a GET.
+ * Parameters:
+ *    dir  : directory the path is relative to
+ *    path : path of the file
+ *    buf  : buffer to render into, META_HEADER_MAX bytes
+ * Returns: the number of bytes rendered, or 0 if the path is a directory.
+ */
+extern int meta_head( int dir, const char *path, char *buf ) {
+	unsigned hash = util_hash_str( UTIL_HASH_BASIS ^ (unsigned)dir, path ); /* hash of path */
+	struct meta **slot = &slots[hash & ( SLOTS - 1 )]; /* where it is kept */
+	struct meta *m; /* kept header */
+	struct stat st; /* file status */
+	long long now = util_now_ns(); /* time of lookup */
+	int len; /* length of response */
+
+	pthread_mutex_lock( &lock );
+	m = *slot;
+	if( m && ( m->hash == hash ) && ( m->dir == dir ) && !strcmp( m->path, path ) &&
+	    ( now - m->checked < META_TTL_MS * 1000000LL ) ) { /* hit */
+		len = m->len;
+		memcpy( buf, m->header, len );
+		hits++;
+		pthread_mutex_unlock( &lock );
+		return len;
+	}
+	pthread_mutex_unlock( &lock );
+
+	if( fstatat( dir, path, &st, 0 ) || faccessat( dir, path, R_OK, 0 ) ) { /* miss, render it */
+		len = sprintf( buf, "HTTP/1.1 404 File not found\n\n" );
+	} else if( S_ISDIR( st.st_mode ) ) { /* up to the caller */
+		return 0;
+	} else {
+		len = meta_header( buf, S_ISREG( st.st_mode ) ? st.st_size : -1, &st.st_mtim );
+	}
+
+	m = malloc( sizeof( struct meta ) + strlen( path ) + 1 );
+	if( m ) { /* keep it, if we can */
+		m->dir = dir;
+		m->hash = hash;
+		m->checked = now;
+		m->len = len;
+		memcpy( m->header, buf, len );
+		strcpy( m->path, path );
+	}
+
+	pthread_mutex_lock( &lock );
+	misses++;
+	if( m ) { /* replace whatever was there */
+		entries += !*slot;
+		free( *slot );
+		*slot = m;
+	}
+	pthread_mutex_unlock( &lock );
+	return len;
+}
+
+
+/* This function forgets the header of a file, if it is kept.
+ * Parameters:
+ *    dir  : directory the path is relative to
+ *    path : path of the file
+ * Returns: None
+ */
+extern void meta_invalidate( int dir, const char *path ) {
+	unsigned hash = util_hash_str( UTIL_HASH_BASIS ^ (unsigned)dir, path ); /* hash of path */
+	struct meta **slot = &slots[hash & ( SLOTS - 1 )]; /* where it is kept */
+
+	pthread_mutex_lock( &lock );
+	if( *slot && ( ( *slot )->hash == hash ) && ( ( *slot )->dir == dir ) &&
+	    !strcmp( ( *slot )->path, path ) ) {
+		free( *slot );
+		*slot = NULL;
+		entries--;
+		invalidations++;
+	}
+	pthread_mutex_unlock( &lock );
+}
+
+
+/* This function reports how the header cache is doing.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void meta_stats( struct meta_stats *stats ) {
+	pthread_mutex_lock( &lock );
+	stats->entries = entries;
+	stats->hits = hits;
+	stats->misses = misses;
+	stats->invalidations = invalidations;
+	pthread_mutex_unlock( &lock );
+}
@@ -0,0 +1,86 @@
+/*
+ * File: meta.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          meta module, which renders response headers from file metadata
+ *          and keeps recently rendered ones for HEAD requests.
+ */
+
+#ifndef META_H
+#define META_H
+
+#include <stddef.h>
+#include <time.h>
+
+#define META_HEADER_MAX 160 /* room needed for a rendered header */
+#define META_TTL_MS 1000 /* how long a kept header is trusted */
+
+/*
+ * This module has four functions:
+ *   meta_header()     : render the header of a 200 response
+ *   meta_head()       : render the response to a HEAD request
+ *   meta_invalidate() : forget the header of a file
+ *   meta_stats()      : report how the header cache is doing
+ *
+ * GET and HEAD responses carry the same header, rendered by meta_header()
+ * from the file's size and modification time.  A HEAD request never opens
+ * the file: meta_head() renders its header from stat(), and keeps it in a
+ * small direct-mapped table so that repeated probes of the same path do not
+ * even need the stat().  Paths are relative to a site's root, given by file
+ * descriptor, and each site's headers are kept apart.  A kept header is
+ * trusted for META_TTL_MS, so a file changed behind the server's back may
+ * be described as it was for that long; files the server replaces itself
+ * are forgotten at once with meta_invalidate().  Missing and unreadable
+ * files are kept too, as the 404 responses a GET of them would get, but
+ * directories are not.  All functions are thread safe.
+ */
+
+struct meta_stats {
+	size_t entries;       /* # of headers kept */
+	size_t hits;          /* # of HEAD requests answered from the table */
+	size_t misses;        /* # of HEAD requests that needed a stat() */
+	size_t invalidations; /* # of headers forgotten */
+};
+
+
+/* This function renders the header of a 200 response for a file.
+ * Parameters:
+ *    buf   : buffer to render into, META_HEADER_MAX bytes
+ *    size  : the file's size, or -1 if it has none (e.g., a directory)
+ *    mtime : the file's modification time
+ * Returns: the number of bytes rendered
+ */
+extern int meta_header( char *buf, long long size, const struct timespec *mtime );
+
+
+/* This function renders the response to a HEAD request for a file: the
+ *    same header a GET would get, or a 404 if there is no such file or it
+ *    cannot be read.  A directory is not rendered, since a GET of it is
+ *    redirected or served by its index.html or a listing; the caller must
+ *    decide which, as for a GET.
+ * Parameters:
+ *    dir  : directory the path is relative to
+ *    path : path of the file
+ *    buf  : buffer to render into, META_HEADER_MAX bytes
+ * Returns: the number of bytes rendered, or 0 if the path is a directory.
+ */
+extern int meta_head( int dir, const char *path, char *buf );
+
+
+/* This function forgets the header of a file, if it is kept.
+ * Parameters:
+ *    dir  : directory the path is relative to
+ *    path : path of the file
+ * Returns: None
+ */
+extern void meta_invalidate( int dir, const char *path );
+
+
+/* This function reports how the header cache is doing.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void meta_stats( struct meta_stats *stats );
+
+#endif
@@ -15,6 +15,7 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <sys/select.h>
@@ -22,7 +23,32 @@
 
 #include "network.h"
 
+#define LISTEN_FDS_START 3 /* first descriptor passed in, by the convention */
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69 /* Linux 5.11, missing from older headers */
+#endif
+
 static int serv_sock = -1;
+static int busy_poll; /* busy poll usecs, 0 if off */
+static size_t accepted; /* # of clients accepted */
+static size_t busy_poll_failed; /* # of sockets that refused busy poll */
+static int inherited; /* was serv_sock passed in? */
+
+
+/* This function turns on busy polling for a socket.
+ * Parameters:
+ *   sock : the socket
+ * Returns: None
+ */
+static void set_busy_poll( int sock ) {
+	int yes = 1; /* config variable */
+
+	if( setsockopt( sock, SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof( int ) ) ||
+	    setsockopt( sock, SOL_SOCKET, SO_PREFER_BUSY_POLL, &yes, sizeof( int ) ) ) {
+		busy_poll_failed++;
+	}
+}
 
 /* This function checks if there are any web clients waiting to connect.
  *    If one or more clients are waiting to connect, this function returns.
@@ -93,12 +119,68 @@ extern int network_open() {
 
 		if( sock < 0 ) { /* check for errors */
 			perror( "Error occurred on select()" );
+		} else {
+			accepted++;
+			if( busy_poll ) {
+				set_busy_poll( sock );
+			}
 		}
 	}
 	return sock; /* return client conn.*/
 }
 
 
+/* This function returns the file descriptor of the server socket, so that
+ *    a program waiting on several descriptors at once (e.g., with epoll)
+ *    can wait for clients without calling network_wait().  When the
+ *    socket is readable, network_open() should be called until it returns -1.
+ * Parameters: None
+ * Returns: The file descriptor of the server socket.
+ */
+extern int network_socket() {
+	if( serv_sock < 0 ) { /* sanity check */
+		perror( "Error, network not initalized" );
+		abort();
+	}
+	return serv_sock;
+}
+
+
+/* This function turns on busy polling (SO_BUSY_POLL and SO_PREFER_BUSY_POLL)
+ *    for the server socket and for every client connection opened after
+ *    this call.  When a busy polled socket has no data, a read or poll on
+ *    it spins in the kernel on the device queue for up to the given time
+ *    instead of sleeping until an interrupt, trading CPU for latency.
+ *    Raising the busy poll time needs CAP_NET_ADMIN; sockets on which the
+ *    kernel refuses it are counted in network_stats().
+ * Parameters:
+ *    usecs : how long to busy poll, in microseconds
+ * Returns: None
+ */
+extern void network_busy_poll( int usecs ) {
+	if( serv_sock < 0 ) { /* sanity check */
+		perror( "Error, network not initalized" );
+		abort();
+	}
+
+	busy_poll = usecs;
+	set_busy_poll( serv_sock );
+}
+
+
+/* This function reports what the module has been doing.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void network_stats( struct network_stats *stats ) {
+	stats->accepted = accepted;
+	stats->busy_poll = busy_poll;
+	stats->busy_poll_failed = busy_poll_failed;
+	stats->inherited = inherited;
+}
+
+
 /* This function initializes the network module and creates a server socket
  *   bound to a specified port.  This function will abort the program if an
  *   error occurs.
@@ -133,3 +215,51 @@ extern void network_init( int port ) {
 		abort();
 	}
 }
+
+
+/* This function initializes the network module with a listening socket
+ *   passed in by the LISTEN_FDS convention, if there is one.  Only the first
+ *   socket passed in is used; any others are closed.  The variables of the
+ *   convention are removed from the environment, so they are not passed on
+ *   to other programs.  This function will abort the program if the socket
+ *   passed in is not a listening IPv4 TCP socket.
+ * Parameters: None
+ * Returns: The port the socket is bound to, or -1 if no socket was passed
+ *          in, in which case network_init() should be called instead.
+ */
+extern int network_inherit() {
+	struct sockaddr_in self; /* socket address */
+	socklen_t len = sizeof( self ); /* length of addr */
+	char *pid = getenv( "LISTEN_PID" ); /* process the sockets are for */
+	char *fds = getenv( "LISTEN_FDS" ); /* # of sockets passed in */
+	int listening = 0; /* is the socket listening? */
+	socklen_t opt_len = sizeof( listening ); /* length of option */
+	int yes = 1; /* config variable */
+	int n = 0; /* # of sockets */
+	int i; /* descriptor index */
+
+	if( !pid || !fds || ( atol( pid ) != (long)getpid() ) ||
+	    ( sscanf( fds, "%d", &n ) != 1 ) || ( n < 1 ) ) { /* none for us */
+		return -1;
+	}
+	unsetenv( "LISTEN_PID" );
+	unsetenv( "LISTEN_FDS" );
+	unsetenv( "LISTEN_FDNAMES" );
+
+	if( getsockopt( LISTEN_FDS_START, SOL_SOCKET, SO_ACCEPTCONN, &listening, &opt_len ) ||
+	    !listening || getsockname( LISTEN_FDS_START, (struct sockaddr *)&self, &len ) ||
+	    ( self.sin_family != AF_INET ) ) {
+		fprintf( stderr, "Error, inherited descriptor %d is not a listening IPv4 socket\n",
+		         LISTEN_FDS_START );
+		abort();
+	}
+	for( i = 1; i < n; i++ ) { /* one server socket */
+		close( LISTEN_FDS_START + i );
+	}
+	fcntl( LISTEN_FDS_START, F_SETFD, FD_CLOEXEC );
+	setsockopt( LISTEN_FDS_START, SOL_SOCKET, SO_KEEPALIVE, &yes, sizeof( int ) );
+
+	serv_sock = LISTEN_FDS_START;
+	inherited = 1;
+	return ntohs( self.sin_port );
+}
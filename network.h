@@ -10,15 +10,33 @@
 
 #include <stdio.h>
 
+struct network_stats {
+	size_t accepted;          /* # of client connections opened */
+	int busy_poll;            /* busy poll time in usecs, 0 if off */
+	size_t busy_poll_failed;  /* # of sockets busy polling was refused on */
+	int inherited;            /* was the server socket passed in? */
+};
+
 /*
- * This module has three functions:
- *   network_init() : inititalizes the module
- *   network_wait() : wait until a client connects
- *   network_open() : open the next client connection
+ * This module has seven functions:
+ *   network_init()      : inititalizes the module
+ *   network_inherit()   : initializes it with a socket passed in
+ *   network_wait()      : wait until a client connects
+ *   network_open()      : open the next client connection
+ *   network_socket()    : get the server socket, to wait on it yourself
+ *   network_busy_poll() : have the kernel busy poll the server's sockets
+ *   network_stats()     : report what the module has been doing
  *
  * The network_init() function should be called once, at the start of the
  * program.  This function will create a socket to which web clients can
- * connect.
+ * connect.  Alternatively, network_inherit() takes over a listening socket
+ * that was already created by whoever started the program, e.g., systemd
+ * or another supervisor, and passed in with the LISTEN_FDS convention:
+ * the socket is descriptor 3, and the environment has LISTEN_FDS=1 and
+ * LISTEN_PID set to the program's pid.  The supervisor binds the port once
+ * and keeps it across restarts, so no client is refused while the program
+ * starts, and those that connect meanwhile wait in the socket's backlog
+ * until it is ready.
  *
  * The network_wait() function should be called when there are no more web
  * clients waiting to connect.  This function will put the program to sleep
@@ -42,6 +60,19 @@
 extern void network_init( int port );
 
 
+/* This function initializes the network module with a listening socket
+ *   passed in by the LISTEN_FDS convention, if there is one.  Only the first
+ *   socket passed in is used; any others are closed.  The variables of the
+ *   convention are removed from the environment, so they are not passed on
+ *   to other programs.  This function will abort the program if the socket
+ *   passed in is not a listening IPv4 TCP socket.
+ * Parameters: None
+ * Returns: The port the socket is bound to, or -1 if no socket was passed
+ *          in, in which case network_init() should be called instead.
+ */
+extern int network_inherit();
+
+
 /* This function checks if there are any web clients waiting to connect.
  *    If one or more clients are waiting to connect, this function returns.
  *    Otherwise, this function puts the program to sleep (blocks) until
@@ -63,4 +94,36 @@ extern void network_wait();
  */
 extern int network_open();
 
+
+/* This function returns the file descriptor of the server socket, so that
+ *    a program waiting on several descriptors at once (e.g., with epoll)
+ *    can wait for clients without calling network_wait().  When the
+ *    socket is readable, network_open() should be called until it returns -1.
+ * Parameters: None
+ * Returns: The file descriptor of the server socket.
+ */
+extern int network_socket();
+
+
+/* This function turns on busy polling (SO_BUSY_POLL and SO_PREFER_BUSY_POLL)
+ *    for the server socket and for every client connection opened after
+ *    this call.  When a busy polled socket has no data, a read or poll on
+ *    it spins in the kernel on the device queue for up to the given time
+ *    instead of sleeping until an interrupt, trading CPU for latency.
+ *    Raising the busy poll time needs CAP_NET_ADMIN; sockets on which the
+ *    kernel refuses it are counted in network_stats().
+ * Parameters:
+ *    usecs : how long to busy poll, in microseconds
+ * Returns: None
+ */
+extern void network_busy_poll( int usecs );
+
+
+/* This function reports what the module has been doing.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void network_stats( struct network_stats *stats );
+
 #endif
@@ -0,0 +1,136 @@
+/*
+ * File: pace.c
+ * Author: agent
+ * Purpose: This file contains the pace module, which paces responses in
+ *         classes of paths to a set rate.
+ *         Please see pace.h for documentation on how to use this module.
+ */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "config.h"
+#include "pace.h"
+#include "util.h"
+
+#define MAX_RATE 0xffffffffu /* most the socket option takes */
+
+static atomic_size_t kernel; /* counters for pace_stats() */
+static atomic_size_t bucket;
+static atomic_size_t waits;
+
+
+/* This function finds the class of a path, by the current settings.
+ * Parameters:
+ *    path : the path
+ * Returns: The class, or NULL if the path is in none.
+ */
+static const struct settings_rule *find_class( const char *path ) {
+	const struct settings *set = settings_get(); /* current classes */
+	size_t i; /* class index */
+
+	for( i = 0; i < set->num_pace; i++ ) {
+		if( config_match( set->pace[i].pattern, path ) > 0 ) {
+			return &set->pace[i];
+		}
+	}
+	return NULL;
+}
+
+
+/* This function adds a class of paths, from a pace directive.
+ * Parameters:
+ *    set  : the settings being built
+ *    argc : # of words of the directive
+ *    argv : words of the directive, starting with "pace"
+ * Returns: 0 on success, or -1 if the directive is malformed.
+ */
+extern int pace_add( struct settings *set, int argc, char **argv ) {
+	size_t rate; /* bytes per second */
+
+	if( ( argc != 3 ) || config_match( argv[1], NULL ) || config_size( argv[2], &rate ) ||
+	    !rate ) {
+		return -1;
+	}
+	return settings_add_rule( &set->pace, &set->num_pace, argv[1], rate );
+}
+
+
+/* This function starts pacing a response, if its path is in a class: the
+ *    kernel is asked to pace the connection, and if it cannot, a token
+ *    bucket is set up to.
+ * Parameters:
+ *    pace : the response's pacing, to be set up
+ *    fd   : the client connection
+ *    path : the requested path
+ * Returns: None
+ */
+extern void pace_start( struct pace *pace, int fd, const char *path ) {
+	const struct settings_rule *class = find_class( path ); /* class of path */
+	unsigned rate; /* rate for the kernel */
+
+	pace->rate = 0;
+	if( !class ) {
+		return;
+	}
+
+	rate = class->value > MAX_RATE ? MAX_RATE : class->value;
+	if( !setsockopt( fd, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof( rate ) ) ) {
+		atomic_fetch_add_explicit( &kernel, 1, memory_order_relaxed );
+		return;
+	}
+
+	pace->rate = class->value; /* no kernel pacing, do it here */
+	bucket_fill( &pace->bucket, class->value / BUCKET_SENDS + 1, util_now_ns() );
+	atomic_fetch_add_explicit( &bucket, 1, memory_order_relaxed );
+}
+
+
+/* This function gets how many bytes of a paced response may be sent now,
+ *    taking them from its token bucket.
+ * Parameters:
+ *    pace : the response's pacing
+ *    want : the bytes the caller would like to send
+ *    wait : if none may be sent, set to the ns until some may
+ * Returns: The bytes that may be sent, at most want, or 0 if the caller is
+ *          to try again in *wait ns.
+ */
+extern size_t pace_grant( struct pace *pace, size_t want, long long *wait ) {
+	if( !pace->rate || !want ) { /* not paced here */
+		return want;
+	}
+	want = bucket_grant( &pace->bucket, pace->rate, want, util_now_ns(), wait );
+	if( !want ) {
+		atomic_fetch_add_explicit( &waits, 1, memory_order_relaxed );
+	}
+	return want;
+}
+
+
+/* This function gives back bytes granted by pace_grant() that were not
+ *    sent, e.g., because the client's bandwidth would not allow them.
+ * Parameters:
+ *    pace  : the response's pacing
+ *    bytes : bytes to give back
+ * Returns: None
+ */
+extern void pace_refund( struct pace *pace, size_t bytes ) {
+	if( pace->rate ) {
+		bucket_refund( &pace->bucket, bytes );
+	}
+}
+
+
+/* This function reports how many responses have been paced, and how.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void pace_stats( struct pace_stats *stats ) {
+	stats->classes = settings_get()->num_pace;
+	stats->kernel = atomic_load( &kernel );
+	stats->bucket = atomic_load( &bucket );
+	stats->waits = atomic_load( &waits );
+}
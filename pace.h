@@ -0,0 +1,117 @@
+/*
+ * File: pace.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          pace module, which paces responses in classes of paths to a set
+ *          rate.
+ */
+
+#ifndef PACE_H
+#define PACE_H
+
+#include <stddef.h>
+
+#include "bucket.h"
+#include "settings.h"
+
+/*
+ * This module has five functions:
+ *   pace_add()    : add a class of paths, from a pace directive
+ *   pace_start()  : start pacing a response, if its path is in a class
+ *   pace_grant()  : get how many bytes of a paced response may be sent now
+ *   pace_refund() : give back bytes granted but not sent
+ *   pace_stats()  : report how many responses have been paced, and how
+ *
+ * Large downloads sent as fast as possible come out in bursts that fill
+ * the queues of the link and delay the small, interactive responses that
+ * share it.  Responses for paths in a class are instead sent at the class's
+ * rate.  Classes are added from the configuration file with directives of
+ * the form
+ *
+ *   pace /prefix rate
+ *   pace *.ext   rate
+ *
+ * where rate is in bytes per second, e.g., 1m.  A path is in the first
+ * class, in the order given, whose prefix it starts with or whose
+ * extension it ends with.
+ *
+ * pace_start() asks the kernel to pace the connection, with the
+ * SO_MAX_PACING_RATE socket option, which TCP and the fq queueing
+ * discipline honour without any further work by the server.  If the kernel
+ * refuses, the response is paced by a token bucket (see bucket.h) instead:
+ * each send asks pace_grant() how much it may send, and when the answer is
+ * nothing, the request is put aside, off the run queues, until the bucket
+ * has refilled, and the worker serves other requests meanwhile.  Bytes
+ * granted but then held back by the client's bandwidth (see rate.h) are
+ * given back with pace_refund().  The classes are part of the settings
+ * (see settings.h), so a reload of the configuration file replaces them;
+ * a response keeps the pacing it started with.  pace_start(), pace_grant()
+ * and pace_refund() are thread safe.
+ */
+
+/* The pacing of one response. */
+struct pace {
+	size_t rate;          /* bytes per second, 0 if not paced by a token bucket */
+	struct bucket bucket; /* bytes that may be sent */
+};
+
+struct pace_stats {
+	size_t classes; /* # of classes of paths */
+	size_t kernel;  /* # of responses paced by the kernel */
+	size_t bucket;  /* # of responses paced by a token bucket */
+	size_t waits;   /* # of sends held back by a token bucket */
+};
+
+
+/* This function adds a class of paths, from a pace directive.
+ * Parameters:
+ *    set  : the settings being built
+ *    argc : # of words of the directive
+ *    argv : words of the directive, starting with "pace"
+ * Returns: 0 on success, or -1 if the directive is malformed.
+ */
+extern int pace_add( struct settings *set, int argc, char **argv );
+
+
+/* This function starts pacing a response, if its path is in a class: the
+ *    kernel is asked to pace the connection, and if it cannot, a token
+ *    bucket is set up to.
+ * Parameters:
+ *    pace : the response's pacing, to be set up
+ *    fd   : the client connection
+ *    path : the requested path
+ * Returns: None
+ */
+extern void pace_start( struct pace *pace, int fd, const char *path );
+
+
+/* This function gets how many bytes of a paced response may be sent now,
+ *    taking them from its token bucket.
+ * Parameters:
+ *    pace : the response's pacing
+ *    want : the bytes the caller would like to send
+ *    wait : if none may be sent, set to the ns until some may
+ * Returns: The bytes that may be sent, at most want, or 0 if the caller is
+ *          to try again in *wait ns.
+ */
+extern size_t pace_grant( struct pace *pace, size_t want, long long *wait );
+
+
+/* This function gives back bytes granted by pace_grant() that were not
+ *    sent, e.g., because the client's bandwidth would not allow them.
+ * Parameters:
+ *    pace  : the response's pacing
+ *    bytes : bytes to give back
+ * Returns: None
+ */
+extern void pace_refund( struct pace *pace, size_t bytes );
+
+
+/* This function reports how many responses have been paced, and how.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void pace_stats( struct pace_stats *stats );
+
+#endif
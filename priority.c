@@ -0,0 +1,104 @@
+/*
+ * File: priority.c
+ * Author: agent
+ * Purpose: This file contains the priority module, which sorts requests
+ *         into priority classes by their path.
+ *         Please see priority.h for documentation on how to use this module.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "priority.h"
+
+static const char *names[WORKER_CLASSES] = { "high", "normal", "low" }; /* by class */
+static int weights[WORKER_CLASSES]; /* quanta per round, by class */
+static int weighted; /* weighted, rather than strict, priority? */
+
+
+/* This function puts paths in a class, from a priority directive.
+ * Parameters:
+ *    set  : the settings being built
+ *    argc : # of words of the directive
+ *    argv : words of the directive, starting with "priority"
+ * Returns: 0 on success, or -1 if the directive is malformed.
+ */
+extern int priority_add( struct settings *set, int argc, char **argv ) {
+	int class; /* class of paths */
+	int i; /* word index */
+
+	for( class = 0; ( class < WORKER_CLASSES ) && ( argc > 1 ); class++ ) {
+		if( !strcmp( argv[1], names[class] ) ) {
+			break;
+		}
+	}
+	if( ( argc < 3 ) || ( class == WORKER_CLASSES ) ) {
+		return -1;
+	}
+
+	for( i = 2; i < argc; i++ ) {
+		if( config_match( argv[i], NULL ) ||
+		    settings_add_rule( &set->priority, &set->num_priority, argv[i], class ) ) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+/* This function sets how classes share the workers, from a schedule
+ *    directive.
+ * Parameters:
+ *    argc : # of words of the directive
+ *    argv : words of the directive, starting with "schedule"
+ * Returns: 0 on success, or -1 if the directive is malformed.
+ */
+extern int priority_schedule( int argc, char **argv ) {
+	int class; /* class index */
+
+	if( ( argc == 2 ) && !strcmp( argv[1], "strict" ) ) {
+		weighted = 0;
+		return 0;
+	} else if( ( argc != 2 + WORKER_CLASSES ) || strcmp( argv[1], "weighted" ) ) {
+		return -1;
+	}
+
+	for( class = 0; class < WORKER_CLASSES; class++ ) {
+		if( ( sscanf( argv[2 + class], "%d", &weights[class] ) != 1 ) ||
+		    ( weights[class] < 1 ) ) {
+			return -1;
+		}
+	}
+	weighted = 1;
+	return 0;
+}
+
+
+/* This function finds the class of a path, by the current settings.
+ * Parameters:
+ *    path : the path
+ * Returns: The class, PRIORITY_HIGH, PRIORITY_NORMAL or PRIORITY_LOW.
+ */
+extern int priority_class( const char *path ) {
+	const struct settings *set = settings_get(); /* current rules */
+	size_t i; /* rule index */
+
+	for( i = 0; i < set->num_priority; i++ ) {
+		if( config_match( set->priority[i].pattern, path ) > 0 ) {
+			return set->priority[i].value;
+		}
+	}
+	return PRIORITY_NORMAL;
+}
+
+
+/* This function gets the weights of the classes, for worker_init().
+ * Parameters: None
+ * Returns: The weights, WORKER_CLASSES of them, highest class first, or
+ *          NULL for strict priority.
+ */
+extern const int *priority_weights() {
+	return weighted ? weights : NULL;
+}
@@ -0,0 +1,87 @@
+/*
+ * File: priority.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          priority module, which sorts requests into priority classes by
+ *          their path.
+ */
+
+#ifndef PRIORITY_H
+#define PRIORITY_H
+
+#include "settings.h"
+#include "worker.h"
+
+#define PRIORITY_HIGH 0 /* e.g., pages and API calls */
+#define PRIORITY_NORMAL 1 /* everything not put in a class */
+#define PRIORITY_LOW 2 /* e.g., large downloads */
+
+/*
+ * This module has four functions:
+ *   priority_add()      : put paths in a class, from a priority directive
+ *   priority_schedule() : set how classes share the workers, from a
+ *                         schedule directive
+ *   priority_class()    : find the class of a path
+ *   priority_weights()  : get the weights of the classes
+ *
+ * Each request is served from the run queue of its class (see worker.h),
+ * so that page loads stay fast while large archives download.  Paths are
+ * put in classes from the configuration file with directives of the form
+ *
+ *   priority high|normal|low pattern...
+ *
+ * where each pattern is a path prefix, such as /api, or an extension, such
+ * as *.html.  A path is in the class of the first pattern it matches, in
+ * the order given, and in the normal class if it matches none.  How the
+ * classes share the workers is set with
+ *
+ *   schedule strict
+ *   schedule weighted high normal low
+ *
+ * Under strict priority, the default, a worker always serves the highest
+ * class with a request waiting.  Under weighted priority, each class gets
+ * as many quanta per round as its weight, e.g., schedule weighted 8 4 1,
+ * so that low classes never starve; a class with nothing waiting gives its
+ * turns to the others.  Within a class, requests take turns a quantum at
+ * a time, as before.  The rules are part of the settings (see settings.h),
+ * so a reload of the configuration file replaces them; the schedule is
+ * fixed when the workers start, and only read from the file at startup.
+ */
+
+
+/* This function puts paths in a class, from a priority directive.
+ * Parameters:
+ *    set  : the settings being built
+ *    argc : # of words of the directive
+ *    argv : words of the directive, starting with "priority"
+ * Returns: 0 on success, or -1 if the directive is malformed.
+ */
+extern int priority_add( struct settings *set, int argc, char **argv );
+
+
+/* This function sets how classes share the workers, from a schedule
+ *    directive.
+ * Parameters:
+ *    argc : # of words of the directive
+ *    argv : words of the directive, starting with "schedule"
+ * Returns: 0 on success, or -1 if the directive is malformed.
+ */
+extern int priority_schedule( int argc, char **argv );
+
+
+/* This function finds the class of a path, by the current settings.
+ * Parameters:
+ *    path : the path
+ * Returns: The class, PRIORITY_HIGH, PRIORITY_NORMAL or PRIORITY_LOW.
+ */
+extern int priority_class( const char *path );
+
+
+/* This function gets the weights of the classes, for worker_init().
+ * Parameters: None
+ * Returns: The weights, WORKER_CLASSES of them, highest class first, or
+ *          NULL for strict priority.
+ */
+extern const int *priority_weights();
+
+#endif
@@ -0,0 +1,33 @@
+/*
+ * File: probes.c
+ * Author: agent
+ * Purpose: This file contains the semaphores of the USDT probes, which a
+ *         tracer sets while it is attached to them.
+ *         Please see probes.h for documentation on how to use this module.
+ */
+
+#include "probes.h"
+
+#ifdef SWS_PROBES
+__extension__ unsigned short sws_accept_semaphore PROBE_SEMAPHORE;
+__extension__ unsigned short sws_parse_semaphore PROBE_SEMAPHORE;
+__extension__ unsigned short sws_enqueue_semaphore PROBE_SEMAPHORE;
+__extension__ unsigned short sws_dispatch_semaphore PROBE_SEMAPHORE;
+__extension__ unsigned short sws_quantum_semaphore PROBE_SEMAPHORE;
+__extension__ unsigned short sws_cache_hit_semaphore PROBE_SEMAPHORE;
+__extension__ unsigned short sws_cache_miss_semaphore PROBE_SEMAPHORE;
+__extension__ unsigned short sws_close_semaphore PROBE_SEMAPHORE;
+#endif
+
+
+/* This function checks whether the server was built with probes.
+ * Parameters: None
+ * Returns: 1 if it was, 0 if not.
+ */
+extern int probes_enabled() {
+#ifdef SWS_PROBES
+	return 1;
+#else
+	return 0;
+#endif
+}
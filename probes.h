@@ -0,0 +1,97 @@
+/*
+ * File: probes.h
+ * Author: agent
+ * Purpose: This file contains the USDT probes placed along the life of a
+ *          request, and describes how to use them, so that perf, bpftrace
+ *          or SystemTap can be attached to a running server to see inside
+ *          it.
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+#include <stdint.h>
+
+/*
+ * This module has one function:
+ *   probes_enabled() : check whether the server was built with probes
+ *
+ * The probes are built in wherever <sys/sdt.h> (systemtap-sdt-dev) is
+ * installed, unless SWS_NO_PROBES is defined.  Each is a single nop until
+ * a tracer attaches to it, and each has a semaphore that the tracer sets
+ * while attached, so that its arguments, such as the time, are only
+ * worked out while someone is listening.  Every probe of the provider sws
+ * gets the time on the monotonic clock, in ns, as its last argument:
+ *
+ *   accept     (fd, ns)                   : client connection accepted
+ *   parse      (fd, status, path, ns)     : request read and parsed; path
+ *                                           is NULL if status is not 0
+ *   enqueue    (req, class, ns)           : request put on a run queue
+ *   dispatch   (req, class, ns)           : worker starts a quantum of it
+ *   quantum    (fd, path, sent, more, ns) : quantum served, sent bytes of
+ *                                           the response so far, more if
+ *                                           it needs another
+ *   cache_hit  (path, size, ns)           : file found in the cache
+ *   cache_miss (path, size, ns)           : file read into the cache
+ *   close      (fd, path, sent, ns)       : connection closed, path NULL
+ *                                           if no request was served
+ *
+ * For example, to see how long requests wait on the run queues:
+ *
+ *   bpftrace -e 'usdt:./sws:sws:enqueue { @t[arg0] = arg2; }
+ *                usdt:./sws:sws:dispatch /@t[arg0]/ {
+ *                  @wait_us = hist( ( arg2 - @t[arg0] ) / 1000 );
+ *                  delete( @t[arg0] ); }'
+ *
+ * Every argument is passed as an integer: pointers, such as req and path,
+ * go through PROBE_PTR(), so that a tracer reads them as addresses (e.g.,
+ * str( arg1 ) in bpftrace) whatever the pointer type.
+ */
+
+#define PROBE_PTR( p ) ( (long)(uintptr_t)( p ) ) /* pointer as a probe argument */
+
+#if !defined( SWS_NO_PROBES ) && defined( __has_include )
+#if __has_include( <sys/sdt.h> )
+#define SWS_PROBES
+#endif
+#endif
+
+#ifdef SWS_PROBES
+
+#define _SDT_HAS_SEMAPHORES 1 /* probes test their semaphores */
+#include <sys/sdt.h>
+
+#include "util.h"
+
+#define PROBE_SEMAPHORE __attribute__(( unused )) __attribute__(( section( ".probes" ) ))
+
+__extension__ extern unsigned short sws_accept_semaphore PROBE_SEMAPHORE;
+__extension__ extern unsigned short sws_parse_semaphore PROBE_SEMAPHORE;
+__extension__ extern unsigned short sws_enqueue_semaphore PROBE_SEMAPHORE;
+__extension__ extern unsigned short sws_dispatch_semaphore PROBE_SEMAPHORE;
+__extension__ extern unsigned short sws_quantum_semaphore PROBE_SEMAPHORE;
+__extension__ extern unsigned short sws_cache_hit_semaphore PROBE_SEMAPHORE;
+__extension__ extern unsigned short sws_cache_miss_semaphore PROBE_SEMAPHORE;
+__extension__ extern unsigned short sws_close_semaphore PROBE_SEMAPHORE;
+
+/* fires probe sws:name with the given arguments and the time, if attached */
+#define PROBE( name, ... ) do { \
+	if( __builtin_expect( sws_##name##_semaphore, 0 ) ) { \
+		STAP_PROBEV( sws, name, __VA_ARGS__, util_now_ns() ); \
+	} \
+} while( 0 )
+
+#else
+
+#define PROBE( name, ... ) do { } while( 0 ) /* built without probes */
+
+#endif
+
+
+/* This function checks whether the server was built with probes.
+ * Parameters: None
+ * Returns: 1 if it was, 0 if not.
+ */
+extern int probes_enabled();
+
+#endif
@@ -0,0 +1,641 @@
+/*
+ * File: profile.c
+ * Author: agent
+ * Purpose: This file contains the profile module, which samples the
+ *         server's own threads on demand and reports where they spend their
+ *         time.
+ *         Please see profile.h for documentation on how to use this module.
+ */
+
+#define _GNU_SOURCE /* for dladdr(), process_vm_readv() and REG_RIP */
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+
+#include "profile.h"
+
+#define MAX_DEPTH 48 /* deepest stack kept */
+#define MAX_SAMPLES 16384 /* most samples kept per profile */
+#define MAX_THREADS 256 /* most threads sampled with perf events */
+#define MAX_RECORD 512 /* largest perf record read, in 8 byte words */
+#define RING_PAGES 16 /* pages of each perf ring, a power of two */
+#define DRAIN_MS 50 /* ms between emptying the perf rings */
+#define FRAME_SPAN ( 8 << 20 ) /* farthest a frame may be above the stack pointer */
+#define LINE_SIZE 4096 /* longest folded stack */
+
+/* A call stack sampled, innermost function first. */
+struct sample {
+	int depth;                 /* # of addresses */
+	uintptr_t ips[MAX_DEPTH];  /* addresses: where the thread was, then return addresses */
+};
+
+/* A function of the server's own symbol table. */
+struct sym {
+	uintptr_t addr;   /* where it starts, as loaded */
+	size_t size;      /* its length */
+	const char *name; /* its name */
+};
+
+/* The perf event sampling one thread, and the ring its samples land in. */
+struct ring {
+	int fd;                             /* the event */
+	struct perf_event_mmap_page *meta;  /* head and tail of the ring */
+	char *data;                         /* the ring */
+};
+
+static atomic_int running; /* is a profile running? */
+static atomic_int sampling; /* may the SIGPROF handler take samples? */
+static atomic_int in_handler; /* # of SIGPROF handlers running */
+static atomic_int num_samples; /* # of samples taken, kept or not */
+static atomic_int dropped; /* # of samples not kept */
+static struct sample *samples; /* samples kept */
+static struct sym *syms; /* functions of the server, by address */
+static int num_syms;
+static int handler_set; /* is the SIGPROF handler installed? */
+static pid_t self; /* the server's pid */
+static size_t page_size; /* bytes in a page */
+static int out_fd = -1; /* client to send the profile to */
+static int duration; /* seconds to profile for */
+
+
+/* This function claims a slot for a new sample.  It is safe to call from
+ *    a signal handler.
+ * Parameters: None
+ * Returns: The slot, or NULL if all are taken.
+ */
+static struct sample *new_sample() {
+	int i = atomic_fetch_add( &num_samples, 1 ); /* slot claimed */
+
+	if( i >= MAX_SAMPLES ) {
+		atomic_fetch_add( &dropped, 1 );
+		return NULL;
+	}
+	samples[i].depth = 0;
+	return &samples[i];
+}
+
+
+/* This function reads a stack frame, the caller's frame pointer and the
+ *    return address, without faulting if the frame pointer is bad.  It is
+ *    safe to call from a signal handler.
+ * Parameters:
+ *    fp    : the frame pointer
+ *    frame : set to the caller's frame pointer and the return address
+ * Returns: 0 on success, or -1 if the frame cannot be read.
+ */
+static int read_frame( uintptr_t fp, uintptr_t *frame ) {
+	struct iovec local = { frame, 2 * sizeof( uintptr_t ) }; /* read into */
+	struct iovec remote = { (void *)fp, 2 * sizeof( uintptr_t ) }; /* read from */
+
+	return process_vm_readv( self, &local, 1, &remote, 1, 0 ) ==
+	       2 * sizeof( uintptr_t ) ? 0 : -1;
+}
+
+
+/* This function takes a sample of the thread a SIGPROF lands on, by
+ *    following its frame pointers up from where it was interrupted.  Each
+ *    frame must be above the last, and within FRAME_SPAN of the stack
+ *    pointer.
+ * Parameters:
+ *    sig     : the signal, SIGPROF
+ *    info    : not used
+ *    context : the interrupted thread's registers
+ * Returns: None
+ */
+static void on_sigprof( int sig, siginfo_t *info, void *context ) {
+	ucontext_t *uc = context; /* interrupted thread */
+	uintptr_t pc = 0, fp = 0, sp = 0; /* its registers */
+	uintptr_t frame[2]; /* caller's frame pointer, return address */
+	struct sample *s; /* sample taken */
+	int saved = errno; /* errno of interrupted code */
+
+	(void)sig;
+	(void)info;
+	atomic_fetch_add( &in_handler, 1 );
+#if defined( __x86_64__ )
+	pc = uc->uc_mcontext.gregs[REG_RIP];
+	fp = uc->uc_mcontext.gregs[REG_RBP];
+	sp = uc->uc_mcontext.gregs[REG_RSP];
+#elif defined( __aarch64__ )
+	pc = uc->uc_mcontext.pc;
+	fp = uc->uc_mcontext.regs[29];
+	sp = uc->uc_mcontext.sp;
+#else
+	(void)uc;
+#endif
+	if( pc && atomic_load( &sampling ) && ( s = new_sample() ) ) {
+		s->ips[s->depth++] = pc;
+		while( ( s->depth < MAX_DEPTH ) && ( fp >= sp ) && ( fp - sp < FRAME_SPAN ) &&
+		       !( fp % sizeof( uintptr_t ) ) && !read_frame( fp, frame ) && frame[1] ) {
+			s->ips[s->depth++] = frame[1];
+			if( frame[0] <= fp ) { /* outermost frame, or a broken chain */
+				break;
+			}
+			fp = frame[0];
+		}
+	}
+	atomic_fetch_sub( &in_handler, 1 );
+	errno = saved;
+}
+
+
+/* This function starts sampling the server with SIGPROF, PROFILE_HZ times
+ *    a second of CPU time.  The handler stays installed once it is, since
+ *    a signal could still be on its way when sampling stops.
+ * Parameters: None
+ * Returns: None
+ */
+static void sigprof_start() {
+	struct sigaction sa; /* handler */
+	struct itimerval it = { { 0, 1000000 / PROFILE_HZ }, { 0, 1000000 / PROFILE_HZ } };
+
+	if( !handler_set ) {
+		memset( &sa, 0, sizeof( sa ) );
+		sa.sa_sigaction = on_sigprof;
+		sa.sa_flags = SA_SIGINFO | SA_RESTART;
+		sigemptyset( &sa.sa_mask );
+		sigaction( SIGPROF, &sa, NULL );
+		handler_set = 1;
+	}
+	atomic_store( &sampling, 1 );
+	setitimer( ITIMER_PROF, &it, NULL );
+}
+
+
+/* This function stops sampling with SIGPROF, and waits for handlers that
+ *    are still running to finish.
+ * Parameters: None
+ * Returns: None
+ */
+static void sigprof_stop() {
+	struct itimerval it; /* timer, off */
+
+	memset( &it, 0, sizeof( it ) );
+	setitimer( ITIMER_PROF, &it, NULL );
+	atomic_store( &sampling, 0 );
+	while( atomic_load( &in_handler ) ) {
+		sched_yield();
+	}
+}
+
+
+/* This function opens a perf event that samples a thread's call stack
+ *    PROFILE_HZ times a second of its CPU time, and maps its ring.
+ * Parameters:
+ *    ring : set to the event and its ring
+ *    tid  : the thread
+ * Returns: 0 on success, or -1 if perf events are not allowed or fail.
+ */
+static int ring_open( struct ring *ring, pid_t tid ) {
+	struct perf_event_attr attr; /* what to sample */
+
+	memset( &attr, 0, sizeof( attr ) );
+	attr.size = sizeof( attr );
+	attr.type = PERF_TYPE_SOFTWARE;
+	attr.config = PERF_COUNT_SW_CPU_CLOCK;
+	attr.freq = 1;
+	attr.sample_freq = PROFILE_HZ;
+	attr.sample_type = PERF_SAMPLE_CALLCHAIN;
+	attr.exclude_hv = 1;
+	attr.exclude_callchain_kernel = 1; /* the user stack, even in a system call */
+
+	ring->fd = syscall( SYS_perf_event_open, &attr, tid, -1, -1, PERF_FLAG_FD_CLOEXEC );
+	if( ring->fd < 0 ) { /* time in the kernel not allowed, e.g., perf_event_paranoid 2 */
+		attr.exclude_kernel = 1;
+		ring->fd = syscall( SYS_perf_event_open, &attr, tid, -1, -1, PERF_FLAG_FD_CLOEXEC );
+	}
+	if( ring->fd < 0 ) {
+		return -1;
+	}
+	ring->meta = mmap( NULL, ( RING_PAGES + 1 ) * page_size, PROT_READ | PROT_WRITE,
+	                   MAP_SHARED, ring->fd, 0 );
+	if( ring->meta == MAP_FAILED ) {
+		close( ring->fd );
+		return -1;
+	}
+	ring->data = (char *)ring->meta + page_size;
+	return 0;
+}
+
+
+/* This function closes a perf event and unmaps its ring.
+ * Parameters:
+ *    ring : the event and its ring
+ * Returns: None
+ */
+static void ring_close( struct ring *ring ) {
+	munmap( ring->meta, ( RING_PAGES + 1 ) * page_size );
+	close( ring->fd );
+}
+
+
+/* This function copies bytes out of a ring, where they may wrap around its
+ *    end.
+ * Parameters:
+ *    ring : the ring
+ *    off  : where the bytes start, as counted by the ring's head and tail
+ *    dst  : where to copy them
+ *    len  : # of bytes
+ * Returns: None
+ */
+static void ring_copy( struct ring *ring, uint64_t off, void *dst, size_t len ) {
+	size_t size = RING_PAGES * page_size; /* bytes of ring */
+	size_t first; /* bytes before the end */
+
+	off &= size - 1;
+	first = size - off < len ? size - off : len;
+	memcpy( dst, ring->data + off, first );
+	memcpy( (char *)dst + first, ring->data, len - first );
+}
+
+
+/* This function keeps the samples that have landed in a ring, and frees
+ *    their room.
+ * Parameters:
+ *    ring : the ring
+ * Returns: None
+ */
+static void ring_drain( struct ring *ring ) {
+	static uint64_t rec[MAX_RECORD]; /* record: header, # of addresses, addresses */
+	struct perf_event_header hdr; /* header of record */
+	uint64_t head, tail; /* written up to, read up to */
+	struct sample *s; /* sample kept */
+	uint64_t i; /* address index */
+
+	head = __atomic_load_n( &ring->meta->data_head, __ATOMIC_ACQUIRE );
+	for( tail = ring->meta->data_tail; tail < head; tail += hdr.size ) {
+		ring_copy( ring, tail, &hdr, sizeof( hdr ) );
+		if( !hdr.size ) { /* never, but do not spin on it */
+			tail = head;
+			break;
+		} else if( ( hdr.type != PERF_RECORD_SAMPLE ) ) {
+			continue; /* e.g., samples lost, which dropped counts anyway */
+		} else if( hdr.size > sizeof( rec ) ) {
+			atomic_fetch_add( &dropped, 1 );
+			continue;
+		}
+		ring_copy( ring, tail, rec, hdr.size );
+		if( !( s = new_sample() ) ) {
+			continue;
+		}
+		for( i = 0; ( i < rec[1] ) && ( 2 + i < hdr.size / 8 ) && ( s->depth < MAX_DEPTH ); i++ ) {
+			if( rec[2 + i] < (uint64_t)PERF_CONTEXT_MAX ) { /* not a context marker */
+				s->ips[s->depth++] = rec[2 + i];
+			}
+		}
+	}
+	__atomic_store_n( &ring->meta->data_tail, tail, __ATOMIC_RELEASE );
+}
+
+
+/* This function opens a perf event for each thread of the server but the
+ *    caller.
+ * Parameters:
+ *    rings : set to the events, MAX_THREADS of them at most
+ * Returns: The # of events opened, or -1 if perf events cannot be used.
+ */
+static int rings_open( struct ring *rings ) {
+	pid_t me = syscall( SYS_gettid ); /* the profiling thread */
+	struct dirent *de; /* thread found */
+	DIR *dir; /* threads of the server */
+	int n = 0; /* # of events opened */
+	int tried = 0; /* # of threads tried */
+	pid_t tid; /* thread */
+
+	dir = opendir( "/proc/self/task" );
+	if( !dir ) {
+		return -1;
+	}
+	while( ( de = readdir( dir ) ) && ( n < MAX_THREADS ) ) {
+		tid = atoi( de->d_name );
+		if( ( tid <= 0 ) || ( tid == me ) ) {
+			continue;
+		}
+		tried++;
+		if( !ring_open( &rings[n], tid ) ) {
+			n++;
+		} else if( tried == 1 ) { /* not allowed at all */
+			break;
+		}
+	}
+	closedir( dir );
+	return n ? n : -1;
+}
+
+
+/* This function gets where the server was loaded.  It is called by
+ *    dl_iterate_phdr().
+ * Parameters:
+ *    info : the object loaded, the server first
+ *    size : not used
+ *    base : set to where it was loaded
+ * Returns: 1, to stop after the server.
+ */
+static int find_base( struct dl_phdr_info *info, size_t size, void *base ) {
+	(void)size;
+	*(uintptr_t *)base = info->dlpi_addr;
+	return 1;
+}
+
+
+/* This function compares two functions by address, for qsort().
+ * Parameters:
+ *    a : the first function
+ *    b : the second function
+ * Returns: less than, equal to, or greater than 0, as a is before, at, or
+ *          after b.
+ */
+static int compare_syms( const void *a, const void *b ) {
+	const struct sym *x = a, *y = b; /* functions */
+
+	return ( x->addr > y->addr ) - ( x->addr < y->addr );
+}
+
+
+/* This function reads the functions of the server's own symbol table, so
+ *    that static functions, which dladdr() cannot name, are named too.  The
+ *    executable stays mapped, as the names point into it.  If it has no
+ *    symbol table, e.g., it was stripped, there are no functions.
+ * Parameters: None
+ * Returns: None
+ */
+static void syms_load() {
+	ElfW(Ehdr) *eh; /* ELF header */
+	ElfW(Shdr) *sh; /* section headers */
+	ElfW(Sym) *sym; /* symbols */
+	uintptr_t base = 0; /* where the server was loaded */
+	struct stat st; /* size of executable */
+	char *map; /* executable */
+	char *str; /* names of symbols */
+	size_t i, j, n; /* section, symbol index, # of symbols */
+	int fd; /* executable */
+
+	dl_iterate_phdr( find_base, &base );
+	fd = open( "/proc/self/exe", O_RDONLY );
+	if( ( fd < 0 ) || fstat( fd, &st ) ||
+	    ( ( map = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 ) ) == MAP_FAILED ) ) {
+		if( fd >= 0 ) {
+			close( fd );
+		}
+		return;
+	}
+	close( fd );
+
+	eh = (ElfW(Ehdr) *)map;
+	if( memcmp( eh->e_ident, ELFMAG, SELFMAG ) ||
+	    ( eh->e_shoff + eh->e_shnum * sizeof( ElfW(Shdr) ) > (size_t)st.st_size ) ) {
+		return;
+	}
+	sh = (ElfW(Shdr) *)( map + eh->e_shoff );
+	for( i = 0; i < eh->e_shnum; i++ ) {
+		if( ( sh[i].sh_type != SHT_SYMTAB ) || ( sh[i].sh_link >= eh->e_shnum ) ) {
+			continue;
+		}
+		sym = (ElfW(Sym) *)( map + sh[i].sh_offset );
+		str = map + sh[sh[i].sh_link].sh_offset;
+		n = sh[i].sh_size / sizeof( ElfW(Sym) );
+		syms = malloc( n * sizeof( struct sym ) );
+		if( !syms ) {
+			perror( "Error while allocating memory" );
+			abort();
+		}
+		for( j = 0; j < n; j++ ) {
+			if( ( ELF64_ST_TYPE( sym[j].st_info ) /* same for 32 bits */ == STT_FUNC ) && sym[j].st_value ) {
+				syms[num_syms].addr = base + sym[j].st_value;
+				syms[num_syms].size = sym[j].st_size;
+				syms[num_syms++].name = str + sym[j].st_name;
+			}
+		}
+		qsort( syms, num_syms, sizeof( struct sym ), compare_syms );
+		break;
+	}
+}
+
+
+/* This function names the function an address is in.
+ * Parameters:
+ *    ip  : the address
+ *    buf : buffer for a name made up, LINE_SIZE bytes
+ * Returns: The name: the function's, or, failing that, the object's in
+ *          brackets, or [unknown].
+ */
+static const char *name_of( uintptr_t ip, char *buf ) {
+	Dl_info info; /* shared library symbol */
+	const char *base; /* file name of object */
+	int lo = 0, hi = num_syms, mid; /* bounds of search */
+
+	while( lo < hi ) { /* first function past ip */
+		mid = ( lo + hi ) / 2;
+		if( syms[mid].addr <= ip ) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if( lo && ( ip < syms[lo - 1].addr + syms[lo - 1].size ) ) {
+		return syms[lo - 1].name;
+	}
+
+	if( !dladdr( (void *)ip, &info ) ) {
+		return "[unknown]";
+	} else if( info.dli_sname ) {
+		return info.dli_sname;
+	}
+	base = info.dli_fname ? strrchr( info.dli_fname, '/' ) : NULL;
+	snprintf( buf, LINE_SIZE, "[%s]", base ? base + 1 : info.dli_fname ? info.dli_fname : "?" );
+	return buf;
+}
+
+
+/* This function folds a sample into a line: the functions of its stack,
+ *    outermost first, separated by semicolons.  This function will abort
+ *    the program if memory cannot be allocated.
+ * Parameters:
+ *    s : the sample
+ * Returns: The line, to be freed by the caller.
+ */
+static char *fold( struct sample *s ) {
+	static char line[LINE_SIZE]; /* line folded */
+	static char buf[LINE_SIZE]; /* made up name */
+	char *copy; /* line returned */
+	int len = 0; /* length of line */
+	int i; /* address index */
+
+	line[0] = '\0';
+	for( i = s->depth - 1; ( i >= 0 ) && ( len < LINE_SIZE - 1 ); i-- ) {
+		/* a return address is just past the call, which may end the function */
+		len += snprintf( line + len, LINE_SIZE - len, "%s%s", len ? ";" : "",
+		                 name_of( s->ips[i] - ( i > 0 ), buf ) );
+	}
+	copy = strdup( line );
+	if( !copy ) {
+		perror( "Error while allocating memory" );
+		abort();
+	}
+	return copy;
+}
+
+
+/* This function compares two lines, for qsort().
+ * Parameters:
+ *    a : the first line
+ *    b : the second line
+ * Returns: less than, equal to, or greater than 0, as a is before, the same
+ *          as, or after b.
+ */
+static int compare_lines( const void *a, const void *b ) {
+	return strcmp( *(char * const *)a, *(char * const *)b );
+}
+
+
+/* This function sends the profile to the client as folded stacks, with a
+ *    count of the samples of each, and closes the connection.  This
+ *    function will abort the program if memory cannot be allocated.
+ * Parameters:
+ *    method : how the samples were taken
+ * Returns: None
+ */
+static void report( const char *method ) {
+	int n = atomic_load( &num_samples ); /* # of samples kept */
+	char **lines; /* folded stacks */
+	FILE *out; /* connection to client */
+	int i, j; /* line index, end of run */
+
+	n = n < MAX_SAMPLES ? n : MAX_SAMPLES;
+	lines = malloc( ( n + 1 ) * sizeof( char * ) );
+	if( !lines ) {
+		perror( "Error while allocating memory" );
+		abort();
+	}
+	for( i = 0; i < n; i++ ) {
+		lines[i] = fold( &samples[i] );
+	}
+	qsort( lines, n, sizeof( char * ), compare_lines );
+
+	out = fdopen( out_fd, "w" );
+	if( !out ) {
+		close( out_fd );
+	} else {
+		fprintf( out, "HTTP/1.1 200 OK\nContent-Type: text/plain\nX-Profiler: %s\n"
+		         "X-Samples: %d\nX-Dropped: %d\n\n", method, n, atomic_load( &dropped ) );
+		for( i = 0; i < n; i = j ) {
+			for( j = i + 1; ( j < n ) && !strcmp( lines[i], lines[j] ); j++ );
+			if( lines[i][0] ) {
+				fprintf( out, "%s %d\n", lines[i], j - i );
+			}
+		}
+		fclose( out );
+	}
+	for( i = 0; i < n; i++ ) {
+		free( lines[i] );
+	}
+	free( lines );
+}
+
+
+/* This function is where the profiling thread starts running.  It samples
+ *    the server for the time asked, with perf events if it can and SIGPROF
+ *    if not, sends the result, and exits.  This function will abort the
+ *    program if memory cannot be allocated.
+ * Parameters:
+ *    arg : not used
+ * Returns: NULL
+ */
+static void *profile_main( void *arg ) {
+	static struct ring rings[MAX_THREADS]; /* perf events, one per thread */
+	struct timespec nap = { 0, DRAIN_MS * 1000000L }; /* time between drains */
+	sigset_t block; /* signals not to take */
+	int n; /* # of perf events */
+	int t, i; /* drain index, event index */
+
+	(void)arg;
+	sigemptyset( &block );
+	sigaddset( &block, SIGPROF );
+	pthread_sigmask( SIG_BLOCK, &block, NULL ); /* do not sample ourselves */
+	if( !self ) {
+		self = getpid();
+		page_size = sysconf( _SC_PAGESIZE );
+		syms_load();
+	}
+	samples = malloc( MAX_SAMPLES * sizeof( struct sample ) );
+	if( !samples ) {
+		perror( "Error while allocating memory" );
+		abort();
+	}
+	atomic_store( &num_samples, 0 );
+	atomic_store( &dropped, 0 );
+
+	n = rings_open( rings );
+	if( n < 0 ) {
+		sigprof_start();
+	}
+	for( t = 0; t < duration * 1000 / DRAIN_MS; t++ ) {
+		nanosleep( &nap, NULL );
+		for( i = 0; i < n; i++ ) {
+			ring_drain( &rings[i] );
+		}
+	}
+	if( n < 0 ) {
+		sigprof_stop();
+	}
+	for( i = 0; i < n; i++ ) {
+		ring_drain( &rings[i] );
+		ring_close( &rings[i] );
+	}
+
+	report( n < 0 ? "sigprof" : "perf" );
+	free( samples );
+	samples = NULL;
+	atomic_store( &running, 0 );
+	return NULL;
+}
+
+
+/* This function starts profiling the server for a while, on a thread of
+ *    its own.  When it is done, the thread sends the result to a client,
+ *    as an HTTP response, and closes its own copy of the connection.
+ * Parameters:
+ *    fd   : the file descriptor to the client connection, which the caller
+ *           may close once this function returns
+ *    secs : how long to profile, up to PROFILE_MAX_SECS
+ * Returns: 0 if the profile was started, or -1 if one is already running
+ *          or the thread cannot be created.
+ */
+extern int profile_start( int fd, int secs ) {
+	pthread_t tid; /* profiling thread */
+	int idle = 0; /* running, if none is */
+
+	if( !atomic_compare_exchange_strong( &running, &idle, 1 ) ) {
+		return -1;
+	}
+	out_fd = dup( fd );
+	duration = secs < 1 ? 1 : secs > PROFILE_MAX_SECS ? PROFILE_MAX_SECS : secs;
+	if( ( out_fd < 0 ) || pthread_create( &tid, NULL, profile_main, NULL ) ) {
+		if( out_fd >= 0 ) {
+			close( out_fd );
+		}
+		atomic_store( &running, 0 );
+		return -1;
+	}
+	pthread_detach( tid );
+	return 0;
+}
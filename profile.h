@@ -0,0 +1,57 @@
+/*
+ * File: profile.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          profile module, which samples the server's own threads on
+ *          demand and reports where they spend their time.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#define PROFILE_HZ 99 /* samples a second per thread, off the beat of timers */
+#define PROFILE_MAX_SECS 60 /* longest profile */
+
+/*
+ * This module has one function:
+ *   profile_start() : profile the server for a while, and send the result
+ *
+ * A profile runs on a thread of its own, so the thread answering admin
+ * requests carries on while it runs, and only one runs at a time.  Each
+ * thread of the server is sampled PROFILE_HZ times a second of the CPU
+ * time it uses, by a perf_event_open() CPU clock event per thread that has
+ * the kernel record the call stack of each sample, by following the frame
+ * pointers (the makefile keeps them).  Time spent in system calls counts
+ * toward the user stack that made them, unless perf_event_paranoid only
+ * allows user time to be sampled.  Where perf events are not allowed,
+ * e.g., by perf_event_paranoid or a seccomp filter, a SIGPROF interval
+ * timer is used instead, and the signal handler follows the frame
+ * pointers of whichever thread the signal lands on, which is the one
+ * using the CPU; it reads each frame with process_vm_readv(), so a broken
+ * chain ends the stack rather than the server.  SIGPROF interrupts system
+ * calls, so this is only a fallback.
+ *
+ * The result is sent as folded stacks, one line per distinct stack, e.g.,
+ *
+ *   worker_main;worker_serve;serve_quantum;send_cached;write 42
+ *
+ * ready for flamegraph.pl or speedscope.  Functions of the server are
+ * named from its own symbol table, so static ones are named too, and those
+ * of shared libraries by dladdr().  Headers X-Profiler, X-Samples and
+ * X-Dropped give the method used, and the samples taken and lost.
+ */
+
+
+/* This function starts profiling the server for a while, on a thread of
+ *    its own.  When it is done, the thread sends the result to a client,
+ *    as an HTTP response, and closes its own copy of the connection.
+ * Parameters:
+ *    fd   : the file descriptor to the client connection, which the caller
+ *           may close once this function returns
+ *    secs : how long to profile, up to PROFILE_MAX_SECS
+ * Returns: 0 if the profile was started, or -1 if one is already running
+ *          or the thread cannot be created.
+ */
+extern int profile_start( int fd, int secs );
+
+#endif
@@ -0,0 +1,599 @@
+/*
+ * File: proxy.c
+ * Author: agent
+ * Purpose: This file contains sws-proxy, which sits between clients, such
+ *          as sws-load or hydra.py, and the web server, and makes each
+ *          connection through it behave as though it crossed a slow or
+ *          distant link: its bandwidth is limited, each direction is
+ *          delayed, with jitter, and some of the data is "lost" and only
+ *          arrives after a retransmission timeout.  It needs neither root
+ *          nor tc, so the server's scheduling and timeouts can be measured
+ *          under WAN-like conditions on one machine.
+ *
+ *          Every connection gets a link of its own.  Data read from one
+ *          side is queued with the time it would reach the other end: the
+ *          time the link finishes sending it, at the link's bandwidth
+ *          (-b for server to client, -u for client to server), plus the
+ *          one-way delay (-d), plus a random jitter of up to -j ms.  A
+ *          piece lost (with probability -L percent) is held back a further
+ *          RTO_MS, and, as with TCP, everything behind it waits for it:
+ *          data is never reordered.  At most -w bytes are queued in each
+ *          direction; beyond that the proxy stops reading, so a server
+ *          sending to a slow client sees a slow reader, not a fast one.
+ *
+ *          A link only costs time once data flows over it: the handshake
+ *          to the server is not delayed.
+ */
+
+#define _GNU_SOURCE /* for accept4() */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "config.h"
+#include "util.h"
+
+#define MAX_EVENTS 256 /* events handled per epoll_wait() */
+#define CHUNK_SIZE 16384 /* most bytes read, and so sent on, at once */
+#define RTO_MS 200 /* extra delay of lost data, Linux's least RTO */
+#define IDLE_MS 1000 /* longest wait with nothing scheduled */
+
+/* Data read from one side of a link, waiting to be written to the other. */
+struct chunk {
+	struct chunk *next; /* next in order */
+	long long due;      /* when it reaches the other side, in ns */
+	size_t len;         /* bytes of data, 0 for end of file */
+	size_t off;         /* bytes of data written */
+	char data[];        /* the data */
+};
+
+/* One direction of a link. */
+struct dir {
+	int from;             /* socket read from */
+	int to;               /* socket written to */
+	size_t rate;          /* bandwidth, in bytes per second, 0 for none */
+	struct chunk *head;   /* oldest data queued */
+	struct chunk *tail;   /* newest data queued */
+	size_t queued;        /* bytes queued */
+	long long link_free;  /* when the link finishes sending what it has */
+	long long last_due;   /* when the newest data is due */
+	int eof;              /* end of file read? */
+	int done;             /* end of file passed on? */
+	int writing;          /* waiting for room to write? */
+	int armed;            /* timer set for the oldest data? */
+	struct link *link;    /* link the direction belongs to */
+};
+
+/* One side of a link, as registered with epoll. */
+struct end {
+	int fd;            /* socket */
+	unsigned events;   /* events registered, 0 if not in epoll */
+	struct dir *in;    /* direction read from the socket */
+	struct dir *out;   /* direction written to the socket */
+	struct link *link; /* link the side belongs to */
+};
+
+/* A client's connection, and the proxy's connection to the server. */
+struct link {
+	struct dir up;       /* client to server */
+	struct dir down;     /* server to client */
+	struct end ends[2];  /* client, server */
+	int connecting;      /* still connecting to the server? */
+	int closed;          /* both sockets closed? */
+	int timers;          /* # of timers set */
+	struct link *next;   /* next closed link to free */
+};
+
+/* A direction waiting for its oldest data to be due. */
+struct timer {
+	long long due;   /* when, in ns */
+	struct dir *dir; /* the direction */
+};
+
+static struct timer *timers; /* heap, soonest first */
+static int num_timers;
+static int max_timers; /* room in heap */
+static struct link *dead; /* closed links, freed after each batch of events */
+static struct sockaddr_in server; /* where to connect */
+static size_t down_rate; /* server to client bandwidth, 0 for none */
+static size_t up_rate; /* client to server bandwidth, 0 for none */
+static long long delay; /* one-way delay, in ns */
+static long long jitter; /* most extra delay, in ns */
+static double loss; /* chance a chunk is lost */
+static size_t window = 256 << 10; /* most bytes queued per direction */
+static int epfd; /* epoll instance */
+
+
+/* This function sets a timer for when a direction's oldest data is due.
+ *    This function will abort the program if memory cannot be allocated.
+ * Parameters:
+ *    dir : the direction
+ * Returns: None
+ */
+static void timer_push( struct dir *dir ) {
+	struct timer t = { dir->head->due, dir }; /* new timer */
+	int i = num_timers++; /* hole, sifted up */
+
+	if( num_timers > max_timers ) {
+		max_timers = max_timers ? 2 * max_timers : 256;
+		timers = realloc( timers, max_timers * sizeof( struct timer ) );
+		if( !timers ) {
+			perror( "Error while allocating memory" );
+			abort();
+		}
+	}
+	for( ; ( i > 0 ) && ( timers[( i - 1 ) / 2].due > t.due ); i = ( i - 1 ) / 2 ) {
+		timers[i] = timers[( i - 1 ) / 2];
+	}
+	timers[i] = t;
+	dir->armed = 1;
+	dir->link->timers++;
+}
+
+
+/* This function takes the soonest timer off the heap.
+ * Parameters: None
+ * Returns: The direction of the timer.
+ */
+static struct dir *timer_pop() {
+	struct timer last = timers[--num_timers]; /* moved into the hole */
+	struct dir *dir = timers[0].dir; /* direction of soonest */
+	int i = 0, c; /* hole, child */
+
+	for( c = 1; c < num_timers; i = c, c = 2 * c + 1 ) {
+		if( ( c + 1 < num_timers ) && ( timers[c + 1].due < timers[c].due ) ) {
+			c++;
+		}
+		if( timers[c].due >= last.due ) {
+			break;
+		}
+		timers[i] = timers[c];
+	}
+	timers[i] = last;
+	dir->armed = 0;
+	dir->link->timers--;
+	return dir;
+}
+
+
+/* This function closes both sides of a link and drops what is queued.  The
+ *    link itself is freed once no event or timer can refer to it.
+ * Parameters:
+ *    link : the link
+ * Returns: None
+ */
+static void close_link( struct link *link ) {
+	struct dir *dirs[2] = { &link->up, &link->down }; /* both directions */
+	struct chunk *c; /* chunk freed */
+	int i; /* direction index */
+
+	if( link->closed ) {
+		return;
+	}
+	for( i = 0; i < 2; i++ ) {
+		while( ( c = dirs[i]->head ) ) {
+			dirs[i]->head = c->next;
+			free( c );
+		}
+		close( link->ends[i].fd );
+	}
+	link->closed = 1;
+	link->next = dead;
+	dead = link;
+}
+
+
+/* This function queues data read from one side of a link, to be due at
+ *    the time it would reach the other side.
+ * Parameters:
+ *    dir : the direction
+ *    c   : the data
+ *    now : the time it was read, in ns
+ * Returns: None
+ */
+static void schedule( struct dir *dir, struct chunk *c, long long now ) {
+	long long due; /* when the data reaches the other side */
+
+	if( dir->link_free < now ) { /* link idle */
+		dir->link_free = now;
+	}
+	if( dir->rate ) {
+		dir->link_free += (long long)( c->len * 1e9 / dir->rate );
+	}
+	due = dir->link_free + delay;
+	if( jitter ) {
+		due += (long long)( drand48() * jitter );
+	}
+	if( c->len && ( drand48() < loss ) ) {
+		due += RTO_MS * 1000000LL; /* retransmitted */
+	}
+	dir->last_due = due > dir->last_due ? due : dir->last_due; /* in order */
+	c->due = dir->last_due;
+
+	c->next = NULL;
+	if( dir->tail ) {
+		dir->tail->next = c;
+	} else {
+		dir->head = c;
+	}
+	dir->tail = c;
+	dir->queued += c->len;
+}
+
+
+/* This function reads what a direction's socket has, up to its window.
+ *    This function will abort the program if memory cannot be allocated.
+ * Parameters:
+ *    dir : the direction
+ * Returns: 0 on success, or -1 if the socket failed.
+ */
+static int pull( struct dir *dir ) {
+	static char buf[CHUNK_SIZE]; /* read buffer */
+	struct chunk *c; /* data read */
+	ssize_t len; /* bytes read */
+
+	while( !dir->eof && ( dir->queued < window ) ) {
+		len = read( dir->from, buf, CHUNK_SIZE );
+		if( len < 0 ) {
+			return ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) ? 0 : -1;
+		}
+		c = malloc( sizeof( struct chunk ) + len );
+		if( !c ) {
+			perror( "Error while allocating memory" );
+			abort();
+		}
+		memcpy( c->data, buf, len );
+		c->len = len;
+		c->off = 0;
+		dir->eof = !len;
+		schedule( dir, c, util_now_ns() );
+	}
+	return 0;
+}
+
+
+/* This function writes a direction's data that is due to its other side,
+ *    passing on end of file once all is written, and sets a timer for the
+ *    rest.
+ * Parameters:
+ *    dir : the direction
+ * Returns: 0 on success, or -1 if the socket failed.
+ */
+static int deliver( struct dir *dir ) {
+	long long now = util_now_ns(); /* current time */
+	struct chunk *c; /* oldest data */
+	ssize_t len; /* bytes written */
+
+	while( ( c = dir->head ) && ( c->due <= now ) && !dir->writing ) {
+		if( !c->len ) { /* end of file */
+			shutdown( dir->to, SHUT_WR );
+			dir->done = 1;
+		} else {
+			len = send( dir->to, c->data + c->off, c->len - c->off, MSG_NOSIGNAL );
+			if( ( len < 0 ) && ( errno != EAGAIN ) && ( errno != EWOULDBLOCK ) ) {
+				return -1;
+			}
+			c->off += len > 0 ? len : 0;
+			if( c->off < c->len ) { /* socket full */
+				dir->writing = 1;
+				break;
+			}
+		}
+		dir->queued -= c->len;
+		dir->head = c->next;
+		dir->tail = dir->head ? dir->tail : NULL;
+		free( c );
+	}
+
+	if( dir->head && !dir->writing && !dir->armed ) {
+		timer_push( dir );
+	}
+	return 0;
+}
+
+
+/* This function registers the events each side of a link waits for: input
+ *    while its direction has room, and output while the other direction
+ *    waits to write, or while the server is being connected to.  A side
+ *    waiting for neither is taken out of epoll, which would otherwise
+ *    report a hang up on it over and over.  Once both directions have
+ *    passed on end of file, the link is closed.
+ * Parameters:
+ *    link : the link
+ * Returns: None
+ */
+static void watch( struct link *link ) {
+	struct epoll_event ev; /* event registration */
+	struct end *end; /* side of the link */
+	int i; /* side index */
+
+	if( link->up.done && link->down.done ) {
+		close_link( link );
+		return;
+	}
+	for( i = 0; i < 2; i++ ) {
+		end = &link->ends[i];
+		ev.events = 0;
+		if( !end->in->eof && ( end->in->queued < window ) && !( i && link->connecting ) ) {
+			ev.events |= EPOLLIN;
+		}
+		if( end->out->writing ) {
+			ev.events |= EPOLLOUT;
+		}
+		if( ev.events != end->events ) {
+			ev.data.ptr = end;
+			epoll_ctl( epfd, !ev.events ? EPOLL_CTL_DEL : end->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+			           end->fd, &ev );
+			end->events = ev.events;
+		}
+	}
+}
+
+
+/* This function handles an event on one side of a link: it finishes
+ *    connecting to the server, reads what has arrived, and writes what is
+ *    due and now has room.
+ * Parameters:
+ *    end    : the side
+ *    events : the events
+ * Returns: None
+ */
+static void handle_end( struct end *end, unsigned events ) {
+	struct link *link = end->link; /* the link */
+	int err = 0; /* connect result */
+	socklen_t len = sizeof( err ); /* length of result */
+
+	if( link->closed ) { /* closed by an earlier event */
+		return;
+	}
+	if( link->connecting && ( end == &link->ends[1] ) ) {
+		getsockopt( end->fd, SOL_SOCKET, SO_ERROR, &err, &len );
+		if( err ) {
+			close_link( link );
+			return;
+		}
+		link->connecting = 0;
+	}
+
+	if( ( events & ( EPOLLIN | EPOLLHUP | EPOLLERR ) ) &&
+	    ( pull( end->in ) || deliver( end->in ) ) ) {
+		close_link( link );
+		return;
+	}
+	if( events & ( EPOLLOUT | EPOLLHUP | EPOLLERR ) ) {
+		end->out->writing = 0;
+		if( deliver( end->out ) ) {
+			close_link( link );
+			return;
+		}
+	}
+	watch( link );
+}
+
+
+/* This function sets up a direction of a link.
+ * Parameters:
+ *    dir  : the direction
+ *    link : the link
+ *    from : socket read from
+ *    to   : socket written to
+ *    rate : bandwidth, in bytes per second, 0 for none
+ * Returns: None
+ */
+static void init_dir( struct dir *dir, struct link *link, int from, int to, size_t rate ) {
+	memset( dir, 0, sizeof( struct dir ) );
+	dir->from = from;
+	dir->to = to;
+	dir->rate = rate;
+	dir->link = link;
+}
+
+
+/* This function accepts a client and starts connecting to the server on
+ *    its behalf.  This function will abort the program if memory cannot be
+ *    allocated.
+ * Parameters:
+ *    fd : the client's socket
+ * Returns: None
+ */
+static void open_link( int fd ) {
+	struct link *link; /* new link */
+	struct epoll_event ev; /* event registration */
+	int buf = window; /* socket receive buffer */
+	int sd; /* socket to server */
+	int i; /* side index */
+
+	sd = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0 );
+	if( sd < 0 ) {
+		perror( "Error while creating socket" );
+		close( fd );
+		return;
+	}
+	setsockopt( fd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof( int ) ); /* little hidden */
+	setsockopt( sd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof( int ) ); /* in the kernel */
+	if( connect( sd, (struct sockaddr *)&server, sizeof( server ) ) &&
+	    ( errno != EINPROGRESS ) ) {
+		perror( "Error while connecting to server" );
+		close( sd );
+		close( fd );
+		return;
+	}
+
+	link = calloc( 1, sizeof( struct link ) );
+	if( !link ) {
+		perror( "Error while allocating memory" );
+		abort();
+	}
+	init_dir( &link->up, link, fd, sd, up_rate );
+	init_dir( &link->down, link, sd, fd, down_rate );
+	link->up.writing = 1; /* until connected */
+	link->connecting = 1;
+	link->ends[0] = (struct end){ fd, EPOLLIN, &link->up, &link->down, link };
+	link->ends[1] = (struct end){ sd, EPOLLOUT, &link->down, &link->up, link };
+
+	for( i = 0; i < 2; i++ ) {
+		ev.events = link->ends[i].events;
+		ev.data.ptr = &link->ends[i];
+		if( epoll_ctl( epfd, EPOLL_CTL_ADD, link->ends[i].fd, &ev ) ) {
+			perror( "Error while adding connection to epoll" );
+			close_link( link );
+			return;
+		}
+	}
+}
+
+
+/* This function creates the socket the proxy listens on.  This function
+ *    will abort the program if the socket cannot be created.
+ * Parameters:
+ *    port : the port to listen on
+ * Returns: The socket.
+ */
+static int listen_on( int port ) {
+	struct sockaddr_in self; /* address listened on */
+	int yes = 1; /* option value */
+	int sd; /* the socket */
+
+	sd = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0 );
+	if( sd < 0 ) {
+		perror( "Error while creating socket" );
+		abort();
+	}
+	setsockopt( sd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof( int ) );
+	memset( &self, 0, sizeof( self ) );
+	self.sin_family = AF_INET;
+	self.sin_addr.s_addr = htonl( INADDR_ANY );
+	self.sin_port = htons( port );
+	if( bind( sd, (struct sockaddr *)&self, sizeof( self ) ) || listen( sd, 1024 ) ) {
+		perror( "Error while listening" );
+		abort();
+	}
+	return sd;
+}
+
+
+/* This function is where the program starts running.  It reads the
+ *    options, and relays connections until it is killed.
+ * Parameters:
+ *    argc : number of command line parameters (including program name
+ *    argv : array of pointers to command line parameters
+ * Returns: an integer status code, 0 for success, something else for error.
+ */
+int main( int argc, char **argv ) {
+	struct epoll_event events[MAX_EVENTS]; /* ready sockets */
+	struct epoll_event ev; /* event registration */
+	struct rlimit lim; /* open file limit */
+	struct link **link; /* closed link, to free */
+	struct link *gone; /* closed link freed */
+	struct dir *dir; /* direction due */
+	char *host = "127.0.0.1"; /* server's address */
+	int port = 8080; /* server's port */
+	double ms; /* delay or jitter, in ms */
+	long long now; /* current time */
+	int lsd; /* listening socket */
+	int wait; /* ms to wait */
+	int opt; /* command line option */
+	int fd; /* client's socket */
+	int n; /* # of events */
+	int i; /* event index */
+
+	while( ( opt = getopt( argc, argv, "h:p:b:u:d:j:L:w:" ) ) != -1 ) {
+		if( opt == 'h' ) {
+			host = optarg; /* server's address */
+		} else if( ( opt == 'p' ) && ( sscanf( optarg, "%d", &port ) == 1 ) ) {
+			continue; /* server port */
+		} else if( ( opt == 'b' ) && !config_size( optarg, &down_rate ) ) {
+			continue; /* server to client bandwidth */
+		} else if( ( opt == 'u' ) && !config_size( optarg, &up_rate ) ) {
+			continue; /* client to server bandwidth */
+		} else if( ( opt == 'd' ) && ( sscanf( optarg, "%lf", &ms ) == 1 ) ) {
+			delay = (long long)( ms * 1e6 ); /* one-way delay */
+		} else if( ( opt == 'j' ) && ( sscanf( optarg, "%lf", &ms ) == 1 ) ) {
+			jitter = (long long)( ms * 1e6 ); /* most extra delay */
+		} else if( ( opt == 'L' ) && ( sscanf( optarg, "%lf", &loss ) == 1 ) ) {
+			loss /= 100; /* percent lost */
+		} else if( ( opt == 'w' ) && !config_size( optarg, &window ) && window ) {
+			continue; /* most queued */
+		} else {
+			break;
+		}
+	}
+	memset( &server, 0, sizeof( server ) );
+	server.sin_family = AF_INET;
+	server.sin_port = htons( port );
+	if( ( opt != -1 ) || ( optind != argc - 1 ) || !inet_aton( host, &server.sin_addr ) ) {
+		printf( "usage: sws-proxy [-h host] [-p port] [-b bandwidth] [-u bandwidth]\n"
+		        "                 [-d delay_ms] [-j jitter_ms] [-L loss_pct] [-w window]\n"
+		        "                 listen_port\n" );
+		return 1;
+	}
+
+	getrlimit( RLIMIT_NOFILE, &lim ); /* two descriptors per client */
+	lim.rlim_cur = lim.rlim_max;
+	setrlimit( RLIMIT_NOFILE, &lim );
+	signal( SIGPIPE, SIG_IGN );
+	srand48( 1 ); /* same jitter and losses every run */
+
+	epfd = epoll_create1( 0 );
+	if( epfd < 0 ) {
+		perror( "Error while creating epoll instance" );
+		return 1;
+	}
+	lsd = listen_on( atoi( argv[optind] ) );
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL; /* the listening socket */
+	if( epoll_ctl( epfd, EPOLL_CTL_ADD, lsd, &ev ) ) {
+		perror( "Error while adding socket to epoll" );
+		return 1;
+	}
+
+	for( ;; ) {
+		now = util_now_ns();
+		wait = IDLE_MS;
+		if( num_timers && ( timers[0].due - now < wait * 1000000LL ) ) {
+			wait = timers[0].due > now ? ( timers[0].due - now ) / 1000000 + 1 : 0;
+		}
+		n = epoll_wait( epfd, events, MAX_EVENTS, wait );
+		for( i = 0; i < n; i++ ) {
+			if( !events[i].data.ptr ) {
+				while( ( fd = accept4( lsd, NULL, NULL, SOCK_NONBLOCK ) ) >= 0 ) {
+					open_link( fd );
+				}
+			} else {
+				handle_end( events[i].data.ptr, events[i].events );
+			}
+		}
+
+		now = util_now_ns();
+		while( num_timers && ( timers[0].due <= now ) ) { /* data due */
+			dir = timer_pop();
+			if( !dir->link->closed ) {
+				if( deliver( dir ) ) {
+					close_link( dir->link );
+				} else {
+					watch( dir->link );
+				}
+			}
+		}
+
+		for( link = &dead; *link; ) { /* free those no timer refers to */
+			if( ( *link )->timers ) {
+				link = &( *link )->next;
+			} else {
+				gone = *link;
+				*link = gone->next;
+				free( gone );
+			}
+		}
+	}
+	return 0;
+}
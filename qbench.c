@@ -0,0 +1,189 @@
+/*
+ * File: qbench.c
+ * Author: agent
+ * Purpose: This file contains a microbenchmark of the queue module.  It
+ *          measures what it costs to hand a file descriptor from producer
+ *          threads to consumer threads through the lock-free queue, and,
+ *          for comparison, through a queue guarded by a mutex.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "queue.h"
+
+#define ITEMS 2000000 /* default # of handoffs per run */
+#define SLOTS 4096 /* queue size */
+
+/* A plain ring guarded by a mutex, the baseline being compared against. */
+struct locked {
+	pthread_mutex_t lock; /* guards everything below */
+	void *items[SLOTS]; /* the ring */
+	size_t head; /* next position to push */
+	size_t tail; /* next position to pop */
+};
+
+static struct queue *ring; /* lock-free queue under test */
+static struct locked locked; /* mutex queue under test */
+static int use_lock; /* which queue this run uses */
+static long per_producer; /* items each producer pushes */
+static atomic_long remaining; /* items still to be popped */
+
+
+/* This function pushes an item on the queue under test.
+ * Parameters:
+ *    item : the item
+ * Returns: 0 on success, or -1 if the queue is full.
+ */
+static int bench_push( void *item ) {
+	int rc = -1; /* result */
+
+	if( !use_lock ) {
+		return queue_push( ring, item, 0 );
+	}
+
+	pthread_mutex_lock( &locked.lock );
+	if( locked.head - locked.tail < SLOTS ) { /* room for it */
+		locked.items[locked.head++ % SLOTS] = item;
+		rc = 0;
+	}
+	pthread_mutex_unlock( &locked.lock );
+	return rc;
+}
+
+
+/* This function pops an item from the queue under test.
+ * Parameters: None
+ * Returns: The item, or NULL if the queue is empty.
+ */
+static void *bench_pop() {
+	void *item = NULL; /* result */
+
+	if( !use_lock ) {
+		return queue_pop( ring, NULL );
+	}
+
+	pthread_mutex_lock( &locked.lock );
+	if( locked.head != locked.tail ) { /* something there */
+		item = locked.items[locked.tail++ % SLOTS];
+	}
+	pthread_mutex_unlock( &locked.lock );
+	return item;
+}
+
+
+/* This function is where each producer thread starts running.  It pushes
+ *    its share of fake file descriptors, retrying whenever the queue is full.
+ * Parameters:
+ *    arg : not used
+ * Returns: NULL
+ */
+static void *producer( void *arg ) {
+	intptr_t fd; /* fake descriptor */
+
+	(void)arg;
+	for( fd = 1; fd <= per_producer; fd++ ) {
+		while( bench_push( (void *)fd ) ); /* spin while full */
+	}
+	return NULL;
+}
+
+
+/* This function is where each consumer thread starts running.  It pops
+ *    descriptors until every one pushed has been popped.
+ * Parameters:
+ *    arg : not used
+ * Returns: NULL
+ */
+static void *consumer( void *arg ) {
+	(void)arg;
+	while( atomic_load_explicit( &remaining, memory_order_relaxed ) > 0 ) {
+		if( bench_pop() ) {
+			atomic_fetch_sub_explicit( &remaining, 1, memory_order_relaxed );
+		}
+	}
+	return NULL;
+}
+
+
+/* This function runs one benchmark: some producers handing a number of
+ *    descriptors to some consumers.
+ * Parameters:
+ *    producers : # of producer threads
+ *    consumers : # of consumer threads
+ *    items     : total # of descriptors to hand off
+ * Returns: The cost of one handoff, in nanoseconds.
+ */
+static double run( int producers, int consumers, long items ) {
+	pthread_t tids[producers + consumers]; /* all threads */
+	struct timespec start, end; /* run time */
+	int i; /* thread index */
+
+	per_producer = items / producers;
+	atomic_store( &remaining, per_producer * producers );
+
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	for( i = 0; i < consumers; i++ ) {
+		pthread_create( &tids[i], NULL, consumer, NULL );
+	}
+	for( i = 0; i < producers; i++ ) {
+		pthread_create( &tids[consumers + i], NULL, producer, NULL );
+	}
+	for( i = 0; i < producers + consumers; i++ ) {
+		pthread_join( tids[i], NULL );
+	}
+	clock_gettime( CLOCK_MONOTONIC, &end );
+
+	return ( ( end.tv_sec - start.tv_sec ) * 1e9 + ( end.tv_nsec - start.tv_nsec ) )
+	       / ( per_producer * producers );
+}
+
+
+/* This function is where the program starts running.
+ *    It runs every mix of 1, 2, 4, ... producers and consumers up to the
+ *    limits given, against both queues, and prints a table of the cost of
+ *    one handoff in each case.
+ * Parameters:
+ *    argc : number of command line parameters (including program name
+ *    argv : array of pointers to command line parameters
+ * Returns: an integer status code, 0 for success, something else for error.
+ */
+int main( int argc, char **argv ) {
+	long items = ITEMS; /* handoffs per run */
+	int max_prod = 4; /* most producers */
+	int max_cons = 4; /* most consumers */
+	int prod, cons; /* current mix */
+	int opt; /* command line option */
+	double lockfree; /* ns per handoff */
+
+	while( ( opt = getopt( argc, argv, "n:p:c:" ) ) != -1 ) {
+		if( ( opt == 'n' ) && ( sscanf( optarg, "%ld", &items ) == 1 ) ) {
+			continue;
+		} else if( ( opt == 'p' ) && ( sscanf( optarg, "%d", &max_prod ) == 1 ) ) {
+			continue;
+		} else if( ( opt == 'c' ) && ( sscanf( optarg, "%d", &max_cons ) == 1 ) ) {
+			continue;
+		}
+		printf( "usage: qbench [-n items] [-p producers] [-c consumers]\n" );
+		return 0;
+	}
+
+	ring = queue_new( SLOTS );
+	pthread_mutex_init( &locked.lock, NULL );
+
+	printf( "%9s %9s %14s %14s\n", "producers", "consumers", "lockfree ns/fd", "mutex ns/fd" );
+	for( prod = 1; prod <= max_prod; prod *= 2 ) {
+		for( cons = 1; cons <= max_cons; cons *= 2 ) {
+			use_lock = 0;
+			lockfree = run( prod, cons, items );
+			use_lock = 1;
+			printf( "%9d %9d %14.1f %14.1f\n", prod, cons, lockfree, run( prod, cons, items ) );
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * File: queue.c
+ * Author: agent
+ * Purpose: This file contains the queue module, a bounded lock-free queue
+ *         that any number of threads may add to and take from at once.
+ *         Please see queue.h for documentation on how to use this module.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "queue.h"
+
+
+/* This function creates an empty queue.  This function will abort the
+ *    program if memory cannot be allocated.
+ * Parameters:
+ *    size : the number of slots, rounded up to a power of two
+ * Returns: A pointer to the new queue.
+ */
+extern struct queue *queue_new( size_t size ) {
+	struct queue *q; /* new queue */
+	size_t slots = 2; /* # of slots */
+	size_t i; /* slot index */
+
+	while( slots < size ) { /* round up */
+		slots <<= 1;
+	}
+
+	q = aligned_alloc( CACHE_LINE, sizeof( struct queue ) );
+	if( q ) {
+		q->slots = aligned_alloc( CACHE_LINE, slots * sizeof( struct queue_slot ) );
+	}
+	if( !q || !q->slots ) { /* error check */
+		perror( "Error while allocating memory" );
+		abort();
+	}
+
+	q->mask = slots - 1;
+	for( i = 0; i < slots; i++ ) { /* slot i is ready for push i */
+		atomic_init( &q->slots[i].seq, i );
+		q->slots[i].item = NULL;
+	}
+	atomic_init( &q->head, 0 );
+	atomic_init( &q->tail, 0 );
+	return q;
+}
+
+
+/* This function destroys a queue.  Any items still in it are dropped.
+ * Parameters:
+ *    q : the queue
+ * Returns: None
+ */
+extern void queue_free( struct queue *q ) {
+	free( q->slots );
+	free( q );
+}
+
+
+/* This function adds an item to the back of the queue.
+ * Parameters:
+ *    q     : the queue
+ *    item  : the item to add, must not be NULL
+ *    stamp : stamp to keep with it
+ * Returns: 0 on success, or -1 if the queue is full.
+ */
+extern int queue_push( struct queue *q, void *item, long long stamp ) {
+	struct queue_slot *slot; /* slot to fill */
+	size_t pos; /* position to push */
+	intptr_t diff; /* how far the slot lags */
+
+	pos = atomic_load_explicit( &q->head, memory_order_relaxed );
+	for( ;; ) {
+		slot = &q->slots[pos & q->mask];
+		diff = (intptr_t)atomic_load_explicit( &slot->seq, memory_order_acquire ) - (intptr_t)pos;
+		if( diff == 0 ) { /* slot is free, claim it */
+			if( atomic_compare_exchange_weak_explicit( &q->head, &pos, pos + 1,
+			                                           memory_order_relaxed,
+			                                           memory_order_relaxed ) ) {
+				break;
+			}
+		} else if( diff < 0 ) { /* slot still full, queue is full */
+			return -1;
+		} else { /* another pusher got it */
+			pos = atomic_load_explicit( &q->head, memory_order_relaxed );
+		}
+	}
+
+	slot->item = item; /* publish item */
+	slot->stamp = stamp;
+	atomic_store_explicit( &slot->seq, pos + 1, memory_order_release );
+	return 0;
+}
+
+
+/* This function takes the item at the front of the queue.
+ * Parameters:
+ *    q     : the queue
+ *    stamp : set to the item's stamp, if not NULL
+ * Returns: The item, or NULL if the queue is empty.
+ */
+extern void *queue_pop( struct queue *q, long long *stamp ) {
+	struct queue_slot *slot; /* slot to empty */
+	size_t pos; /* position to pop */
+	intptr_t diff; /* how far the slot lags */
+	void *item; /* item to return */
+
+	pos = atomic_load_explicit( &q->tail, memory_order_relaxed );
+	for( ;; ) {
+		slot = &q->slots[pos & q->mask];
+		diff = (intptr_t)atomic_load_explicit( &slot->seq, memory_order_acquire ) - (intptr_t)( pos + 1 );
+		if( diff == 0 ) { /* slot is full, claim it */
+			if( atomic_compare_exchange_weak_explicit( &q->tail, &pos, pos + 1,
+			                                           memory_order_relaxed,
+			                                           memory_order_relaxed ) ) {
+				break;
+			}
+		} else if( diff < 0 ) { /* slot not filled, queue is empty */
+			return NULL;
+		} else { /* another popper got it */
+			pos = atomic_load_explicit( &q->tail, memory_order_relaxed );
+		}
+	}
+
+	item = slot->item; /* free slot for next lap */
+	if( stamp ) {
+		*stamp = slot->stamp;
+	}
+	atomic_store_explicit( &slot->seq, pos + q->mask + 1, memory_order_release );
+	return item;
+}
+
+
+/* This function reports roughly how many items are in the queue.  The count
+ *    may be out of date by the time it is returned.
+ * Parameters:
+ *    q : the queue
+ * Returns: The number of items in the queue.
+ */
+extern size_t queue_depth( struct queue *q ) {
+	size_t tail = atomic_load_explicit( &q->tail, memory_order_relaxed ); /* popped */
+	size_t head = atomic_load_explicit( &q->head, memory_order_relaxed ); /* pushed */
+
+	return head > tail ? head - tail : 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * File: queue.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          queue module, a bounded lock-free queue that any number of
+ *          threads may add to and take from at the same time.
+ */
+
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#define CACHE_LINE 64 /* bytes in a cache line */
+
+/*
+ * This module has five functions:
+ *   queue_new()   : create a queue
+ *   queue_free()  : destroy a queue
+ *   queue_push()  : add an item to the back of the queue
+ *   queue_pop()   : take an item from the front of the queue
+ *   queue_depth() : roughly how many items are in the queue
+ *
+ * The queue is a ring of slots, each with its own sequence number, after
+ * Dmitry Vyukov's bounded MPMC queue.  A slot's sequence number tells a
+ * thread whether the slot is ready to be written (it equals the position
+ * being pushed) or read (it equals the position being popped plus one), so
+ * threads only contend on the position counters, and only with threads
+ * doing the same operation.  The two counters and every slot sit on cache
+ * lines of their own so that pushers, poppers and neighbouring slots do
+ * not bounce each other's lines.
+ *
+ * Neither push nor pop ever blocks: queue_push() fails if the queue is full
+ * and queue_pop() fails if it is empty.  Waiting for room or for items is
+ * up to the caller.
+ *
+ * Each item carries a stamp, given when it is pushed and handed back when
+ * it is popped, e.g., the time it was pushed, so that the caller can tell
+ * how long it waited without keeping anything in the item itself.
+ */
+
+struct queue_slot {
+	_Alignas( CACHE_LINE ) atomic_size_t seq; /* slot's sequence number */
+	void *item; /* item stored in slot */
+	long long stamp; /* its stamp */
+};
+
+struct queue {
+	_Alignas( CACHE_LINE ) atomic_size_t head; /* next position to push */
+	_Alignas( CACHE_LINE ) atomic_size_t tail; /* next position to pop */
+	_Alignas( CACHE_LINE ) size_t mask; /* # of slots - 1 */
+	struct queue_slot *slots; /* the ring itself */
+};
+
+
+/* This function creates an empty queue.  This function will abort the
+ *    program if memory cannot be allocated.
+ * Parameters:
+ *    size : the number of slots, rounded up to a power of two
+ * Returns: A pointer to the new queue.
+ */
+extern struct queue *queue_new( size_t size );
+
+
+/* This function destroys a queue.  Any items still in it are dropped.
+ * Parameters:
+ *    q : the queue
+ * Returns: None
+ */
+extern void queue_free( struct queue *q );
+
+
+/* This function adds an item to the back of the queue.
+ * Parameters:
+ *    q     : the queue
+ *    item  : the item to add, must not be NULL
+ *    stamp : stamp to keep with it
+ * Returns: 0 on success, or -1 if the queue is full.
+ */
+extern int queue_push( struct queue *q, void *item, long long stamp );
+
+
+/* This function takes the item at the front of the queue.
+ * Parameters:
+ *    q     : the queue
+ *    stamp : set to the item's stamp, if not NULL
+ * Returns: The item, or NULL if the queue is empty.
+ */
+extern void *queue_pop( struct queue *q, long long *stamp );
+
+
+/* This function reports roughly how many items are in the queue.  The count
+ *    may be out of date by the time it is returned.
+ * Parameters:
+ *    q : the queue
+ * Returns: The number of items in the queue.
+ */
+extern size_t queue_depth( struct queue *q );
+
+#endif
@@ -0,0 +1,225 @@
+/*
+ * File: rate.c
+ * Author: agent
+ * Purpose: This file contains the rate module, which limits how fast each
+ *         client may make requests and receive data.
+ *         Please see rate.h for documentation on how to use this module.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "bucket.h"
+#include "config.h"
+#include "rate.h"
+#include "util.h"
+
+#define MASK ( RATE_SLOTS - 1 ) /* slot index mask */
+
+/* A client and its token buckets. */
+struct client {
+	unsigned addr;          /* IP address */
+	int used;               /* slot holds a client? */
+	int ref;                /* looked up since the clock hand last passed? */
+	struct bucket requests; /* requests that may be made */
+	struct bucket bytes;    /* bytes that may be sent */
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; /* guards all below */
+static struct client slots[RATE_SLOTS]; /* clients, by hash */
+static size_t hand; /* clock hand */
+static size_t clients; /* counters for rate_stats() */
+static size_t admitted;
+static size_t limited;
+static size_t paced;
+static size_t evictions;
+
+
+/* This function evicts the client the clock hand comes to first that has
+ *    not been looked up since the hand last passed it.  The slots after it
+ *    are shifted back, so that linear probing still finds them.  The lock
+ *    must be held.
+ * Parameters: None
+ * Returns: None
+ */
+static void evict() {
+	size_t i, j; /* slot emptied, slot checked */
+	size_t home; /* slot a client hashes to */
+
+	for( ;; hand = ( hand + 1 ) & MASK ) {
+		if( slots[hand].used && slots[hand].ref ) { /* second chance */
+			slots[hand].ref = 0;
+		} else if( slots[hand].used ) {
+			break;
+		}
+	}
+
+	i = hand;
+	slots[i].used = 0;
+	for( j = ( i + 1 ) & MASK; slots[j].used; j = ( j + 1 ) & MASK ) {
+		home = util_hash( UTIL_HASH_BASIS, &slots[j].addr, sizeof( slots[j].addr ) ) & MASK;
+		if( ( ( j - home ) & MASK ) >= ( ( j - i ) & MASK ) ) { /* can move back */
+			slots[i] = slots[j];
+			slots[j].used = 0;
+			i = j;
+		}
+	}
+	clients--;
+	evictions++;
+}
+
+
+/* This function finds a client, adding it with full buckets if it is not
+ *    tracked, and refills its request bucket.  The lock must be held.
+ * Parameters:
+ *    addr : the client's address
+ *    set  : the current settings
+ *    now  : the time, in ns
+ * Returns: The client.
+ */
+static struct client *find_client( unsigned addr, const struct settings *set, long long now ) {
+	size_t home = util_hash( UTIL_HASH_BASIS, &addr, sizeof( addr ) ) & MASK; /* its slot */
+	struct client *c; /* client found */
+	size_t j; /* slot */
+
+	for( j = home; slots[j].used; j = ( j + 1 ) & MASK ) {
+		if( slots[j].addr == addr ) {
+			break;
+		}
+	}
+
+	c = &slots[j];
+	if( !c->used ) { /* new client */
+		if( clients >= RATE_CLIENTS ) { /* make room, then find a free slot */
+			evict();
+			for( j = home; slots[j].used; j = ( j + 1 ) & MASK );
+			c = &slots[j];
+		}
+		c->addr = addr;
+		c->used = 1;
+		bucket_fill( &c->requests, set->request_burst, now );
+		bucket_fill( &c->bytes, set->bandwidth, now );
+		clients++;
+	}
+
+	bucket_refill( &c->requests, set->request_rate, set->request_burst, now );
+	c->ref = 1;
+	return c;
+}
+
+
+/* This function sets the limits, from a rate directive.
+ * Parameters:
+ *    set  : the settings being built
+ *    argc : # of words of the directive
+ *    argv : words of the directive, starting with "rate"
+ * Returns: 0 on success, or -1 if the directive is malformed.
+ */
+extern int rate_config( struct settings *set, int argc, char **argv ) {
+	int i; /* word index */
+
+	set->request_burst = -1;
+	for( i = 1; i < argc; i++ ) {
+		if( !strncmp( argv[i], "requests=", 9 ) &&
+		    ( sscanf( argv[i] + 9, "%lf", &set->request_rate ) == 1 ) &&
+		    ( set->request_rate >= 0 ) ) {
+			continue;
+		} else if( !strncmp( argv[i], "burst=", 6 ) &&
+		           ( sscanf( argv[i] + 6, "%lf", &set->request_burst ) == 1 ) &&
+		           ( set->request_burst >= 1 ) ) {
+			continue;
+		} else if( !strncmp( argv[i], "bandwidth=", 10 ) &&
+		           !config_size( argv[i] + 10, &set->bandwidth ) ) {
+			continue;
+		}
+		return -1;
+	}
+	if( set->request_burst < 0 ) { /* default burst */
+		set->request_burst = set->request_rate < 0.5 ? 1 : 2 * set->request_rate;
+	}
+	return 0;
+}
+
+
+/* This function checks whether a client may make another request, taking
+ *    a token from its request bucket if so.
+ * Parameters:
+ *    fd     : the client connection
+ *    client : set to the client's address, for rate_pace()
+ * Returns: 0 if the request may go ahead, or -1 if the client is over its
+ *          request rate.
+ */
+extern int rate_admit( int fd, unsigned *client ) {
+	const struct settings *set = settings_get(); /* current limits */
+	struct sockaddr_in addr; /* client's address */
+	socklen_t len = sizeof( addr ); /* length of address */
+	struct client *c; /* client's buckets */
+	int rc = 0; /* result */
+
+	*client = 0;
+	if( ( !set->request_rate && !set->bandwidth ) ||
+	    getpeername( fd, (struct sockaddr *)&addr, &len ) || ( addr.sin_family != AF_INET ) ) {
+		return 0; /* no limits, or no address to limit */
+	}
+	*client = addr.sin_addr.s_addr;
+
+	pthread_mutex_lock( &lock );
+	c = find_client( *client, set, util_now_ns() );
+	if( set->request_rate && ( c->requests.tokens < 1 ) ) { /* over the limit */
+		limited++;
+		rc = -1;
+	} else {
+		c->requests.tokens -= 1;
+		admitted++;
+	}
+	pthread_mutex_unlock( &lock );
+	return rc;
+}
+
+
+/* This function gets how many bytes may be sent to a client now, taking
+ *    them from its bandwidth bucket.
+ * Parameters:
+ *    client : the client's address, from rate_admit()
+ *    want   : the bytes the caller would like to send
+ *    wait   : if none may be sent, set to the ns until some may
+ * Returns: The bytes that may be sent, at most want, or 0 if the caller is
+ *          to try again in *wait ns.
+ */
+extern size_t rate_pace( unsigned client, size_t want, long long *wait ) {
+	const struct settings *set = settings_get(); /* current limits */
+	long long now = util_now_ns(); /* time of send */
+	struct client *c; /* client's buckets */
+
+	if( !set->bandwidth || !client || !want ) { /* not paced */
+		return want;
+	}
+
+	pthread_mutex_lock( &lock );
+	c = find_client( client, set, now );
+	want = bucket_grant( &c->bytes, set->bandwidth, want, now, wait );
+	if( !want ) {
+		paced++;
+	}
+	pthread_mutex_unlock( &lock );
+	return want;
+}
+
+
+/* This function reports how many clients are tracked and limited.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void rate_stats( struct rate_stats *stats ) {
+	pthread_mutex_lock( &lock );
+	stats->clients = clients;
+	stats->admitted = admitted;
+	stats->limited = limited;
+	stats->paced = paced;
+	stats->evictions = evictions;
+	pthread_mutex_unlock( &lock );
+}
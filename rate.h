@@ -0,0 +1,102 @@
+/*
+ * File: rate.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          rate module, which limits how fast each client may make requests
+ *          and receive data.
+ */
+
+#ifndef RATE_H
+#define RATE_H
+
+#include <stddef.h>
+
+#include "settings.h"
+
+#define RATE_SLOTS 8192 /* size of client table, a power of two */
+#define RATE_CLIENTS ( RATE_SLOTS / 2 ) /* most clients tracked at once */
+
+/*
+ * This module has four functions:
+ *   rate_config() : set the limits, from a rate directive
+ *   rate_admit()  : check whether a client may make another request
+ *   rate_pace()   : get how many bytes may be sent to a client now
+ *   rate_stats()  : report how many clients are tracked and limited
+ *
+ * Each client, identified by its IP address, has two token buckets: one
+ * of requests, refilled at a set rate up to a burst, and one of bytes,
+ * refilled at a set bandwidth up to one second's worth.  A request that
+ * finds its client's request bucket empty is refused with a 429 before any
+ * parsing or file work is done.  A client that has used up its bandwidth
+ * is paced instead: rate_pace() grants it no bytes and says how long until
+ * it would, and the request is put aside, off the run queues, until then.
+ * Both are token buckets of the bucket module (see bucket.h).
+ *
+ * Limits are set from the configuration file with a directive of the form
+ *
+ *   rate [requests=n] [burst=n] [bandwidth=size]
+ *
+ * where requests is per second, burst defaults to twice requests, and
+ * bandwidth is bytes per second.  A limit of 0, the default, is off.  The
+ * limits are part of the settings (see settings.h), so a reload of the
+ * configuration file changes them; clients keep their buckets, which
+ * refill at the new rates from then on.
+ *
+ * The buckets live in a fixed table of RATE_SLOTS slots with open
+ * addressing and linear probing, kept at most half full.  When it holds
+ * RATE_CLIENTS clients, a new client evicts an old one chosen by a clock
+ * hand: each lookup marks a client as used, and the hand clears the marks
+ * it passes until it finds a client that has not been used since its last
+ * pass.  All functions are thread safe.
+ */
+
+struct rate_stats {
+	size_t clients;   /* # of clients tracked */
+	size_t admitted;  /* # of requests admitted */
+	size_t limited;   /* # of requests refused with a 429 */
+	size_t paced;     /* # of sends held back to pace a client */
+	size_t evictions; /* # of clients evicted to make room */
+};
+
+
+/* This function sets the limits, from a rate directive.
+ * Parameters:
+ *    set  : the settings being built
+ *    argc : # of words of the directive
+ *    argv : words of the directive, starting with "rate"
+ * Returns: 0 on success, or -1 if the directive is malformed.
+ */
+extern int rate_config( struct settings *set, int argc, char **argv );
+
+
+/* This function checks whether a client may make another request, taking
+ *    a token from its request bucket if so.
+ * Parameters:
+ *    fd     : the client connection
+ *    client : set to the client's address, for rate_pace()
+ * Returns: 0 if the request may go ahead, or -1 if the client is over its
+ *          request rate.
+ */
+extern int rate_admit( int fd, unsigned *client );
+
+
+/* This function gets how many bytes may be sent to a client now, taking
+ *    them from its bandwidth bucket.
+ * Parameters:
+ *    client : the client's address, from rate_admit()
+ *    want   : the bytes the caller would like to send
+ *    wait   : if none may be sent, set to the ns until some may
+ * Returns: The bytes that may be sent, at most want, or 0 if the caller is
+ *          to try again in *wait ns.
+ */
+extern size_t rate_pace( unsigned client, size_t want, long long *wait );
+
+
+/* This function reports how many clients are tracked and limited.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void rate_stats( struct rate_stats *stats );
+
+#endif
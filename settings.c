@@ -0,0 +1,213 @@
+/*
+ * File: settings.c
+ * Author: agent
+ * Purpose: This file contains the settings module, which holds the
+ *         settings that can be changed while the server runs.
+ *         Please see settings.h for documentation on how to use this module.
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "settings.h"
+
+/* A thread that reads settings.  Each slot has a cache line of its own,
+ * so entering and exiting touch no line another thread writes. */
+struct reader {
+	_Alignas( 64 ) atomic_ullong epoch; /* epoch entered in, 0 if outside */
+};
+
+static struct settings defaults; /* current until a set is published */
+static struct settings *_Atomic current = &defaults; /* current settings */
+static atomic_ullong epoch = 1; /* advanced each time a set is replaced */
+static struct reader readers[SETTINGS_READERS]; /* a slot per thread */
+static atomic_int num_readers; /* # of slots claimed */
+static _Thread_local struct reader *me; /* calling thread's slot */
+static struct settings *retired; /* replaced sets waiting to be freed */
+static unsigned long long generation; /* generation of the last set published */
+static size_t pending; /* counters for settings_stats(), all event loop only */
+static size_t freed;
+
+
+/* This function starts a new set of settings, with no rules and no limits,
+ *    for directives to be applied to.  This function will abort the
+ *    program if memory cannot be allocated.
+ * Parameters: None
+ * Returns: The new set.
+ */
+extern struct settings *settings_new() {
+	struct settings *set = calloc( 1, sizeof( struct settings ) ); /* new set */
+
+	if( !set ) { /* error check */
+		perror( "Error while allocating memory" );
+		abort();
+	}
+	return set;
+}
+
+
+/* This function adds a rule to the end of a list of a new set.
+ * Parameters:
+ *    rules   : the list, e.g., &set->priority
+ *    count   : its length, e.g., &set->num_priority
+ *    pattern : the rule's pattern, which is copied
+ *    value   : what paths that match get
+ * Returns: 0 on success, or -1 if memory cannot be allocated.
+ */
+extern int settings_add_rule( struct settings_rule **rules, size_t *count, const char *pattern,
+                              size_t value ) {
+	struct settings_rule *more; /* grown list */
+
+	more = realloc( *rules, ( *count + 1 ) * sizeof( struct settings_rule ) );
+	if( !more ) {
+		return -1;
+	}
+	*rules = more;
+	more[*count].pattern = strdup( pattern );
+	more[*count].value = value;
+	return more[( *count )++].pattern ? 0 : -1;
+}
+
+
+/* This function frees a list of rules.
+ * Parameters:
+ *    rules : the list
+ *    count : its length
+ * Returns: None
+ */
+static void free_rules( struct settings_rule *rules, size_t count ) {
+	size_t i; /* rule index */
+
+	for( i = 0; i < count; i++ ) {
+		free( rules[i].pattern );
+	}
+	free( rules );
+}
+
+
+/* This function frees a new set that will not be published, e.g., because
+ *    a directive was bad.
+ * Parameters:
+ *    set : the set
+ * Returns: None
+ */
+extern void settings_discard( struct settings *set ) {
+	free_rules( set->priority, set->num_priority );
+	free_rules( set->pace, set->num_pace );
+	free( set );
+}
+
+
+/* This function makes a new set the current one.  The set replaced is
+ *    freed once no thread can still be reading it.  It must be called by
+ *    the thread running the event loop.
+ * Parameters:
+ *    set : the set, which must not be changed after
+ * Returns: None
+ */
+extern void settings_publish( struct settings *set ) {
+	struct settings *old; /* set replaced */
+
+	set->generation = ++generation;
+	old = atomic_exchange( &current, set );
+	if( old != &defaults ) {
+		old->retired = atomic_fetch_add( &epoch, 1 ); /* readers from now on see set */
+		old->next = retired;
+		retired = old;
+		pending++;
+	}
+	settings_reclaim();
+}
+
+
+/* This function gets the current settings.  The caller must have entered,
+ *    unless it is the thread running the event loop, and must not use them
+ *    after it exits.
+ * Parameters: None
+ * Returns: The current settings.
+ */
+extern const struct settings *settings_get() {
+	return atomic_load( &current ); /* ordered after the entering store */
+}
+
+
+/* This function starts reading the current settings.  This function will
+ *    abort the program if more than SETTINGS_READERS threads read them.
+ * Parameters: None
+ * Returns: None
+ */
+extern void settings_enter() {
+	int i; /* slot claimed */
+
+	if( !me ) { /* thread's first time */
+		i = atomic_fetch_add( &num_readers, 1 );
+		if( i >= SETTINGS_READERS ) {
+			fprintf( stderr, "Error: more than %d threads read settings\n", SETTINGS_READERS );
+			abort();
+		}
+		me = &readers[i];
+	}
+	atomic_store( &me->epoch, atomic_load( &epoch ) ); /* before any settings_get() */
+}
+
+
+/* This function finishes reading the current settings.
+ * Parameters: None
+ * Returns: None
+ */
+extern void settings_exit() {
+	atomic_store_explicit( &me->epoch, 0, memory_order_release );
+}
+
+
+/* This function frees replaced sets that no thread can still be reading.
+ *    It must be called by the thread running the event loop, and is cheap
+ *    when there are none waiting.
+ * Parameters: None
+ * Returns: None
+ */
+extern void settings_reclaim() {
+	unsigned long long oldest = ~0ULL; /* oldest epoch a thread is in */
+	unsigned long long e; /* epoch of a thread */
+	struct settings **link; /* link to set checked */
+	struct settings *set; /* set checked */
+	int n = atomic_load( &num_readers ); /* # of slots claimed */
+	int i; /* slot index */
+
+	if( !retired ) {
+		return;
+	}
+	for( i = 0; ( i < n ) && ( i < SETTINGS_READERS ); i++ ) {
+		e = atomic_load( &readers[i].epoch );
+		if( e && ( e < oldest ) ) {
+			oldest = e;
+		}
+	}
+
+	for( link = &retired; *link; ) {
+		set = *link;
+		if( set->retired < oldest ) { /* everyone in entered after it went */
+			*link = set->next;
+			settings_discard( set );
+			pending--;
+			freed++;
+		} else {
+			link = &set->next;
+		}
+	}
+}
+
+
+/* This function reports how reloads are going.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void settings_stats( struct settings_stats *stats ) {
+	stats->generation = generation;
+	stats->pending = pending;
+	stats->freed = freed;
+	stats->readers = atomic_load( &num_readers );
+}
@@ -0,0 +1,161 @@
+/*
+ * File: settings.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          settings module, which holds the settings that can be changed
+ *          while the server runs, and replaces them all at once when the
+ *          configuration file is reloaded.
+ */
+
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stddef.h>
+
+#define SETTINGS_READERS 1024 /* most threads that read settings */
+
+/*
+ * This module has nine functions:
+ *   settings_new()      : start a new set of settings
+ *   settings_add_rule() : add a rule to a list of a new set
+ *   settings_discard()  : free a new set that will not be published
+ *   settings_publish()  : make a new set the current one
+ *   settings_get()      : get the current settings
+ *   settings_enter()    : start reading the current settings
+ *   settings_exit()     : finish reading them
+ *   settings_reclaim()  : free replaced sets no thread can still be reading
+ *   settings_stats()    : report how reloads are going
+ *
+ * The settings that requests look up as they are served, the priority
+ * rules (see priority.h), pace classes (see pace.h) and rate limits (see
+ * rate.h), are kept together in a set that never changes once published.
+ * A reload builds a whole new set from the configuration file, off to the
+ * side, with the modules' directive functions writing into it rather than
+ * into their own variables; only if every directive is good is the set
+ * published, with a single atomic pointer swap, so requests see either
+ * the old settings or the new, never a mix, and never wait for a reload.
+ *
+ * The old set is freed once no thread can still be using it, by epoch
+ * based reclamation.  A thread that reads settings brackets its use of
+ * them, e.g., a quantum, with settings_enter() and settings_exit(), which
+ * note, in a slot of the thread's own, the epoch it entered in; a replaced
+ * set is tagged with the epoch it was replaced in, and freed once every
+ * thread is either outside or entered since.  A thread that is parked, or
+ * between quanta, holds nothing up.  Entering and exiting are a store
+ * each, with no locks and no shared writes.
+ *
+ * One thread, the one running the event loop, builds, publishes and
+ * reclaims sets; since nothing is freed but by it, it may read the
+ * settings without entering.  Until a set is published, the current
+ * settings are the defaults: no rules and no limits.
+ */
+
+/* A pattern, e.g., /api or *.html, and what paths that match it get. */
+struct settings_rule {
+	char *pattern; /* prefix, or *.ext */
+	size_t value;  /* depends on the list */
+};
+
+/* A set of settings. */
+struct settings {
+	struct settings_rule *priority; /* priority rules, value is the class */
+	size_t num_priority;
+	struct settings_rule *pace;     /* pace classes, value is bytes per second */
+	size_t num_pace;
+	double request_rate;            /* requests per second per client, 0 if no limit */
+	double request_burst;           /* most requests in a burst */
+	size_t bandwidth;               /* bytes per second per client, 0 if no limit */
+	unsigned long long generation;  /* # of sets published before, and this one */
+	unsigned long long retired;     /* epoch replaced in, for this module */
+	struct settings *next;          /* next set waiting to be freed, for this module */
+};
+
+struct settings_stats {
+	unsigned long long generation; /* generation of the current settings */
+	size_t pending;                /* # of replaced sets not yet freed */
+	size_t freed;                  /* # of replaced sets freed */
+	int readers;                   /* # of threads that have read settings */
+};
+
+
+/* This function starts a new set of settings, with no rules and no limits,
+ *    for directives to be applied to.  This function will abort the
+ *    program if memory cannot be allocated.
+ * Parameters: None
+ * Returns: The new set.
+ */
+extern struct settings *settings_new();
+
+
+/* This function adds a rule to the end of a list of a new set.
+ * Parameters:
+ *    rules   : the list, e.g., &set->priority
+ *    count   : its length, e.g., &set->num_priority
+ *    pattern : the rule's pattern, which is copied
+ *    value   : what paths that match get
+ * Returns: 0 on success, or -1 if memory cannot be allocated.
+ */
+extern int settings_add_rule( struct settings_rule **rules, size_t *count, const char *pattern,
+                              size_t value );
+
+
+/* This function frees a new set that will not be published, e.g., because
+ *    a directive was bad.
+ * Parameters:
+ *    set : the set
+ * Returns: None
+ */
+extern void settings_discard( struct settings *set );
+
+
+/* This function makes a new set the current one.  The set replaced is
+ *    freed once no thread can still be reading it.  It must be called by
+ *    the thread running the event loop.
+ * Parameters:
+ *    set : the set, which must not be changed after
+ * Returns: None
+ */
+extern void settings_publish( struct settings *set );
+
+
+/* This function gets the current settings.  The caller must have entered,
+ *    unless it is the thread running the event loop, and must not use them
+ *    after it exits.
+ * Parameters: None
+ * Returns: The current settings.
+ */
+extern const struct settings *settings_get();
+
+
+/* This function starts reading the current settings.  This function will
+ *    abort the program if more than SETTINGS_READERS threads read them.
+ * Parameters: None
+ * Returns: None
+ */
+extern void settings_enter();
+
+
+/* This function finishes reading the current settings.
+ * Parameters: None
+ * Returns: None
+ */
+extern void settings_exit();
+
+
+/* This function frees replaced sets that no thread can still be reading.
+ *    It must be called by the thread running the event loop, and is cheap
+ *    when there are none waiting.
+ * Parameters: None
+ * Returns: None
+ */
+extern void settings_reclaim();
+
+
+/* This function reports how reloads are going.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void settings_stats( struct settings_stats *stats );
+
+#endif
@@ -0,0 +1,285 @@
+/*
+ * File: site.c
+ * Author: agent
+ * Purpose: This file contains the site module, which maps the Host of a
+ *         request to the site that serves it.
+ *         Please see site.h for documentation on how to use this module.
+ */
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "site.h"
+#include "util.h"
+
+#define CACHE_SHARE 8 /* a site's cache defaults to 1/8 of the server's */
+#define MIN_TABLE 16 /* smallest host table */
+
+/* A host name and the site that serves it. */
+struct host {
+	unsigned hash;     /* hash of name */
+	char *name;        /* the name, lowercase */
+	struct site *site; /* the site */
+};
+
+static struct site default_site; /* serves unknown hosts */
+static size_t default_cache; /* bytes of files to cache per site */
+static size_t default_upload; /* largest upload per site */
+static struct site **sites; /* sites added */
+static size_t num_sites;
+static struct host *hosts; /* hosts added, in order */
+static size_t num_hosts;
+static struct host *table; /* hosts, by hash */
+static size_t table_mask; /* size of table - 1 */
+static atomic_size_t unknown; /* # of lookups of unknown hosts */
+
+
+/* This function adds a host name for a site.
+ * Parameters:
+ *    name : the name
+ *    site : the site
+ * Returns: 0 on success, or -1 if the name is empty or already has a site.
+ *          This function will abort the program if memory cannot be
+ *          allocated.
+ */
+static int add_host( char *name, struct site *site ) {
+	struct host *more; /* grown list */
+	size_t i; /* host index */
+
+	for( i = 0; name[i]; i++ ) {
+		name[i] = tolower( (unsigned char)name[i] );
+	}
+	for( i = 0; i < num_hosts; i++ ) {
+		if( !strcmp( hosts[i].name, name ) ) { /* already taken */
+			return -1;
+		}
+	}
+	if( !*name ) {
+		return -1;
+	}
+
+	more = realloc( hosts, ( num_hosts + 1 ) * sizeof( struct host ) );
+	if( more ) {
+		hosts = more;
+		hosts[num_hosts].name = strdup( name );
+	}
+	if( !more || !hosts[num_hosts].name ) { /* error check */
+		perror( "Error while allocating memory" );
+		abort();
+	}
+	hosts[num_hosts].hash = util_hash_str( UTIL_HASH_BASIS, name );
+	hosts[num_hosts].site = site;
+	num_hosts++;
+	return 0;
+}
+
+
+/* This function applies an option of a site directive.
+ * Parameters:
+ *    site       : the site
+ *    opt        : the option, e.g., "cache=16m"
+ *    cache_size : set to the site's cache budget, if the option gives it
+ * Returns: 0 on success, or -1 if the option is malformed.
+ */
+static int site_option( struct site *site, const char *opt, size_t *cache_size ) {
+	if( !strncmp( opt, "cache=", 6 ) ) {
+		return config_size( opt + 6, cache_size );
+	} else if( !strncmp( opt, "upload=", 7 ) ) {
+		return config_size( opt + 7, &site->upload_limit );
+	} else if( !strncmp( opt, "requests=", 9 ) ) {
+		return sscanf( opt + 9, "%d", &site->max_requests ) == 1 ? 0 : -1;
+	}
+	return -1;
+}
+
+
+/* This function creates the default site, serving the current directory.
+ *    It must be called before any other function in this module.  This
+ *    function will abort the program if the site cannot be created.
+ * Parameters:
+ *    cache_size   : bytes of files to cache, for the default site
+ *    upload_limit : largest upload, 0 if uploads are off
+ * Returns: None
+ */
+extern void site_init( size_t cache_size, size_t upload_limit ) {
+	default_site.name = "";
+	default_site.dir = open( ".", O_RDONLY | O_DIRECTORY );
+	if( default_site.dir < 0 ) {
+		perror( "Error while opening current directory" );
+		abort();
+	}
+	default_site.cache = cache_new( cache_size, cache_size / 4 ); /* one file gets <= 1/4 */
+	default_site.upload_limit = upload_limit;
+	default_cache = cache_size / CACHE_SHARE;
+	default_upload = upload_limit;
+}
+
+
+/* This function adds a site, from a site directive.  This function will
+ *    abort the program if memory cannot be allocated.
+ * Parameters:
+ *    argc : # of words of the directive
+ *    argv : words of the directive, starting with "site"
+ * Returns: 0 on success, or -1 if the directive is malformed, names a host
+ *          that already has a site, or its root cannot be opened.
+ */
+extern int site_add( int argc, char **argv ) {
+	struct site *site; /* new site */
+	struct site **more; /* grown list */
+	size_t cache_size = default_cache; /* site's cache budget */
+	size_t first = num_hosts; /* index of the site's first host */
+	char *name; /* host name */
+	int i; /* word index */
+
+	if( ( argc < 3 ) || strcmp( argv[0], "site" ) ) {
+		return -1;
+	}
+	more = realloc( sites, ( num_sites + 1 ) * sizeof( struct site * ) );
+	if( more ) {
+		sites = more;
+		site = calloc( 1, sizeof( struct site ) );
+	}
+	if( !more || !site ) { /* error check */
+		perror( "Error while allocating memory" );
+		abort();
+	}
+
+	site->upload_limit = default_upload;
+	for( i = 3; i < argc; i++ ) {
+		if( site_option( site, argv[i], &cache_size ) ) {
+			free( site );
+			return -1;
+		}
+	}
+
+	site->dir = open( argv[2], O_RDONLY | O_DIRECTORY );
+	if( site->dir < 0 ) {
+		perror( argv[2] );
+		free( site );
+		return -1;
+	}
+
+	for( name = strtok( argv[1], "," ); name; name = strtok( NULL, "," ) ) {
+		if( add_host( name, site ) ) {
+			break;
+		}
+		if( !site->name ) { /* first name names the site */
+			site->name = hosts[num_hosts - 1].name;
+		}
+	}
+	if( name || !site->name ) { /* a bad name, or none, undo the site */
+		while( num_hosts > first ) {
+			free( hosts[--num_hosts].name );
+		}
+		close( site->dir );
+		free( site );
+		return -1;
+	}
+
+	site->cache = cache_new( cache_size, cache_size / 4 );
+	sites[num_sites++] = site;
+	return 0;
+}
+
+
+/* This function builds the table of host names of the sites added.  It
+ *    must be called once, after the last site_add() and before the first
+ *    site_find().  This function will abort the program if memory cannot
+ *    be allocated.
+ * Parameters: None
+ * Returns: None
+ */
+extern void site_index() {
+	size_t size = MIN_TABLE; /* # of slots, at most half full */
+	size_t i, j; /* host index, slot */
+
+	while( size < 2 * num_hosts ) {
+		size *= 2;
+	}
+	table = calloc( size, sizeof( struct host ) );
+	if( !table ) { /* error check */
+		perror( "Error while allocating memory" );
+		abort();
+	}
+	table_mask = size - 1;
+
+	for( i = 0; i < num_hosts; i++ ) { /* linear probing */
+		for( j = hosts[i].hash & table_mask; table[j].name; j = ( j + 1 ) & table_mask );
+		table[j] = hosts[i];
+	}
+}
+
+
+/* This function finds the site serving a host.
+ * Parameters:
+ *    host : the host name, lowercase and without port, may be empty
+ * Returns: The site, or the default site if the host has none.
+ */
+extern struct site *site_find( const char *host ) {
+	unsigned hash; /* hash of host */
+	size_t j; /* slot */
+
+	if( num_hosts && *host ) {
+		hash = util_hash_str( UTIL_HASH_BASIS, host );
+		for( j = hash & table_mask; table[j].name; j = ( j + 1 ) & table_mask ) {
+			if( ( table[j].hash == hash ) && !strcmp( table[j].name, host ) ) {
+				return table[j].site;
+			}
+		}
+	}
+	atomic_fetch_add_explicit( &unknown, 1, memory_order_relaxed );
+	return &default_site;
+}
+
+
+/* This function counts a request against its site's quota.
+ * Parameters:
+ *    site : the site
+ * Returns: 0 if the request may go ahead, or -1 if the site is at its
+ *          limit of requests in progress.
+ */
+extern int site_enter( struct site *site ) {
+	if( ( atomic_fetch_add( &site->active, 1 ) >= site->max_requests ) &&
+	    ( site->max_requests > 0 ) ) { /* over quota */
+		atomic_fetch_sub( &site->active, 1 );
+		atomic_fetch_add_explicit( &site->refused, 1, memory_order_relaxed );
+		return -1;
+	}
+	atomic_fetch_add_explicit( &site->requests, 1, memory_order_relaxed );
+	return 0;
+}
+
+
+/* This function counts a request that site_enter() let in as done.
+ * Parameters:
+ *    site : the site
+ * Returns: None
+ */
+extern void site_leave( struct site *site ) {
+	atomic_fetch_sub( &site->active, 1 );
+}
+
+
+/* This function reports how many sites there are and how they are doing.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void site_stats( struct site_stats *stats ) {
+	size_t i; /* site index */
+
+	stats->sites = num_sites;
+	stats->hosts = num_hosts;
+	stats->unknown = atomic_load( &unknown );
+	stats->requests = atomic_load( &default_site.requests );
+	stats->refused = atomic_load( &default_site.refused );
+	for( i = 0; i < num_sites; i++ ) {
+		stats->requests += atomic_load( &sites[i]->requests );
+		stats->refused += atomic_load( &sites[i]->refused );
+	}
+}
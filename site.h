@@ -0,0 +1,131 @@
+/*
+ * File: site.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          site module, which maps the Host of a request to the site that
+ *          serves it.
+ */
+
+#ifndef SITE_H
+#define SITE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "cache.h"
+
+/*
+ * This module has seven functions:
+ *   site_init()  : create the default site
+ *   site_add()   : add a site, from a site directive
+ *   site_index() : build the table of host names
+ *   site_find()  : find the site serving a host
+ *   site_enter() : count a request against its site's quota
+ *   site_leave() : count a request as done
+ *   site_stats() : report how many sites there are and how they are doing
+ *
+ * Each site has its own document root, which is opened once and used as
+ * the directory all of its paths are relative to, its own partition of the
+ * file cache, and its own quotas: the largest upload it accepts and the
+ * most requests it may have in progress at once.  The default site serves
+ * the current directory, with the server's own settings, to requests for
+ * any host that has no site of its own.
+ *
+ * Sites are added from the configuration file with directives of the form
+ *
+ *   site host[,alias...] root [cache=size] [upload=size] [requests=n]
+ *
+ * A site's cache defaults to an eighth of the server's, its upload limit
+ * to the server's, and it has no limit on requests unless one is given.
+ * Once all sites are added, site_index() builds an open-addressing hash
+ * table of their host names, which is never changed after; site_find()
+ * probes it without taking any lock.  Host names are matched without case
+ * and without port; http_parse() has already lowercased them and dropped
+ * the port.
+ */
+
+struct site {
+	const char *name;       /* first host name, "" for the default site */
+	int dir;                /* descriptor of document root */
+	struct cache *cache;    /* the site's cache partition */
+	size_t upload_limit;    /* largest upload, 0 if uploads are off */
+	int max_requests;       /* most requests in progress, 0 if no limit */
+	atomic_int active;      /* # of requests in progress */
+	atomic_size_t requests; /* # of requests admitted */
+	atomic_size_t refused;  /* # of requests refused, over quota */
+};
+
+struct site_stats {
+	size_t sites;    /* # of sites, not counting the default */
+	size_t hosts;    /* # of host names in the table */
+	size_t unknown;  /* # of lookups that fell back to the default site */
+	size_t requests; /* # of requests admitted, all sites */
+	size_t refused;  /* # of requests refused, all sites */
+};
+
+
+/* This function creates the default site, serving the current directory.
+ *    It must be called before any other function in this module.  This
+ *    function will abort the program if the site cannot be created.
+ * Parameters:
+ *    cache_size   : bytes of files to cache, for the default site
+ *    upload_limit : largest upload, 0 if uploads are off
+ * Returns: None
+ */
+extern void site_init( size_t cache_size, size_t upload_limit );
+
+
+/* This function adds a site, from a site directive.  This function will
+ *    abort the program if memory cannot be allocated.
+ * Parameters:
+ *    argc : # of words of the directive
+ *    argv : words of the directive, starting with "site"
+ * Returns: 0 on success, or -1 if the directive is malformed, names a host
+ *          that already has a site, or its root cannot be opened.
+ */
+extern int site_add( int argc, char **argv );
+
+
+/* This function builds the table of host names of the sites added.  It
+ *    must be called once, after the last site_add() and before the first
+ *    site_find().  This function will abort the program if memory cannot
+ *    be allocated.
+ * Parameters: None
+ * Returns: None
+ */
+extern void site_index();
+
+
+/* This function finds the site serving a host.
+ * Parameters:
+ *    host : the host name, lowercase and without port, may be empty
+ * Returns: The site, or the default site if the host has none.
+ */
+extern struct site *site_find( const char *host );
+
+
+/* This function counts a request against its site's quota.
+ * Parameters:
+ *    site : the site
+ * Returns: 0 if the request may go ahead, or -1 if the site is at its
+ *          limit of requests in progress.
+ */
+extern int site_enter( struct site *site );
+
+
+/* This function counts a request that site_enter() let in as done.
+ * Parameters:
+ *    site : the site
+ * Returns: None
+ */
+extern void site_leave( struct site *site );
+
+
+/* This function reports how many sites there are and how they are doing.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void site_stats( struct site_stats *stats );
+
+#endif
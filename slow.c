@@ -0,0 +1,263 @@
+/*
+ * File: slow.c
+ * Author: agent
+ * Purpose: This file contains the slow request module, which keeps the
+ *         timelines of the slowest requests.
+ *         Please see slow.h for documentation on how to use this module.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "slow.h"
+#include "util.h"
+
+#define INTERVAL_NS ( SLOW_INTERVAL_SECS * 1000000000LL ) /* length of an interval */
+
+/* A request kept in a reservoir. */
+struct record {
+	long long total;           /* ns from accept to close */
+	int status;                /* status answered with */
+	size_t bytes;              /* bytes of body sent */
+	char path[SLOW_PATH_MAX];  /* path requested, maybe cut short */
+	struct slow_trace trace;   /* its timeline */
+};
+
+/* The slowest requests of an interval. */
+struct reservoir {
+	long long start;                 /* start of interval, 0 if none yet */
+	int kept;                        /* # of requests kept */
+	struct record record[SLOW_KEEP]; /* the requests, in no order */
+};
+
+static const char *names[] = { "accept", "read", "parse", "enqueue", "dispatch", "open",
+                               "quantum", "close" };
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; /* guards the reservoirs */
+static struct reservoir current; /* slowest of the current interval */
+static struct reservoir last; /* slowest of the one before */
+static atomic_llong floor_ns; /* fastest kept once current is full, else 0 */
+static atomic_llong ends = 1; /* end of current interval, ns; already ended at first */
+
+
+/* This function starts a new interval if the current one has ended.  The
+ *    lock must be held.
+ * Parameters:
+ *    now : the current time, in ns
+ * Returns: None
+ */
+static void rotate( long long now ) {
+	if( current.start && ( now < current.start + INTERVAL_NS ) ) {
+		return;
+	} else if( current.start && ( now < current.start + 2 * INTERVAL_NS ) ) {
+		last = current; /* the interval just ended */
+	} else {
+		last.start = 0; /* nothing recorded in it */
+		last.kept = 0;
+	}
+	current.start = now;
+	current.kept = 0;
+	atomic_store( &floor_ns, 0 );
+	atomic_store( &ends, now + INTERVAL_NS );
+}
+
+
+/* This function starts the timeline of a request with its accept.
+ * Parameters:
+ *    trace    : the timeline
+ *    accepted : when the client connected, ns on the monotonic clock
+ * Returns: None
+ */
+extern void slow_begin( struct slow_trace *trace, long long accepted ) {
+	trace->event[0].time = accepted;
+	trace->event[0].type = SLOW_ACCEPT;
+	trace->event[0].arg = 0;
+	trace->events = 1;
+	trace->dropped = 0;
+}
+
+
+/* This function adds an event to a timeline, at the current time.
+ * Parameters:
+ *    trace : the timeline
+ *    type  : the type of the event, SLOW_READ, ...
+ *    arg   : its argument
+ * Returns: None
+ */
+extern void slow_event( struct slow_trace *trace, int type, int arg ) {
+	struct slow_event *e; /* event added */
+
+	if( ( trace->events < SLOW_EVENTS - 1 ) ||
+	    ( ( type == SLOW_CLOSE ) && ( trace->events < SLOW_EVENTS ) ) ) {
+		e = &trace->event[trace->events++];
+		e->time = util_now_ns();
+		e->type = type;
+		e->arg = arg;
+	} else {
+		trace->dropped++;
+	}
+}
+
+
+/* This function gets the calling thread's id, as shown by ps and perf.
+ * Parameters: None
+ * Returns: The thread id.
+ */
+extern int slow_tid() {
+	static _Thread_local int tid; /* calling thread's id, 0 until known */
+
+	if( !tid ) {
+		tid = syscall( SYS_gettid );
+	}
+	return tid;
+}
+
+
+/* This function offers a finished request's timeline, which must end with
+ *    its close, to the reservoir of the current interval.
+ * Parameters:
+ *    trace  : the timeline
+ *    path   : the path requested, or NULL if the request did not parse
+ *    status : the HTTP status code it was answered with
+ *    bytes  : bytes of body sent
+ * Returns: None
+ */
+extern void slow_record( const struct slow_trace *trace, const char *path, int status,
+                         size_t bytes ) {
+	long long closed = trace->event[trace->events - 1].time; /* end of request */
+	long long total = closed - trace->event[0].time; /* its response time */
+	struct record *r; /* record replaced */
+	int i; /* record index */
+
+	if( ( total <= atomic_load_explicit( &floor_ns, memory_order_relaxed ) ) &&
+	    ( closed < atomic_load_explicit( &ends, memory_order_relaxed ) ) ) {
+		return; /* not among the slowest, the usual case */
+	}
+
+	pthread_mutex_lock( &lock );
+	rotate( closed );
+	if( current.kept < SLOW_KEEP ) { /* room for it */
+		r = &current.record[current.kept++];
+	} else { /* replace the fastest kept */
+		r = &current.record[0];
+		for( i = 1; i < SLOW_KEEP; i++ ) {
+			if( current.record[i].total < r->total ) {
+				r = &current.record[i];
+			}
+		}
+		if( total <= r->total ) { /* floor was raised meanwhile */
+			pthread_mutex_unlock( &lock );
+			return;
+		}
+	}
+	r->total = total;
+	r->status = status;
+	r->bytes = bytes;
+	snprintf( r->path, SLOW_PATH_MAX, "%s", path ? path : "-" );
+	memcpy( &r->trace, trace, sizeof( struct slow_trace ) );
+
+	if( current.kept == SLOW_KEEP ) { /* new floor, the fastest kept */
+		total = current.record[0].total;
+		for( i = 1; i < SLOW_KEEP; i++ ) {
+			if( current.record[i].total < total ) {
+				total = current.record[i].total;
+			}
+		}
+		atomic_store( &floor_ns, total );
+	}
+	pthread_mutex_unlock( &lock );
+}
+
+
+/* This function orders records slowest first, for qsort().
+ * Parameters:
+ *    a : pointer to a record pointer
+ *    b : pointer to another
+ * Returns: <0 if a is slower, >0 if b is, 0 if neither.
+ */
+static int slower( const void *a, const void *b ) {
+	long long ta = ( *(struct record *const *)a )->total; /* a's response time */
+	long long tb = ( *(struct record *const *)b )->total; /* b's response time */
+
+	return ( ta < tb ) - ( ta > tb );
+}
+
+
+/* This function renders the requests of a reservoir, slowest first.
+ * Parameters:
+ *    buf  : buffer to render into
+ *    size : size of the buffer
+ *    res  : the reservoir
+ *    name : name of its interval
+ *    now  : the current time, in ns
+ * Returns: The number of bytes rendered, or would have been.
+ */
+static int render( char *buf, int size, struct reservoir *res, const char *name, long long now ) {
+	struct record *order[SLOW_KEEP]; /* records, slowest first */
+	struct slow_event *e; /* event rendered */
+	struct record *r; /* record rendered */
+	char arg[16]; /* event's argument, if it has one */
+	int len; /* bytes rendered */
+	int i, j; /* record, event index */
+
+	len = snprintf( buf, size, "interval %s started_secs_ago %.1f kept %d\n", name,
+	                res->start ? ( now - res->start ) / 1e9 : 0, res->kept );
+	for( i = 0; i < res->kept; i++ ) {
+		order[i] = &res->record[i];
+	}
+	qsort( order, res->kept, sizeof( struct record * ), slower );
+
+	for( i = 0; ( i < res->kept ) && ( len < size ); i++ ) {
+		r = order[i];
+		len += snprintf( buf + len, size - len, "request %s status %d total_us %lld bytes %zu"
+		                 " dropped %d\n", r->path, r->status, r->total / 1000, r->bytes,
+		                 r->trace.dropped );
+		for( j = 0; ( j < r->trace.events ) && ( len < size ); j++ ) {
+			e = &r->trace.event[j];
+			arg[0] = '\0';
+			if( ( e->type != SLOW_ACCEPT ) && ( e->type != SLOW_READ ) &&
+			    ( e->type != SLOW_CLOSE ) ) {
+				snprintf( arg, sizeof( arg ), " %d", e->arg );
+			}
+			len += snprintf( buf + len, size - len, "  +%lld %s%s\n",
+			                 ( e->time - r->trace.event[0].time ) / 1000, names[e->type], arg );
+		}
+	}
+	return len;
+}
+
+
+/* This function renders the slowest requests of the last interval and the
+ *    current one as text, slowest first, each with its timeline, e.g.,
+ *
+ *      request /big.bin status 200 total_us 12345 bytes 600000 dropped 0
+ *        +0 accept
+ *        +40 read
+ *        +45 parse 0
+ *        +50 enqueue 1
+ *        +2200 dispatch 4120
+ *        ...
+ *
+ *    with times in microseconds since the accept.
+ * Parameters:
+ *    buf  : buffer to render into, SLOW_DUMP_SIZE bytes is enough
+ *    size : size of the buffer
+ * Returns: The number of bytes rendered, at most size - 1.
+ */
+extern int slow_render( char *buf, int size ) {
+	long long now = util_now_ns(); /* current time */
+	int len; /* bytes rendered */
+
+	pthread_mutex_lock( &lock );
+	rotate( now );
+	len = render( buf, size, &last, "last", now );
+	if( len < size ) {
+		len += render( buf + len, size - len, &current, "current", now );
+	}
+	pthread_mutex_unlock( &lock );
+	return len < size ? len : size - 1;
+}
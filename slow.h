@@ -0,0 +1,133 @@
+/*
+ * File: slow.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          slow request module, which keeps the timelines of the slowest
+ *          requests, so that the tail of the response times can be
+ *          explained one request at a time.
+ */
+
+#ifndef SLOW_H
+#define SLOW_H
+
+#include <stddef.h>
+
+#define SLOW_KEEP 16 /* slowest requests kept per interval */
+#define SLOW_INTERVAL_SECS 10 /* length of an interval */
+#define SLOW_EVENTS 32 /* most events in a timeline */
+#define SLOW_PATH_MAX 128 /* most bytes of a path kept */
+#define SLOW_DUMP_SIZE ( 2 * SLOW_KEEP * ( SLOW_EVENTS * 64 + SLOW_PATH_MAX + 256 ) + 256 )
+                       /* room for slow_render() */
+
+#define SLOW_ACCEPT 0   /* client connected */
+#define SLOW_READ 1     /* whole request read */
+#define SLOW_PARSE 2    /* request parsed, arg is the status, 0 if good */
+#define SLOW_ENQUEUE 3  /* handed to the workers, arg is the priority class */
+#define SLOW_DISPATCH 4 /* a worker starts a quantum, arg is its thread id */
+#define SLOW_OPEN 5     /* file found, or not, arg is the status */
+#define SLOW_QUANTUM 6  /* quantum done, arg is the bytes written */
+#define SLOW_CLOSE 7    /* connection closed */
+
+/*
+ * This module has five functions:
+ *   slow_begin()  : start the timeline of a request
+ *   slow_event()  : add an event to a timeline
+ *   slow_tid()    : get the calling thread's id
+ *   slow_record() : offer a finished request's timeline to the reservoir
+ *   slow_render() : render the slowest requests as text
+ *
+ * Every request carries a timeline, a list of up to SLOW_EVENTS events,
+ * each a time on the monotonic clock, a type (SLOW_ACCEPT, ...) and an
+ * argument.  The events are the phases of its life: accepted, read,
+ * parsed, put on a run queue, and then each quantum, from when a worker
+ * picks it up (so the gap since the last quantum is time spent waiting on
+ * the run queue) to when it is done, with the bytes written in it, and
+ * finally closed.  Events past SLOW_EVENTS - 1 are counted but dropped,
+ * except the close, which always fits.
+ *
+ * When a request is finished, its timeline is offered to a reservoir of
+ * the SLOW_KEEP slowest requests, accept to close, of the current
+ * interval of SLOW_INTERVAL_SECS.  Once the reservoir is full, a request
+ * no slower than the fastest one kept is turned away without taking a
+ * lock, so the cost of offering is a comparison for all but the slow
+ * requests.  When an interval ends, its reservoir is kept for reading and
+ * a new one started.  slow_render() renders the reservoirs of the last
+ * interval and the current one, slowest first.  slow_record() and
+ * slow_render() are thread safe; a timeline belongs to the thread serving
+ * its request.
+ */
+
+/* An event of a timeline. */
+struct slow_event {
+	long long time; /* when, ns on the monotonic clock */
+	int type;       /* SLOW_ACCEPT, SLOW_READ, ... */
+	int arg;        /* depends on type */
+};
+
+/* The timeline of a request. */
+struct slow_trace {
+	int events;    /* # of events */
+	int dropped;   /* # of events that did not fit */
+	struct slow_event event[SLOW_EVENTS]; /* the events, in order */
+};
+
+
+/* This function starts the timeline of a request with its accept.
+ * Parameters:
+ *    trace    : the timeline
+ *    accepted : when the client connected, ns on the monotonic clock
+ * Returns: None
+ */
+extern void slow_begin( struct slow_trace *trace, long long accepted );
+
+
+/* This function adds an event to a timeline, at the current time.
+ * Parameters:
+ *    trace : the timeline
+ *    type  : the type of the event, SLOW_READ, ...
+ *    arg   : its argument
+ * Returns: None
+ */
+extern void slow_event( struct slow_trace *trace, int type, int arg );
+
+
+/* This function gets the calling thread's id, as shown by ps and perf.
+ * Parameters: None
+ * Returns: The thread id.
+ */
+extern int slow_tid();
+
+
+/* This function offers a finished request's timeline, which must end with
+ *    its close, to the reservoir of the current interval.
+ * Parameters:
+ *    trace  : the timeline
+ *    path   : the path requested, or NULL if the request did not parse
+ *    status : the HTTP status code it was answered with
+ *    bytes  : bytes of body sent
+ * Returns: None
+ */
+extern void slow_record( const struct slow_trace *trace, const char *path, int status,
+                         size_t bytes );
+
+
+/* This function renders the slowest requests of the last interval and the
+ *    current one as text, slowest first, each with its timeline, e.g.,
+ *
+ *      request /big.bin status 200 total_us 12345 bytes 600000 dropped 0
+ *        +0 accept
+ *        +40 read
+ *        +45 parse 0
+ *        +50 enqueue 1
+ *        +2200 dispatch 4120
+ *        ...
+ *
+ *    with times in microseconds since the accept.
+ * Parameters:
+ *    buf  : buffer to render into, SLOW_DUMP_SIZE bytes is enough
+ *    size : size of the buffer
+ * Returns: The number of bytes rendered, at most size - 1.
+ */
+extern int slow_render( char *buf, int size );
+
+#endif
@@ -0,0 +1,223 @@
+/*
+ * File: stats.c
+ * Author: agent
+ * Purpose: This file contains the stats module, which publishes the
+ *         server's counters in shared memory.
+ *         Please see stats.h for documentation on how to use this module.
+ */
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+
+#include "cache.h"
+#include "conn.h"
+#include "network.h"
+#include "stats.h"
+#include "util.h"
+#include "worker.h"
+
+#define NAME_MAX_LEN 32 /* room for a segment's name */
+
+static struct stats_segment *seg; /* the segment, NULL if there is none */
+static int timer = -1; /* timer for publishing the gauges */
+static _Thread_local struct stats_slot *slot; /* calling thread's slot */
+static _Thread_local int claimed; /* has the thread tried to claim one? */
+static long long launched; /* when the server was launched */
+static long long ready; /* when it was ready to serve */
+static atomic_llong first_response; /* when the first request finished, 0 if none yet */
+
+
+/* This function starts writing a sequence locked part of the segment.
+ * Parameters:
+ *    seq : its sequence lock
+ * Returns: None
+ */
+static void write_begin( atomic_uint *seq ) {
+	atomic_store_explicit( seq, atomic_load_explicit( seq, memory_order_relaxed ) + 1,
+	                       memory_order_relaxed ); /* odd, readers retry */
+	atomic_thread_fence( memory_order_release ); /* ... before seeing any update */
+}
+
+
+/* This function finishes writing a sequence locked part of the segment.
+ * Parameters:
+ *    seq : its sequence lock
+ * Returns: None
+ */
+static void write_end( atomic_uint *seq ) {
+	atomic_store_explicit( seq, atomic_load_explicit( seq, memory_order_relaxed ) + 1,
+	                       memory_order_release ); /* even, after all updates */
+}
+
+
+/* This function notes when the server was launched.  It must be called
+ *    first thing in main().
+ * Parameters: None
+ * Returns: None
+ */
+extern void stats_launched() {
+	launched = util_now_ns();
+}
+
+
+/* This function creates the server's segment, replacing any left behind
+ *    by an earlier server on the same port, and a timer for publishing the
+ *    gauges.  If the segment cannot be created, the reason is printed and
+ *    the server carries on without it.
+ * Parameters:
+ *    port : the port the server listens on
+ * Returns: A timer descriptor that becomes readable every STATS_PERIOD_MS,
+ *          for the event loop to call stats_publish(), or -1 if there is no
+ *          segment.
+ */
+extern int stats_open( int port ) {
+	struct itimerspec period = { { 0, STATS_PERIOD_MS * 1000000L },
+	                             { 0, STATS_PERIOD_MS * 1000000L } }; /* timer period */
+	char name[NAME_MAX_LEN]; /* segment's name */
+	int fd; /* shared memory object */
+
+	snprintf( name, NAME_MAX_LEN, STATS_NAME, port );
+	shm_unlink( name ); /* readers of an old one keep it until they let go */
+	fd = shm_open( name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644 );
+	if( ( fd < 0 ) || ftruncate( fd, sizeof( struct stats_segment ) ) ) {
+		perror( "Error while creating stats segment" );
+		if( fd >= 0 ) {
+			close( fd );
+			shm_unlink( name );
+		}
+		return -1;
+	}
+	seg = mmap( NULL, sizeof( struct stats_segment ), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+	timer = seg != MAP_FAILED ? timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC ) : -1;
+	if( ( timer < 0 ) || timerfd_settime( timer, 0, &period, NULL ) ) {
+		perror( "Error while creating stats segment" );
+		if( seg != MAP_FAILED ) {
+			munmap( seg, sizeof( struct stats_segment ) );
+		}
+		seg = NULL;
+		shm_unlink( name );
+		return -1;
+	}
+
+	seg->version = STATS_VERSION;
+	seg->size = sizeof( struct stats_segment );
+	seg->pid = getpid();
+	seg->start = launched;
+	stats_publish();
+	atomic_thread_fence( memory_order_release );
+	seg->magic = STATS_MAGIC; /* last, readers check it first */
+	return timer;
+}
+
+
+/* This function publishes a finished request in the calling thread's
+ *    slot, claiming one if the thread has none.  Requests of threads beyond
+ *    STATS_THREADS are not published.  This function is thread safe.
+ * Parameters:
+ *    accepted : when the client connected, ns on the monotonic clock
+ *    status   : the HTTP status code the request was answered with
+ *    bytes    : bytes of body sent
+ * Returns: None
+ */
+extern void stats_request( long long accepted, int status, size_t bytes ) {
+	long long now = util_now_ns(); /* when the request finished */
+	long long none = 0; /* first_response before the first */
+	int i; /* slot claimed */
+
+	if( !atomic_load_explicit( &first_response, memory_order_relaxed ) ) {
+		atomic_compare_exchange_strong( &first_response, &none, now );
+	}
+	if( !claimed && seg ) { /* thread's first request, set up its slot */
+		claimed = 1;
+		i = atomic_fetch_add( &seg->threads, 1 );
+		slot = i < STATS_THREADS ? &seg->slots[i] : NULL;
+		if( slot ) {
+			write_begin( &slot->seq );
+			hist_init( &slot->latency );
+			write_end( &slot->seq );
+		}
+	}
+	if( !slot ) {
+		return;
+	}
+
+	write_begin( &slot->seq );
+	slot->requests++;
+	slot->errors += status >= 400;
+	slot->bytes += bytes;
+	hist_add( &slot->latency, now - accepted );
+	write_end( &slot->seq );
+}
+
+
+/* This function notes when the server is ready to serve.  It must be
+ *    called once, as the event loop is entered.
+ * Parameters: None
+ * Returns: None
+ */
+extern void stats_ready() {
+	ready = util_now_ns();
+}
+
+
+/* This function publishes the gauges, once the timer returned by
+ *    stats_open() is readable.  It must be called by the thread running the
+ *    event loop, which owns the connection counters.
+ * Parameters: None
+ * Returns: None
+ */
+extern void stats_publish() {
+	struct stats_gauges *g = &seg->gauges; /* gauges being published */
+	struct network_stats ns; /* network counters */
+	struct conn_stats cs; /* connection counters */
+	struct worker_stats ws; /* worker counters */
+	struct cache_stats cas; /* cache counters */
+	unsigned long long ticks; /* expirations of the timer */
+	int i; /* class index */
+
+	if( read( timer, &ticks, sizeof( ticks ) ) < 0 ) { /* rearm the timer */
+		ticks = 0;
+	}
+	network_stats( &ns );
+	conn_stats( &cs );
+	worker_stats( &ws );
+	cache_stats( &cas );
+
+	write_begin( &g->seq );
+	g->time = util_now_ns();
+	g->accepted = ns.accepted;
+	g->conns = cs.open;
+	g->workers = ws.workers;
+	g->worker_resizes = ws.grows + ws.shrinks;
+	g->queue_delay = ws.queue_delay;
+	g->depth = ws.depth;
+	for( i = 0; i < STATS_CLASSES; i++ ) {
+		g->class_depth[i] = ws.class_depth[i];
+	}
+	g->cache_entries = cas.entries;
+	g->cache_bytes = cas.bytes;
+	g->cache_hits = cas.hits;
+	g->cache_misses = cas.misses;
+	g->cache_uncached = cas.uncached;
+	write_end( &g->seq );
+}
+
+
+/* This function reports how long the server took to start.
+ * Parameters:
+ *    startup : structure to be filled in
+ * Returns: None
+ */
+extern void stats_startup( struct stats_startup *startup ) {
+	long long first = atomic_load( &first_response ); /* first request finished */
+
+	startup->ready = ready - launched;
+	startup->first_response = first ? first - launched : 0;
+}
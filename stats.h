@@ -0,0 +1,166 @@
+/*
+ * File: stats.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          stats module, which publishes the server's counters in shared
+ *          memory, and the layout of the segment they are published in.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hist.h"
+
+#define STATS_NAME "/sws.%d" /* shm_open() name of a server's segment, by port */
+#define STATS_MAGIC 0x73777374 /* "swst", first word of a segment */
+#define STATS_VERSION 2 /* bumped whenever the layout changes */
+#define STATS_THREADS 128 /* most threads publishing requests */
+#define STATS_PERIOD_MS 250 /* how often the gauges are published */
+#define STATS_CLASSES 3 /* priority classes, see priority.h */
+
+/*
+ * This module has six functions:
+ *   stats_launched() : note when the server was launched
+ *   stats_open()     : create the server's segment
+ *   stats_ready()    : note when the server is ready to serve
+ *   stats_request()  : publish a finished request
+ *   stats_publish()  : publish the gauges
+ *   stats_startup()  : report how long the server took to start
+ *
+ * The segment is a POSIX shared memory object named after the server's
+ * port, e.g., /dev/shm/sws.8080, that tools such as sws-top map read only,
+ * so watching the server takes no requests and no locks from it.  Every
+ * thread that finishes requests has a slot of its own, which only it
+ * writes, holding its request, byte and error counts and a histogram of
+ * response times, from accept to close.  The thread running the event
+ * loop publishes gauges, such as the depth of the run queues and the cache
+ * counters, every STATS_PERIOD_MS, when the timer descriptor returned by
+ * stats_open() becomes readable.
+ *
+ * Each slot, and the gauges, is guarded by a sequence lock: the writer
+ * makes the sequence odd, updates the fields, and makes it even again, so
+ * writing costs no more than the updates themselves, and a reader copies
+ * the fields and tries again if the sequence was odd or changed meanwhile.
+ * A reader adds the slots up to get the server's totals, and works out
+ * rates and percentiles from the difference between two readings.  The
+ * segment starts with STATS_MAGIC, STATS_VERSION and its size, which a
+ * reader checks before trusting the layout, and the server's pid, so a
+ * segment left behind by a server that has gone can be recognized.
+ * Slots are set up by the thread that claims them, not when the segment
+ * is created, so a server starts without touching the whole segment.
+ *
+ * The module also times the server's startup: from stats_launched(),
+ * called first thing in main(), to stats_ready(), called as the event
+ * loop is entered, and to the first request finished, which is the time
+ * to first response when the first client was waiting (e.g., queued on a
+ * listening socket passed in by a supervisor, see network.h).
+ */
+
+/* What the requests finished by one thread add up to.  Slots start on a
+ * cache line of their own, so threads do not slow each other down. */
+struct stats_slot {
+	_Alignas( 64 ) atomic_uint seq; /* sequence lock, odd while being written */
+	uint64_t requests;   /* # of requests finished */
+	uint64_t errors;     /* # of those answered with a status of 400 or more */
+	uint64_t bytes;      /* bytes of body sent */
+	struct hist latency; /* ns from accept to close */
+};
+
+/* The server's state, as of the last time it was published. */
+struct stats_gauges {
+	atomic_uint seq;         /* sequence lock, odd while being written */
+	uint64_t time;           /* when published, ns on the monotonic clock */
+	uint64_t accepted;       /* # of client connections opened */
+	uint64_t conns;          /* # of connections open */
+	uint64_t workers;        /* # of worker threads serving */
+	uint64_t worker_resizes; /* # of times the pool was resized */
+	uint64_t queue_delay;    /* ns a request waits on the run queues */
+	uint64_t depth;          /* # of requests in the run queues */
+	uint64_t class_depth[STATS_CLASSES]; /* # in each run queue */
+	uint64_t cache_entries;  /* # of entries cached */
+	uint64_t cache_bytes;    /* bytes of data cached */
+	uint64_t cache_hits;     /* # of lookups found in the cache */
+	uint64_t cache_misses;   /* # of lookups loaded into the cache */
+	uint64_t cache_uncached; /* # of lookups for files that cannot be cached */
+};
+
+struct stats_startup {
+	long long ready;          /* ns from launch to ready to serve */
+	long long first_response; /* ns from launch to the first request finished, 0 if none yet */
+};
+
+/* A server's segment. */
+struct stats_segment {
+	uint32_t magic;             /* STATS_MAGIC */
+	uint32_t version;           /* STATS_VERSION */
+	uint64_t size;              /* sizeof( struct stats_segment ) */
+	int64_t pid;                /* the server's pid */
+	uint64_t start;             /* when it was launched, ns on the monotonic clock */
+	atomic_int threads;         /* # of slots in use */
+	struct stats_gauges gauges; /* the server's state */
+	struct stats_slot slots[STATS_THREADS]; /* one per thread */
+};
+
+
+/* This function notes when the server was launched.  It must be called
+ *    first thing in main().
+ * Parameters: None
+ * Returns: None
+ */
+extern void stats_launched();
+
+
+/* This function creates the server's segment, replacing any left behind
+ *    by an earlier server on the same port, and a timer for publishing the
+ *    gauges.  If the segment cannot be created, the reason is printed and
+ *    the server carries on without it.
+ * Parameters:
+ *    port : the port the server listens on
+ * Returns: A timer descriptor that becomes readable every STATS_PERIOD_MS,
+ *          for the event loop to call stats_publish(), or -1 if there is no
+ *          segment.
+ */
+extern int stats_open( int port );
+
+
+/* This function notes when the server is ready to serve.  It must be
+ *    called once, as the event loop is entered.
+ * Parameters: None
+ * Returns: None
+ */
+extern void stats_ready();
+
+
+/* This function publishes a finished request in the calling thread's
+ *    slot, claiming one if the thread has none.  Requests of threads beyond
+ *    STATS_THREADS are not published.  This function is thread safe.
+ * Parameters:
+ *    accepted : when the client connected, ns on the monotonic clock
+ *    status   : the HTTP status code the request was answered with
+ *    bytes    : bytes of body sent
+ * Returns: None
+ */
+extern void stats_request( long long accepted, int status, size_t bytes );
+
+
+/* This function publishes the gauges, once the timer returned by
+ *    stats_open() is readable.  It must be called by the thread running the
+ *    event loop, which owns the connection counters.
+ * Parameters: None
+ * Returns: None
+ */
+extern void stats_publish();
+
+
+/* This function reports how long the server took to start.
+ * Parameters:
+ *    startup : structure to be filled in
+ * Returns: None
+ */
+extern void stats_startup( struct stats_startup *startup );
+
+#endif
@@ -2,36 +2,463 @@
  * File: sws.c
  * Author: Alex Brodsky
  * Purpose: This file contains the implementation of a simple web server.
- *          It consists of two functions: main() which contains the main
- *          loop accept client connections, and serve_client(), which
- *          processes each client request.
+ *          It consists of four functions: main() which contains the main
+ *          loop that accepts client connections and waits for their requests,
+ *          accept_clients(), which adds new clients to the loop,
+ *          serve_client(), which parses each client request and hands it
+ *          to the worker threads, and serve_quantum(), which the workers
+ *          call to send back a piece of the requested file at a time, or
+ *          to receive a piece of an uploaded one.
  */
 
+#define _GNU_SOURCE /* for pthread_setaffinity_np() */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
 
+#include "account.h"
+#include "admin.h"
+#include "cache.h"
+#include "config.h"
+#include "conn.h"
+#include "http.h"
+#include "listing.h"
+#include "meta.h"
 #include "network.h"
+#include "pace.h"
+#include "priority.h"
+#include "probes.h"
+#include "rate.h"
+#include "settings.h"
+#include "site.h"
+#include "slow.h"
+#include "stats.h"
+#include "upload.h"
+#include "util.h"
+#include "worker.h"
+#include "zcopy.h"
 
 #define MAX_HTTP_SIZE 8192 /* size of buffer to allocate */
+#define MAX_EVENTS 64 /* events handled per epoll_wait() */
+#define MAX_ERROR_SIZE 128 /* size of error response buffer */
+#define HEADER_LIMIT 65536 /* default limit on request size */
+#define BUSY_POLL_USECS 50 /* kernel busy poll time in busy poll mode */
+#define CACHE_SIZE ( 64 << 20 ) /* default bytes of files to cache */
+#define CACHE_QUANTUM 65536 /* most bytes of a cached file sent per quantum */
+#define ZC_WAIT_MS 1 /* ms to wait for zero-copy sends per quantum */
+#define ZC_DRAINS 5000 /* most quanta to wait for zero-copy sends */
+
+#define REQ_OPEN 0 /* request's file not yet found */
+#define REQ_SEND 1 /* request's file being sent */
+#define REQ_DRAIN 2 /* waiting for zero-copy sends to complete */
+#define REQ_UPLOAD 3 /* request's body being received */
+#define REQ_HEAD 4 /* request only wants the file's header */
+
+/* A request that has been parsed and is waiting for, or being served by,
+ * a worker thread. */
+struct request {
+	int fd;                    /* client connection */
+	int state;                 /* REQ_OPEN, REQ_SEND, ... */
+	struct site *site;         /* site serving request */
+	FILE *fin;                 /* file being sent, if not cached */
+	struct cache_entry *entry; /* cached file being sent, if cached */
+	struct listing *list;      /* directory listing being sent, if one */
+	size_t off;                /* bytes of cached file or listing sent */
+	size_t sent;               /* bytes of file or listing sent */
+	int status;                /* status answered with */
+	int hit;                   /* cached file found in the cache? */
+	struct account usage;      /* CPU time and system calls used */
+	long long accepted;        /* when the client connected, ns */
+	int zc;                    /* sending cached file without copies? */
+	int zc_sent;               /* # of zero-copy sends made */
+	int zc_done;               /* # of zero-copy sends completed */
+	int drains;                /* # of quanta spent waiting for them */
+	struct upload *up;         /* body being received, if an upload */
+	unsigned client;           /* client's address, for pacing */
+	struct pace pace;          /* pacing of response, by path */
+	int class;                 /* priority class of path */
+	long long wait;            /* ns to put the request aside for, if it must wait */
+	long long resume;          /* when a request put aside goes on anyway, ns */
+	struct request *next;      /* next request put aside */
+	struct slow_trace trace;   /* timeline, for the slow request log */
+	char path[];               /* requested path, with leading / */
+};
+
+static size_t header_limit = HEADER_LIMIT; /* most bytes in a request */
+static int workers = -1; /* # of worker threads */
+static int max_workers = -1; /* most worker threads, if scaled to the load */
+static int pool; /* are requests handed to workers? */
+static char *busy_cpus; /* CPUs for busy poll mode, NULL if off */
+static size_t cache_size = CACHE_SIZE; /* bytes of files to cache */
+static int zerocopy; /* send cached files with MSG_ZEROCOPY? */
+static size_t upload_limit; /* largest upload, 0 if uploads are off */
+static int upload_sync = UPLOAD_SYNC_FILE; /* how hard uploads are synced */
+static char held_ticks; /* tags timer events for requests put aside in the main loop */
+static char held_reads; /* tags events of sockets of requests put aside in the main loop */
+static pthread_mutex_t held_lock = PTHREAD_MUTEX_INITIALIZER; /* guards held */
+static struct request *held; /* requests put aside, soonest first */
+static int held_fd = -1; /* timer for the soonest of them */
+static int held_epfd = -1; /* epoll instance watching the sockets of uploads put aside */
+static char *config_file; /* configuration file, NULL if none */
+static char dir_changes; /* tags directory change events in the main loop */
+static char stats_ticks; /* tags stats timer events in the main loop */
+static char hangups; /* tags SIGHUP events in the main loop */
+static char worker_ticks; /* tags worker pool timer events in the main loop */
+static struct settings *building; /* settings being read from the configuration file */
+static int reloading; /* reading the configuration file again, not at startup? */
+static const char too_many[] = "HTTP/1.1 429 Too many requests\nRetry-After: 1\n\n";
+
+
+/* This function finds a file to serve, in the cache or, if it cannot be
+ *    cached, by opening it.  A directory is found but not opened.
+ * Parameters:
+ *    req  : the request, whose entry or fin is set to the file
+ *    path : path of the file, relative to the site's root
+ *    st   : set to the status of the file
+ * Returns: 0 if the file was found, or -1 if not.
+ */
+static int open_file( struct request *req, const char *path, struct stat *st ) {
+	struct site *site = req->site; /* site serving request */
+	int fd; /* uncached file */
+
+	req->entry = cache_get( site->cache, site->dir, path, &req->hit );
+	if( req->entry ) { /* cached, so a regular file */
+		st->st_mode = S_IFREG;
+		st->st_size = req->entry->size;
+		st->st_mtim = req->entry->mtime;
+		return 0;
+	}
+
+	fd = openat( site->dir, path, O_RDONLY ); /* not cacheable, open file */
+	if( ( fd >= 0 ) && !fstat( fd, st ) && S_ISDIR( st->st_mode ) ) {
+		close( fd ); /* caller decides what to send */
+		return 0;
+	}
+	req->fin = fd >= 0 ? fdopen( fd, "r" ) : NULL;
+	if( !req->fin && ( fd >= 0 ) ) {
+		close( fd );
+	}
+	return req->fin ? 0 : -1;
+}
+
+
+/* This function starts serving a request: it looks the requested file up
+ *    in the cache, or opens it if it cannot be cached, and sends back the
+ *    status and header.  A directory is served by its index.html if it has
+ *    one, and by a listing of it otherwise; one asked for without a
+ *    trailing / is redirected to the path with one, so that relative links
+ *    work.  If the file is not available, the appropriate error is sent
+ *    back.  It is also used for HEAD requests of directories, so they get
+ *    the same status and header as a GET.
+ * Parameters:
+ *    req    : the request
+ *    buffer : response buffer, MAX_HTTP_SIZE bytes
+ * Returns: 1 if the file is to be sent, 0 if the request is finished.
+ */
+static int open_request( struct request *req, char *buffer ) {
+	struct site *site = req->site; /* site serving request */
+	const char *path = req->path[1] ? req->path + 1 : "."; /* skip leading / */
+	struct stat st; /* status of file */
+	struct stat index; /* status of index.html */
+	int len; /* length of response */
+	int url; /* length of escaped path, for a redirect */
+
+	req->status = 404;
+	if( open_file( req, path, &st ) ) { /* check if successful */
+		len = sprintf( buffer, "HTTP/1.1 404 File not found\n\n" );
+		write( req->fd, buffer, len ); /* if not, send err */
+		return 0;
+	}
+
+	if( S_ISDIR( st.st_mode ) && ( req->path[strlen( req->path ) - 1] != '/' ) ) {
+		len = sprintf( buffer, "HTTP/1.1 301 Moved permanently\nLocation: " );
+		url = http_encode_path( buffer + len, MAX_HTTP_SIZE - len - 3, req->path );
+		if( url < 0 ) { /* too long to escape */
+			len = sprintf( buffer, "HTTP/1.1 414 URI too long\n\n" );
+			req->status = 414;
+		} else {
+			len += url + sprintf( buffer + len + url, "/\n\n" );
+			req->status = 301;
+		}
+		write( req->fd, buffer, len );
+		return 0;
+	} else if( S_ISDIR( st.st_mode ) ) { /* index.html, or a listing */
+		sprintf( buffer, "%sindex.html", req->path + 1 );
+		if( open_file( req, buffer, &index ) || S_ISDIR( index.st_mode ) ) {
+			req->list = listing_get( site->dir, path, req->path );
+			st.st_size = req->list ? (off_t)req->list->size : 0;
+		} else {
+			st = index;
+		}
+		if( !req->entry && !req->fin && !req->list ) {
+			len = sprintf( buffer, "HTTP/1.1 404 File not found\n\n" );
+			write( req->fd, buffer, len );
+			return 0;
+		}
+	}
+
+	if( req->state != REQ_HEAD ) { /* a body follows */
+		if( zerocopy && req->entry && ( req->entry->size >= ZCOPY_MIN ) ) {
+			req->zc = !zcopy_enable( req->fd );
+		}
+		pace_start( &req->pace, req->fd, req->path );
+	}
+	req->status = 200;
+
+	len = meta_header( buffer, S_ISREG( st.st_mode ) || req->list ? st.st_size : -1,
+	                   &st.st_mtim ); /* send success code */
+	write( req->fd, buffer, len );
+	return 1;
+}
+
+
+/* This function gets how many bytes of a response may be sent now, within
+ *    both the response's pacing and the client's bandwidth.  Bytes the
+ *    pacing grants but the bandwidth does not are given back to it.
+ * Parameters:
+ *    req  : the request, whose wait is set if nothing may be sent
+ *    want : the bytes the caller would like to send
+ * Returns: The bytes that may be sent, at most want, or 0 if the request is
+ *          to be put aside for req->wait ns.
+ */
+static size_t allowance( struct request *req, size_t want ) {
+	size_t paced = pace_grant( &req->pace, want, &req->wait ); /* within pacing */
+
+	if( !paced ) {
+		return 0;
+	}
+	want = rate_pace( req->client, paced, &req->wait );
+	pace_refund( &req->pace, paced - want );
+	return want;
+}
+
+
+/* This function sends the next chunk of a directory listing, of up to
+ *    CACHE_QUANTUM bytes.
+ * Parameters:
+ *    req : the request
+ * Returns: 1 if there is more to send, 0 if done or the client is gone.
+ */
+static int send_listing( struct request *req ) {
+	size_t len = req->list->size - req->off; /* bytes to send */
+	ssize_t sent; /* bytes sent */
+
+	if( len > CACHE_QUANTUM ) {
+		len = CACHE_QUANTUM;
+	}
+	len = allowance( req, len );
+	if( len == 0 ) { /* client is paced, put aside */
+		return 1;
+	}
+	sent = write( req->fd, req->list->data + req->off, len );
+	if( sent < 1 ) { /* check for errors */
+		perror( "Error while writing to client" );
+		return 0;
+	}
+	req->off += sent;
+	req->sent += sent;
+	return req->off < req->list->size;
+}
 
 
-/* This function takes a file handle to a client, reads in the request,
- *    parses the request, and sends back the requested file.  If the
- *    request is improper or the file is not available, the appropriate
- *    error is sent back.
+/* This function sends the next chunk of a cached file, of up to
+ *    CACHE_QUANTUM bytes.  Large chunks are sent without copying if
+ *    zero-copy is on; each such send holds a reference to the cache entry
+ *    until the kernel reports it complete.
  * Parameters:
- *    fd : the file descriptor to the client connection
+ *    req : the request
+ * Returns: 1 if there is more to send, 0 if done or the client is gone.
+ */
+static int send_cached( struct request *req ) {
+	struct cache_entry *entry = req->entry; /* file being sent */
+	size_t len = entry->size - req->off; /* bytes to send */
+	ssize_t sent = -1; /* bytes sent */
+	int done; /* # of sends completed */
+
+	if( len > CACHE_QUANTUM ) {
+		len = CACHE_QUANTUM;
+	}
+	if( len == 0 ) { /* empty file */
+		return 0;
+	}
+	len = allowance( req, len );
+	if( len == 0 ) { /* client is paced, put aside */
+		return 1;
+	}
+
+	if( req->zc && ( len >= ZCOPY_MIN ) ) { /* no copy */
+		cache_hold( entry );
+		sent = zcopy_send( req->fd, entry->data + req->off, len );
+		if( sent > 0 ) {
+			req->zc_sent++;
+		} else {
+			cache_put( entry, 1 );
+		}
+	}
+	if( sent <= 0 ) { /* plain copy */
+		sent = write( req->fd, entry->data + req->off, len );
+	}
+
+	if( req->zc_sent > req->zc_done ) { /* release completed sends */
+		done = zcopy_reap( req->fd, 0 );
+		req->zc_done += done;
+		cache_put( entry, done );
+	}
+
+	if( sent < 1 ) { /* check for errors */
+		perror( "Error while writing to client" );
+		return 0;
+	}
+	req->off += sent;
+	req->sent += sent;
+	return req->off < entry->size;
+}
+
+
+/* This function sends the next chunk of an uncached file, of up to
+ *    MAX_HTTP_SIZE bytes.
+ * Parameters:
+ *    req    : the request
+ *    buffer : response buffer, MAX_HTTP_SIZE bytes
+ * Returns: 1 if there is more to send, 0 if done or the client is gone.
+ */
+static int send_file( struct request *req, char *buffer ) {
+	size_t want = allowance( req, MAX_HTTP_SIZE ); /* bytes to read */
+	size_t len; /* length of data read */
+
+	if( want == 0 ) { /* client is paced, put aside */
+		return 1;
+	}
+	len = fread( buffer, 1, want, req->fin ); /* read file chunk */
+	if( len > 0 ) { /* if none, send chunk */
+		if( write( req->fd, buffer, len ) < 1 ) { /* check for errors */
+			perror( "Error while writing to client" );
+			len = 0;
+		}
+	}
+	req->sent += len;
+	return len == want; /* the last chunk is short */
+}
+
+
+/* This function waits a little for the kernel to finish zero-copy sends
+ *    of a request, giving back the cache references they hold.  If the
+ *    client stops acknowledging data, the kernel may hold on to the pages
+ *    for minutes; after ZC_DRAINS quanta we stop waiting and leave the
+ *    outstanding references held, so the entry's memory is never reused
+ *    while the kernel may still send from it.
+ * Parameters:
+ *    req : the request
+ * Returns: 1 if there are sends still to wait for, 0 if done.
+ */
+static int drain_request( struct request *req ) {
+	int done; /* # of sends completed */
+
+	done = zcopy_reap( req->fd, ZC_WAIT_MS );
+	req->zc_done += done;
+	cache_put( req->entry, done );
+	return ( req->zc_done < req->zc_sent ) && ( ++req->drains < ZC_DRAINS );
+}
+
+
+/* This function puts a request aside, off the run queues, so that it takes
+ *    no worker's time while it waits.  It goes on once its wait is over,
+ *    or, for an upload, as soon as its socket is readable.  The timer is
+ *    set for it if it is now the soonest.
+ * Parameters:
+ *    req : the request, whose wait is how long to put it aside
  * Returns: None
  */
-static void serve_client( int fd ) {
-	static char *buffer; /* request buffer */
-	char *req = NULL; /* ptr to req file */
-	char *brk; /* state used by strtok */
-	char *tmp; /* error checking ptr */
-	FILE *fin; /* input file handle */
-	int len; /* length of data read */
+static void hold_request( struct request *req ) {
+	struct itimerspec when = { { 0, 0 }, { 0, 0 } }; /* timer setting */
+	struct epoll_event ev; /* socket registration */
+	struct request **pos; /* where it goes in the list */
+
+	req->resume = util_now_ns() + req->wait;
+	req->wait = 0;
+	when.it_value.tv_sec = req->resume / 1000000000LL;
+	when.it_value.tv_nsec = req->resume % 1000000000LL;
+
+	pthread_mutex_lock( &held_lock );
+	for( pos = &held; *pos && ( ( *pos )->resume <= req->resume ); pos = &( *pos )->next );
+	req->next = *pos;
+	*pos = req;
+	if( held == req ) { /* soonest, wake the main loop for it */
+		timerfd_settime( held_fd, TFD_TIMER_ABSTIME, &when, NULL );
+	}
+	if( req->state == REQ_UPLOAD ) { /* wake the main loop when more arrives */
+		ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+		ev.data.ptr = req;
+		if( epoll_ctl( held_epfd, EPOLL_CTL_MOD, req->fd, &ev ) ) { /* 1st wait */
+			epoll_ctl( held_epfd, EPOLL_CTL_ADD, req->fd, &ev );
+		}
+	}
+	pthread_mutex_unlock( &held_lock );
+}
+
+
+/* This function adds the usage of a finished request to the totals of its
+ *    kind.
+ * Parameters:
+ *    req : the request
+ * Returns: None
+ */
+static void account_request( struct request *req ) {
+	int kind; /* kind of request */
+
+	if( req->up ) {
+		kind = ACCOUNT_UPLOAD;
+		req->status = upload_status( req->up );
+	} else if( req->state == REQ_HEAD ) {
+		kind = ACCOUNT_HEAD;
+	} else if( req->status != 200 ) {
+		kind = ACCOUNT_ERROR;
+	} else if( req->entry ) {
+		kind = req->hit ? ACCOUNT_HIT : ACCOUNT_MISS;
+	} else if( req->list ) {
+		kind = ACCOUNT_LISTING;
+	} else {
+		kind = ACCOUNT_DISK;
+	}
+	account_add( &req->usage, req->class, kind, req->status, req->sent );
+	stats_request( req->accepted, req->status, req->sent );
+}
+
+
+/* This function serves one quantum of a request: the first quantum finds
+ *    the requested file and sends back the status, and each quantum after
+ *    that sends the next chunk of the file.  Files are sent from the cache
+ *    when they can be, and a paced client's request is put aside while
+ *    its bandwidth is used up.  Once the whole file is sent, and any
+ *    zero-copy sends of it are complete, the client connection is closed
+ *    and the request is freed.  An upload instead receives the next piece
+ *    of its body each quantum, and is put aside while none is arriving,
+ *    and a HEAD request is answered in one quantum from the file's
+ *    metadata.  This function is called by the worker threads.
+ * Parameters:
+ *    item : the request to serve
+ * Returns: 1 if the request needs another quantum, 0 if it is finished or
+ *          put aside.
+ */
+static int serve_quantum( void *item ) {
+	static _Thread_local char *buffer; /* response buffer */
+	struct request *req = item; /* request being served */
+	size_t sent = req->sent; /* bytes sent before this quantum */
+	int more; /* more to do? */
+	int len; /* length of HEAD response */
 
 	if( !buffer ) { /* 1st time, alloc buffer */
 		buffer = malloc( MAX_HTTP_SIZE );
@@ -41,77 +468,609 @@ static void serve_client( int fd ) {
 		}
 	}
 
-	memset( buffer, 0, MAX_HTTP_SIZE );
-	if( read( fd, buffer, MAX_HTTP_SIZE ) <= 0 ) { /* read req from client */
-		perror( "Error while reading request" );
-		abort();
+	slow_event( &req->trace, SLOW_DISPATCH, slow_tid() );
+	account_start( &req->usage );
+	settings_enter(); /* rates and pacing are looked up */
+	if( req->state == REQ_UPLOAD ) { /* receive next piece */
+		more = upload_step( req->up, &req->wait );
+	} else if( req->state == REQ_HEAD ) { /* header only, no file I/O */
+		len = meta_head( req->site->dir, req->path[1] ? req->path + 1 : ".", buffer );
+		if( len ) {
+			write( req->fd, buffer, len );
+			sscanf( buffer, "HTTP/1.1 %d", &req->status );
+		} else { /* a directory, same status and header as a GET */
+			open_request( req, buffer );
+		}
+		more = 0;
+	} else if( req->state == REQ_OPEN ) { /* 1st quantum, find file */
+		more = open_request( req, buffer );
+		req->state = REQ_SEND;
+		slow_event( &req->trace, SLOW_OPEN, req->status );
+	} else if( req->state == REQ_SEND ) { /* send next chunk */
+		more = req->entry ? send_cached( req ) : req->list ? send_listing( req ) :
+		       send_file( req, buffer );
+	} else { /* wait for zero-copy sends */
+		more = drain_request( req );
+	}
+	settings_exit();
+	account_stop( &req->usage );
+	slow_event( &req->trace, SLOW_QUANTUM, req->sent - sent );
+	PROBE( quantum, req->fd, PROBE_PTR( req->path ), req->sent, more );
+
+	if( req->wait ) { /* nothing to do for now, put aside */
+		hold_request( req );
+		return 0;
+	} else if( more ) {
+		return 1;
+	} else if( ( req->state == REQ_SEND ) && ( req->zc_sent > req->zc_done ) ) {
+		shutdown( req->fd, SHUT_WR ); /* all sent, tell client */
+		req->state = REQ_DRAIN;
+		return 1;
+	}
+
+	if( req->fin ) {
+		fclose( req->fin );
+	}
+	if( req->entry ) {
+		cache_put( req->entry, 1 );
+	}
+	if( req->list ) {
+		listing_put( req->list );
+	}
+	if( req->up ) {
+		upload_free( req->up );
+	}
+	site_leave( req->site );
+	account_request( req );
+	PROBE( close, req->fd, PROBE_PTR( req->path ), req->sent );
+	close( req->fd ); /* close client connectuin*/
+	slow_event( &req->trace, SLOW_CLOSE, 0 );
+	slow_record( &req->trace, req->path, req->status, req->sent );
+	free( req );
+	return 0;
+}
+
+
+/* This function serves a request put aside again, handing it to the
+ *    workers, in its priority class, if there are any.
+ * Parameters:
+ *    req : the request
+ * Returns: None
+ */
+static void resume_request( struct request *req ) {
+	if( pool ) {
+		worker_submit( req, req->class );
+	} else {
+		while( serve_quantum( req ) ); /* serve it all now */
+	}
+}
+
+
+/* This function takes back the requests put aside whose time has come and
+ *    serves them again, and sets the timer for the soonest of the rest.
+ * Parameters: None
+ * Returns: None
+ */
+static void release_requests() {
+	struct itimerspec when = { { 0, 0 }, { 0, 0 } }; /* timer setting */
+	struct request *due = NULL; /* requests whose time has come */
+	struct request *req; /* request released */
+	long long now; /* current time */
+	uint64_t ticks; /* timer expirations */
+
+	read( held_fd, &ticks, sizeof( ticks ) );
+	now = util_now_ns();
+	pthread_mutex_lock( &held_lock );
+	if( held && ( held->resume <= now ) ) {
+		due = held;
+		for( req = held; req->next && ( req->next->resume <= now ); req = req->next );
+		held = req->next;
+		req->next = NULL;
+	}
+	if( held ) {
+		when.it_value.tv_sec = held->resume / 1000000000LL;
+		when.it_value.tv_nsec = held->resume % 1000000000LL;
+		timerfd_settime( held_fd, TFD_TIMER_ABSTIME, &when, NULL );
+	}
+	pthread_mutex_unlock( &held_lock );
+
+	while( due ) {
+		req = due;
+		due = req->next;
+		resume_request( req );
+	}
+}
+
+
+/* This function takes back the uploads put aside whose sockets have become
+ *    readable, or whose clients have gone, and serves them again.  An
+ *    upload the timer took back first is no longer in the list, and is
+ *    left alone.
+ * Parameters: None
+ * Returns: None
+ */
+static void wake_requests() {
+	struct epoll_event events[MAX_EVENTS]; /* readable sockets */
+	struct request **pos; /* request's place in the list */
+	struct request *req; /* request woken */
+	int n; /* # of events */
+	int i; /* loop index */
+
+	n = epoll_wait( held_epfd, events, MAX_EVENTS, 0 );
+	for( i = 0; i < n; i++ ) {
+		req = events[i].data.ptr;
+		pthread_mutex_lock( &held_lock );
+		for( pos = &held; *pos && ( *pos != req ); pos = &( *pos )->next );
+		if( *pos ) { /* still put aside, take it back */
+			*pos = req->next;
+		} else {
+			req = NULL;
+		}
+		pthread_mutex_unlock( &held_lock );
+		if( req ) {
+			resume_request( req );
+		}
+	}
+}
+
+
+/* This function takes a connection whose request has been read in and
+ *    parses the request.  If the request is improper, the appropriate error
+ *    is sent back and the client connection is closed; otherwise, the
+ *    request is handed to the worker threads to be served (or served right
+ *    here if there are no workers).  The connection's buffers are returned
+ *    to the pool as soon as the request is parsed; for an upload, the part
+ *    of the body that came with the headers is copied out first.
+ * Parameters:
+ *    conn : the connection holding the client's request
+ * Returns: None
+ */
+static void serve_client( struct conn *conn ) {
+	char buffer[MAX_ERROR_SIZE]; /* error response */
+	struct http_req hreq; /* parsed request */
+	struct request *req; /* request to hand off */
+	struct site *site = NULL; /* site serving request */
+	struct upload *up = NULL; /* body to receive */
+	struct slow_trace trace; /* timeline of request */
+	int upload = 0; /* PUT or POST request? */
+	int head = 0; /* HEAD request? */
+	int options = 0; /* OPTIONS request? */
+	int admin = 0; /* request for server's own state? */
+	int fd = conn->fd; /* client connection */
+	unsigned client; /* client's address */
+	int status; /* result of parse */
+	int len = 0; /* length of error */
+
+	slow_begin( &trace, conn->accepted );
+	slow_event( &trace, SLOW_READ, 0 );
+	if( rate_admit( fd, &client ) ) { /* client over its rate, do no work */
+		status = 429;
+	} else if( conn->state == HTTP_OVERFLOW ) { /* request over the limit */
+		status = 431;
+	} else { /* parse request */
+		status = http_parse( conn->head, &hreq );
 	}
+	PROBE( parse, fd, status, PROBE_PTR( status ? NULL : hreq.path ) );
+	slow_event( &trace, SLOW_PARSE, status );
 
-	/* standard requests are of the form GET /foo/bar/qux.html HTTP/1.1
-	 * We want the second token (the file path). */
-	tmp = strtok_r( buffer, " ", &brk ); /* parse request */
-	if( tmp && !strcmp( "GET", tmp ) ) {
-		req = strtok_r( NULL, " ", &brk );
+	if( !status ) { /* find the site, and check the method */
+		site = site_find( hreq.host );
+		upload = !strcmp( "PUT", hreq.method ) || !strcmp( "POST", hreq.method );
+		head = !strcmp( "HEAD", hreq.method );
+		options = !strcmp( "OPTIONS", hreq.method );
+		admin = !strcmp( "GET", hreq.method ) &&
+		        !strncmp( hreq.path, ADMIN_PREFIX, strlen( ADMIN_PREFIX ) );
+		if( !upload && !head && !options && strcmp( "GET", hreq.method ) ) {
+			status = 400; /* nothing else is served */
+		} else if( !http_path_safe( hreq.path ) ) {
+			status = 403; /* stay inside the site's root, whatever the method */
+		} else if( upload ) {
+			status = upload_check( site, hreq.path, hreq.length );
+		}
+	}
+	if( !status && !options && !admin ) { /* request for the workers */
+		if( site_enter( site ) ) { /* site is at its quota */
+			status = 503;
+		} else if( upload ) { /* body is spliced, leave socket non-blocking */
+			up = upload_new( fd, site, hreq.path, hreq.length, conn->head, hreq.header_len );
+		}
+	}
+	conn_release( conn ); /* request no longer needed */
+	if( !up ) {
+		fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) & ~O_NONBLOCK );
 	}
 
-	if( !req ) { /* is req valid? */
+	if( status == 429 ) { /* client over its rate, response is ready made */
+		write( fd, too_many, sizeof( too_many ) - 1 );
+	} else if( status == 431 ) { /* request too large */
+		len = sprintf( buffer, "HTTP/1.1 431 Request header fields too large\n\n" );
+	} else if( status == 414 ) { /* path too long */
+		len = sprintf( buffer, "HTTP/1.1 414 URI too long\n\n" );
+	} else if( status == 413 ) { /* upload too large */
+		len = sprintf( buffer, "HTTP/1.1 413 Content too large\n\n" );
+	} else if( status == 411 ) { /* upload without length */
+		len = sprintf( buffer, "HTTP/1.1 411 Length required\n\n" );
+	} else if( status == 403 ) { /* path outside root */
+		len = sprintf( buffer, "HTTP/1.1 403 Forbidden\n\n" );
+	} else if( status == 503 ) { /* site over quota */
+		len = sprintf( buffer, "HTTP/1.1 503 Service unavailable\n\n" );
+	} else if( status ) { /* is req valid? */
 		len = sprintf( buffer, "HTTP/1.1 400 Bad request\n\n" );
-		write( fd, buffer, len ); /* if not, send err */
-	} else { /* if so, open file */
-		req++; /* skip leading / */
-		fin = fopen( req, "r" ); /* open file */
-		if( !fin ) { /* check if successful */
-			len = sprintf( buffer, "HTTP/1.1 404 File not found\n\n" );
-			write( fd, buffer, len ); /* if not, send err */
-		} else { /* if so, send file */
-			len = sprintf( buffer, "HTTP/1.1 200 OK\n\n" );/* send success code */
-			write( fd, buffer, len );
-
-			do { /* loop, read & send file */
-				len = fread( buffer, 1, MAX_HTTP_SIZE, fin ); /* read file chunk */
-				if( len < 0 ) { /* check for errors */
-					perror( "Error while writing to client" );
-				} else if( len > 0 ) { /* if none, send chunk */
-					len = write( fd, buffer, len );
-					if( len < 1 ) { /* check for errors */
-						perror( "Error while writing to client" );
-					}
-				}
-			} while( len == MAX_HTTP_SIZE ); /* the last chunk < 8192 */
-			fclose( fin );
+	} else if( options ) { /* what we allow */
+		len = sprintf( buffer, "HTTP/1.1 204 No content\nAllow: GET, HEAD, OPTIONS%s\n\n",
+		               site->upload_limit ? ", PUT, POST" : "" );
+	} else if( admin ) {
+		admin_serve( fd, hreq.path ); /* server's own state */
+	} else { /* if so, hand it off */
+		req = malloc( sizeof( struct request ) + strlen( hreq.path ) + 1 );
+		if( !req ) { /* error check */
+			perror( "Error while allocating memory" );
+			abort();
+		}
+		memset( req, 0, sizeof( struct request ) );
+		req->fd = fd;
+		req->state = up ? REQ_UPLOAD : head ? REQ_HEAD : REQ_OPEN;
+		req->site = site;
+		req->up = up;
+		req->client = client;
+		req->accepted = conn->accepted;
+		strcpy( req->path, hreq.path );
+		req->class = priority_class( req->path );
+		req->trace = trace;
+		slow_event( &req->trace, SLOW_ENQUEUE, req->class );
+
+		if( pool ) {
+			worker_submit( req, req->class );
+		} else {
+			while( serve_quantum( req ) ); /* serve it all now */
 		}
+		return;
 	}
+
+	if( len > 0 ) {
+		write( fd, buffer, len ); /* if not, send err */
+	}
+	PROBE( close, fd, PROBE_PTR( NULL ), 0 );
 	close( fd ); /* close client connectuin*/
+	if( !admin ) { /* answered here, without a worker */
+		slow_event( &trace, SLOW_CLOSE, 0 );
+		slow_record( &trace, site ? hreq.path : NULL, status ? status : 204, 0 );
+		stats_request( conn->accepted, status ? status : 204, 0 );
+	}
+}
+
+
+/* This function accepts all clients waiting to connect and adds them to the
+ *    set of connections being waited on.  New connections are idle: they
+ *    hold no buffer until they send something.
+ * Parameters:
+ *    epfd : the epoll instance to add connections to
+ * Returns: None
+ */
+static void accept_clients( int epfd ) {
+	struct epoll_event ev; /* event registration */
+	int fd; /* client file descriptor */
+
+	for( fd = network_open(); fd >= 0; fd = network_open() ) { /* get clients */
+		PROBE( accept, fd );
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.ptr = conn_new( fd );
+		if( epoll_ctl( epfd, EPOLL_CTL_ADD, fd, &ev ) ) { /* check for errors */
+			perror( "Error while adding client" );
+			conn_free( ev.data.ptr );
+			close( fd );
+		}
+	}
+}
+
+
+/* This function applies a directive of the configuration file.  Rates,
+ *    pacing and priorities go into the settings being built; sites and the
+ *    schedule are fixed at startup, and skipped on a reload.
+ * Parameters:
+ *    argc : # of words of the directive
+ *    argv : words of the directive
+ * Returns: 0 on success, or -1 if the directive is malformed or unknown.
+ */
+static int directive( int argc, char **argv ) {
+	if( !strcmp( argv[0], "site" ) ) { /* a virtual host */
+		return reloading ? 0 : site_add( argc, argv );
+	} else if( !strcmp( argv[0], "rate" ) ) { /* per-client limits */
+		return rate_config( building, argc, argv );
+	} else if( !strcmp( argv[0], "pace" ) ) { /* paced paths */
+		return pace_add( building, argc, argv );
+	} else if( !strcmp( argv[0], "priority" ) ) { /* classes of paths */
+		return priority_add( building, argc, argv );
+	} else if( !strcmp( argv[0], "schedule" ) ) { /* how classes are served */
+		return reloading ? 0 : priority_schedule( argc, argv );
+	}
+	return -1;
+}
+
+
+/* This function reloads the configuration file, when the server is sent
+ *    SIGHUP.  The new settings are built off to the side and replace the
+ *    current ones all at once, and only if the whole file is good;
+ *    otherwise the current ones are kept.
+ * Parameters:
+ *    sig_fd : the signalfd SIGHUP is read from
+ * Returns: None
+ */
+static void reload( int sig_fd ) {
+	struct signalfd_siginfo info; /* signal received */
+	struct settings_stats ss; /* settings counters */
+
+	while( read( sig_fd, &info, sizeof( info ) ) == sizeof( info ) ); /* take them all */
+	if( !config_file ) {
+		printf( "sws: no configuration file to reload\n" );
+		return;
+	}
+
+	building = settings_new();
+	reloading = 1;
+	if( config_load( config_file, directive ) ) {
+		settings_discard( building );
+		printf( "sws: %s not reloaded, keeping the current settings\n", config_file );
+	} else {
+		settings_publish( building );
+		settings_stats( &ss );
+		printf( "sws: %s reloaded, settings generation %llu\n", config_file, ss.generation );
+	}
+	building = NULL;
+	fflush( stdout );
+}
+
+
+/* This function parses an upload sync policy given on the command line.
+ * Parameters:
+ *    str : the policy, one of none, file or full
+ * Returns: The UPLOAD_SYNC_* policy, or -1 if the policy is unknown.
+ */
+static int parse_sync( char *str ) {
+	if( !strcmp( str, "none" ) ) {
+		return UPLOAD_SYNC_NONE;
+	} else if( !strcmp( str, "file" ) ) {
+		return UPLOAD_SYNC_FILE;
+	} else if( !strcmp( str, "full" ) ) {
+		return UPLOAD_SYNC_FULL;
+	}
+	return -1;
+}
+
+
+/* This function switches the server into busy poll mode, for the lowest
+ *    latency at the cost of dedicated CPUs.  The calling thread, which runs
+ *    the main loop, is pinned to the first CPU in the list, and a busy poll
+ *    worker that never sleeps is pinned to each of the others.  The kernel
+ *    is asked to busy poll the server's sockets too.  The main loop itself
+ *    must wait with a timeout of zero.
+ * Parameters:
+ *    list : CPUs to use, as a comma-separated list of numbers and ranges,
+ *           e.g., "2,4-6"
+ * Returns: 0 on success, or -1 if the list is malformed.
+ */
+static int busy_poll_init( char *list ) {
+	cpu_set_t cpus; /* CPU for main loop */
+	int first = -1; /* CPU for main loop */
+	int lo, hi; /* range of CPUs */
+	int len; /* chars parsed */
+
+	while( sscanf( list, "%d%n", &lo, &len ) == 1 ) {
+		list += len;
+		hi = lo;
+		if( ( *list == '-' ) && ( sscanf( list + 1, "%d%n", &hi, &len ) == 1 ) ) {
+			list += len + 1;
+		}
+		for( ; ( lo <= hi ) && ( lo >= 0 ) && ( lo < CPU_SETSIZE ); lo++ ) {
+			if( first < 0 ) { /* first CPU is ours */
+				first = lo;
+			} else {
+				worker_busy( lo );
+			}
+		}
+		if( *list == ',' ) {
+			list++;
+		}
+	}
+	if( ( *list != '\0' ) || ( first < 0 ) ) { /* check for errors */
+		return -1;
+	}
+
+	CPU_ZERO( &cpus );
+	CPU_SET( first, &cpus );
+	pthread_setaffinity_np( pthread_self(), sizeof( cpus ), &cpus );
+	network_busy_poll( BUSY_POLL_USECS );
+	return 0;
 }
 
 
 /* This function is where the program starts running.
  *    The function first parses its command line parameters to determine port #
  *    Then, it initializes, the network and enters the main loop.
- *    The main loop waits for a client (1 or more to connect, and then processes
- *    all clients by calling the seve_client() function for each one.
+ *    The main loop waits for new clients and for requests from connected
+ *    clients, and processes each complete request by calling the
+ *    serve_client() function.
  * Parameters:
  *    argc : number of command line parameters (including program name
  *    argv : array of pointers to command line parameters
  * Returns: an integer status code, 0 for success, something else for error.
  */
 int main( int argc, char **argv ) {
+	struct epoll_event events[MAX_EVENTS]; /* ready descriptors */
+	struct epoll_event ev; /* event registration */
+	struct conn *conn; /* ready client */
 	int port = -1; /* server port # */
-	int fd; /* client file descriptor */
+	int epfd; /* epoll instance */
+	int n; /* # of ready descriptors */
+	int i; /* event index */
+	int rc; /* result of read */
+	int opt; /* command line option */
+	int notify_fd; /* directory change events */
+	int stats_fd; /* stats timer */
+	int tick_fd; /* worker pool timer */
+	int sig_fd; /* SIGHUP, to reload the configuration */
+	sigset_t hup; /* just SIGHUP */
+	int inherited; /* was a listening socket passed in? */
+	int bad = 0; /* bad option? */
+
+	stats_launched(); /* time startup */
 
 	/* check for and process parameters */
-	if( ( argc < 2 ) || ( sscanf( argv[1], "%d", &port ) < 1 ) ) {
-		printf( "usage: sms <port>\n" );
+	while( ( opt = getopt( argc, argv, "H:w:b:c:zu:F:f:" ) ) != -1 ) {
+		if( ( opt == 'H' ) && !config_size( optarg, &header_limit ) ) {
+			continue; /* request size limit */
+		} else if( ( opt == 'c' ) && !config_size( optarg, &cache_size ) ) {
+			continue; /* bytes of files to cache */
+		} else if( ( opt == 'u' ) && !config_size( optarg, &upload_limit ) ) {
+			continue; /* largest upload */
+		} else if( ( opt == 'F' ) && ( ( upload_sync = parse_sync( optarg ) ) >= 0 ) ) {
+			continue; /* upload sync policy */
+		} else if( opt == 'f' ) {
+			config_file = optarg; /* sites and such */
+			continue;
+		} else if( opt == 'z' ) {
+			zerocopy = 1; /* zero-copy sends from cache */
+			continue;
+		} else if( ( opt == 'w' ) && ( sscanf( optarg, "%d:%d", &workers, &max_workers ) >= 1 ) ) {
+			continue; /* # of worker threads, or fewest:most */
+		} else if( opt == 'b' ) {
+			busy_cpus = optarg; /* busy poll mode */
+			continue;
+		}
+		bad = 1; /* bad option, show usage */
+		break;
+	}
+	port = network_inherit(); /* listening socket passed in, if any */
+	inherited = port >= 0;
+	if( bad ||
+	    ( !inherited && ( ( optind >= argc ) || ( sscanf( argv[optind], "%d", &port ) < 1 ) ) ) ||
+	    ( ( max_workers >= 0 ) && ( ( workers < 1 ) || ( max_workers < workers ) ) ) ) {
+		printf( "usage: sws [-H header_limit] [-w workers|min:max] [-b cpus] [-c cache_size] [-z]\n"
+		        "           [-u upload_limit] [-F none|file|full] [-f config] <port>\n"
+		        "       the port may be left out if a listening socket is passed in by LISTEN_FDS\n" );
 		return 0;
 	}
 
-	network_init( port ); /* init network module */
+	if( workers < 0 ) { /* default, one per CPU */
+		workers = sysconf( _SC_NPROCESSORS_ONLN );
+	}
+	sigemptyset( &hup ); /* taken by the main loop, so no thread may get it */
+	sigaddset( &hup, SIGHUP );
+	pthread_sigmask( SIG_BLOCK, &hup, NULL );
+	site_init( cache_size, upload_limit ); /* the default site */
+	upload_init( upload_sync );
+	building = settings_new();
+	if( config_file && config_load( config_file, directive ) ) {
+		return 1;
+	}
+	settings_publish( building );
+	building = NULL;
+	site_index(); /* all sites known, build host table */
+	pool = ( workers > 0 ) || busy_cpus;
+	if( pool ) {
+		worker_init( workers, serve_quantum, priority_weights() ); /* start workers */
+	}
+	if( !inherited ) {
+		network_init( port ); /* init network module */
+	}
+	if( busy_cpus && busy_poll_init( busy_cpus ) ) {
+		printf( "sws: bad CPU list for -b: %s\n", busy_cpus );
+		return 1;
+	}
 
+	epfd = epoll_create1( 0 ); /* watch server socket */
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if( ( epfd < 0 ) || epoll_ctl( epfd, EPOLL_CTL_ADD, network_socket(), &ev ) ) {
+		perror( "Error while creating epoll instance" );
+		abort();
+	}
+	notify_fd = listing_init(); /* watch listed directories */
+	ev.data.ptr = &dir_changes;
+	if( ( notify_fd >= 0 ) && epoll_ctl( epfd, EPOLL_CTL_ADD, notify_fd, &ev ) ) {
+		perror( "Error while watching directories" );
+		abort();
+	}
+	held_fd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC ); /* put aside */
+	ev.data.ptr = &held_ticks;
+	if( ( held_fd < 0 ) || epoll_ctl( epfd, EPOLL_CTL_ADD, held_fd, &ev ) ) {
+		perror( "Error while watching requests put aside" );
+		abort();
+	}
+	held_epfd = epoll_create1( EPOLL_CLOEXEC ); /* their sockets */
+	ev.data.ptr = &held_reads;
+	if( ( held_epfd < 0 ) || epoll_ctl( epfd, EPOLL_CTL_ADD, held_epfd, &ev ) ) {
+		perror( "Error while watching requests put aside" );
+		abort();
+	}
+	sig_fd = signalfd( -1, &hup, SFD_NONBLOCK | SFD_CLOEXEC ); /* reload on SIGHUP */
+	ev.data.ptr = &hangups;
+	if( ( sig_fd < 0 ) || epoll_ctl( epfd, EPOLL_CTL_ADD, sig_fd, &ev ) ) {
+		perror( "Error while watching for SIGHUP" );
+		abort();
+	}
+	stats_fd = stats_open( port ); /* publish counters */
+	ev.data.ptr = &stats_ticks;
+	if( ( stats_fd >= 0 ) && epoll_ctl( epfd, EPOLL_CTL_ADD, stats_fd, &ev ) ) {
+		perror( "Error while watching stats timer" );
+		abort();
+	}
+	if( pool && ( max_workers > workers ) ) { /* scale the pool to the load */
+		tick_fd = worker_scale( max_workers );
+		ev.data.ptr = &worker_ticks;
+		if( epoll_ctl( epfd, EPOLL_CTL_ADD, tick_fd, &ev ) ) {
+			perror( "Error while watching worker timer" );
+			abort();
+		}
+	}
+
+	stats_ready();
 	for( ;; ) { /* main loop */
-		network_wait(); /* wait for clients */
+		n = epoll_wait( epfd, events, MAX_EVENTS, busy_cpus ? 0 : -1 ); /* wait for clients */
+		if( ( n < 0 ) && ( errno != EINTR ) ) { /* check for errors */
+			perror( "Error occurred while waiting" );
+			abort();
+		}
 
-		for( fd = network_open(); fd >= 0; fd = network_open() ) { /* get clients */
-			serve_client( fd ); /* process each client */
+		for( i = 0; i < n; i++ ) {
+			conn = events[i].data.ptr;
+			if( !conn ) { /* new clients */
+				accept_clients( epfd );
+				continue;
+			} else if( events[i].data.ptr == &dir_changes ) { /* drop stale listings */
+				listing_events();
+				continue;
+			} else if( events[i].data.ptr == &held_ticks ) { /* resume requests */
+				release_requests();
+				continue;
+			} else if( events[i].data.ptr == &held_reads ) { /* resume uploads */
+				wake_requests();
+				continue;
+			} else if( events[i].data.ptr == &stats_ticks ) { /* publish gauges */
+				stats_publish();
+				continue;
+			} else if( events[i].data.ptr == &worker_ticks ) { /* resize worker pool */
+				worker_tick();
+				continue;
+			} else if( events[i].data.ptr == &hangups ) { /* reload settings */
+				reload( sig_fd );
+				continue;
+			}
+
+			rc = conn_read( conn, header_limit ); /* read req from client */
+			if( rc != 0 ) { /* request done or client gone */
+				epoll_ctl( epfd, EPOLL_CTL_DEL, conn->fd, NULL );
+				if( rc > 0 ) {
+					serve_client( conn ); /* process request */
+				} else {
+					close( conn->fd );
+				}
+				conn_free( conn );
+			}
+		}
+		if( pool ) {
+			worker_flush(); /* wake workers for this batch */
 		}
+		settings_reclaim(); /* free settings no longer read */
 	}
 }
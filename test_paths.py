@@ -0,0 +1,116 @@
+#!/usr/bin/python3
+
+
+#######################################
+#
+#  test_paths.py checks that the webserver keeps requests inside the root
+#  of the site they are for, whatever their method.
+#
+#  It starts ./sws, with uploads on, in a scratch directory, sends each
+#  request in the table below, and checks the status that comes back and
+#  that nothing was written outside the scratch directory.  To run it, use
+#  the command:
+#
+#  ./test_paths.py
+#
+#  or make test.  It prints one line per request and exits with 1 if any
+#  of them failed.
+#
+#######################################
+
+import os
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+SWS = os.path.join( os.path.dirname( os.path.abspath( sys.argv[0] ) ), "sws" )
+
+
+# Send a request and return the status code of the response
+def request( port, method, path, body = b"" ):
+  s = socket.create_connection( ( "127.0.0.1", port ) )
+  head = "%s %s HTTP/1.1\r\nHost: localhost\r\n" % ( method, path )
+  if method in ( "PUT", "POST" ):
+    head += "Content-Length: %d\r\n" % len( body )
+  s.sendall( head.encode() + b"\r\n" + body )
+  data = b""
+  while True:
+    got = s.recv( 65536 )
+    if not got:
+      break
+    data += got
+  s.close()
+  return int( data.split()[1] ) if data.startswith( b"HTTP/" ) else 0
+
+
+# Find a port nobody is listening on
+def free_port():
+  s = socket.socket()
+  s.bind( ( "127.0.0.1", 0 ) )
+  port = s.getsockname()[1]
+  s.close()
+  return port
+
+
+def main():
+  outside = tempfile.mkdtemp( prefix = "sws-outside-" )
+  root = tempfile.mkdtemp( prefix = "sws-root-" )
+  name = os.path.basename( outside )
+  with open( os.path.join( outside, "secret.txt" ), "w" ) as f:
+    f.write( "secret\n" )
+  with open( os.path.join( root, "a.txt" ), "w" ) as f:
+    f.write( "a\n" )
+
+  # method, path, expected status, file that must not be created
+  tests = [
+    ( "GET", "/a.txt", 200, None ),
+    ( "PUT", "/new.txt", 201, None ),
+    ( "PUT", "/" + outside + "/pwned.txt", 403, outside + "/pwned.txt" ),
+    ( "PUT", "/../" + name + "/pwned.txt", 403, outside + "/pwned.txt" ),
+    ( "PUT", "/sub/../../" + name + "/pwned.txt", 403, outside + "/pwned.txt" ),
+    ( "POST", "/./x.txt", 403, None ),
+    ( "GET", "/" + outside + "/secret.txt", 403, None ),
+    ( "HEAD", "/" + outside + "/secret.txt", 403, None ),
+    ( "GET", "/../" + name + "/secret.txt", 403, None ),
+    ( "HEAD", "/../" + name + "/secret.txt", 403, None ),
+    ( "GET", "//etc/hostname", 403, None ),
+    ( "GET", "/a.txt/../a.txt", 403, None ),
+    ( "OPTIONS", "//etc", 403, None ),
+    ( "GET", "/a%2etxt", 200, None ),
+    ( "GET", "/%2e%2e/" + name + "/secret.txt", 403, None ),
+    ( "GET", "/%2F" + outside.lstrip( "/" ) + "/secret.txt", 403, None ),
+    ( "PUT", "/%2E%2E/" + name + "/pwned.txt", 403, outside + "/pwned.txt" ),
+    ( "GET", "/a.txt%00", 400, None ),
+  ]
+
+  port = free_port()
+  server = subprocess.Popen( [ SWS, "-u", "1M", "-w", "2", str( port ) ], cwd = root,
+                             stdout = subprocess.DEVNULL )
+  failed = 0
+  try:
+    for i in range( 100 ): # wait for it to listen
+      try:
+        socket.create_connection( ( "127.0.0.1", port ) ).close()
+        break
+      except OSError:
+        time.sleep( 0.05 )
+
+    for method, path, expect, created in tests:
+      status = request( port, method, path, b"pwned" )
+      bad = ( status != expect ) or bool( created and os.path.exists( created ) )
+      failed += bad
+      print( "%s %-7s %-50s %d (expected %d)" % ( "FAIL" if bad else "ok  ", method, path[:50],
+                                                   status, expect ) )
+  finally:
+    server.kill()
+    server.wait()
+    shutil.rmtree( outside )
+    shutil.rmtree( root )
+  return 1 if failed else 0
+
+
+if __name__ == "__main__":
+  sys.exit( main() )
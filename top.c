@@ -0,0 +1,286 @@
+/*
+ * File: top.c
+ * Author: agent
+ * Purpose: This file contains sws-top, a live monitor for the web server.
+ *          It maps the stats segment of the server on a port read only (see
+ *          stats.h) and, every interval, shows the requests and bytes a
+ *          second, the error rate, the response time percentiles over the
+ *          interval, the depth of the run queues and how long requests wait
+ *          on them, the size of the worker pool and how often it was
+ *          resized, and how often the cache was hit.  Reading the segment
+ *          takes nothing from the server: there are no requests to answer
+ *          and no locks to take.
+ *
+ *          The screen is redrawn in place unless -n is given, in which
+ *          case that many readings are printed one after another, e.g.,
+ *          for a log.  A server whose gauges have not been published for
+ *          a while, because its event loop is stuck, is marked as not
+ *          publishing, and sws-top ends once the server has exited.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "hist.h"
+#include "stats.h"
+#include "util.h"
+
+#define NAME_MAX_LEN 32 /* room for a segment's name */
+#define FIELD_MAX 32 /* room for a formatted number */
+#define SPINS 1000 /* reads of a slot before giving up on it for now */
+#define STALE_PERIODS 4 /* gauges this many periods old mean a server is stuck */
+
+/* The server's totals at one moment. */
+struct reading {
+	long long time;        /* when read, ns on the monotonic clock */
+	int threads;           /* # of slots in use */
+	uint64_t requests;     /* # of requests finished */
+	uint64_t errors;       /* # of those that failed */
+	uint64_t bytes;        /* bytes of body sent */
+	struct hist latency;   /* response times */
+	struct stats_gauges g; /* gauges */
+};
+
+static const struct stats_segment *seg; /* server's segment */
+static struct stats_slot copy; /* slot being read */
+static struct reading readings[2]; /* last reading and the one before */
+
+
+/* This function copies a sequence locked part of the segment, trying
+ *    again while it is being written.
+ * Parameters:
+ *    dst  : where to copy it
+ *    src  : the part of the segment, starting with its sequence lock
+ *    size : its size
+ * Returns: 0 on success, or -1 if the writer kept getting in the way.
+ */
+static int read_locked( void *dst, const void *src, size_t size ) {
+	const atomic_uint *seq = src; /* sequence lock */
+	unsigned before; /* sequence before copying */
+	int i; /* tries */
+
+	for( i = 0; i < SPINS; i++ ) {
+		before = atomic_load_explicit( seq, memory_order_acquire );
+		if( before & 1 ) { /* being written */
+			continue;
+		}
+		memcpy( dst, src, size );
+		atomic_thread_fence( memory_order_acquire ); /* copy before checking */
+		if( atomic_load_explicit( seq, memory_order_relaxed ) == before ) {
+			return 0;
+		}
+	}
+	return -1;
+}
+
+
+/* This function reads the segment, adding up the slots.  If a slot cannot
+ *    be read, e.g., because the server died while writing it, the last
+ *    reading is kept, so the totals never go backwards.
+ * Parameters:
+ *    r    : the reading to fill in
+ *    last : the reading before, or NULL if there is none
+ * Returns: None
+ */
+static void take_reading( struct reading *r, const struct reading *last ) {
+	int failed = 0; /* was a slot skipped? */
+	int i; /* slot index */
+
+	r->threads = atomic_load( &seg->threads );
+	if( r->threads > STATS_THREADS ) {
+		r->threads = STATS_THREADS;
+	}
+	r->requests = r->errors = r->bytes = 0;
+	hist_init( &r->latency );
+	for( i = 0; i < r->threads; i++ ) {
+		if( read_locked( &copy, &seg->slots[i], sizeof( copy ) ) ) {
+			failed = 1;
+			continue;
+		}
+		r->requests += copy.requests;
+		r->errors += copy.errors;
+		r->bytes += copy.bytes;
+		hist_merge( &r->latency, &copy.latency );
+	}
+	failed |= read_locked( &r->g, &seg->gauges, sizeof( r->g ) );
+	if( failed && last ) {
+		*r = *last;
+	}
+	r->time = util_now_ns();
+}
+
+
+/* This function formats a time for display.
+ * Parameters:
+ *    buf : buffer of FIELD_MAX bytes
+ *    ns  : the time, in ns
+ * Returns: buf
+ */
+static char *fmt_time( char *buf, double ns ) {
+	if( ns < 1e3 ) {
+		snprintf( buf, FIELD_MAX, "%.0f ns", ns );
+	} else if( ns < 1e6 ) {
+		snprintf( buf, FIELD_MAX, "%.1f us", ns / 1e3 );
+	} else if( ns < 1e9 ) {
+		snprintf( buf, FIELD_MAX, "%.2f ms", ns / 1e6 );
+	} else {
+		snprintf( buf, FIELD_MAX, "%.2f s", ns / 1e9 );
+	}
+	return buf;
+}
+
+
+/* This function formats a number of bytes for display.
+ * Parameters:
+ *    buf   : buffer of FIELD_MAX bytes
+ *    bytes : the number of bytes
+ * Returns: buf
+ */
+static char *fmt_bytes( char *buf, double bytes ) {
+	static const char *units[] = { "B", "KB", "MB", "GB", "TB" };
+	int u = 0; /* unit index */
+
+	while( ( bytes >= 1024 ) && ( u < 4 ) ) {
+		bytes /= 1024;
+		u++;
+	}
+	snprintf( buf, FIELD_MAX, u ? "%.1f %s" : "%.0f %s", bytes, units[u] );
+	return buf;
+}
+
+
+/* This function shows the change from one reading to the next.  The
+ *    response times are those of the requests finished in between, found
+ *    by taking the earlier histogram from the later.
+ * Parameters:
+ *    port : the server's port
+ *    last : the earlier reading
+ *    r    : the later reading
+ * Returns: None
+ */
+static void show( int port, const struct reading *last, struct reading *r ) {
+	struct hist *h = &r->latency; /* interval's response times */
+	char f[5][FIELD_MAX]; /* formatted fields */
+	double secs = ( r->time - last->time ) / 1e9; /* length of interval */
+	uint64_t lookups; /* cache lookups in the interval */
+	uint64_t hits; /* ... that hit */
+	int i; /* bucket index */
+
+	lookups = r->g.cache_hits + r->g.cache_misses + r->g.cache_uncached -
+	          last->g.cache_hits - last->g.cache_misses - last->g.cache_uncached;
+	hits = r->g.cache_hits - last->g.cache_hits;
+	printf( "sws-top: port %d, pid %lld, up %s, %d threads serving%s\n", port,
+	        (long long)seg->pid, fmt_time( f[0], r->time - seg->start ), r->threads,
+	        r->time - (long long)r->g.time > STALE_PERIODS * STATS_PERIOD_MS * 1000000LL ?
+	        ", not publishing" : "" );
+	printf( "requests    %10.1f/s   errors %.1f/s   sent %s/s\n",
+	        ( r->requests - last->requests ) / secs, ( r->errors - last->errors ) / secs,
+	        fmt_bytes( f[0], ( r->bytes - last->bytes ) / secs ) );
+	printf( "connections %10.1f/s   open %llu\n", ( r->g.accepted - last->g.accepted ) / secs,
+	        (unsigned long long)r->g.conns );
+	printf( "run queues  %10llu     high %llu   normal %llu   low %llu   delay %s\n",
+	        (unsigned long long)r->g.depth, (unsigned long long)r->g.class_depth[0],
+	        (unsigned long long)r->g.class_depth[1], (unsigned long long)r->g.class_depth[2],
+	        fmt_time( f[0], r->g.queue_delay ) );
+	printf( "workers     %10llu     resized %llu times, %llu in this interval\n",
+	        (unsigned long long)r->g.workers, (unsigned long long)r->g.worker_resizes,
+	        (unsigned long long)( r->g.worker_resizes - last->g.worker_resizes ) );
+	printf( "cache       %9.1f%%     hits of %.1f lookups/s   %llu entries   %s\n",
+	        lookups ? 100.0 * hits / lookups : 0, lookups / secs,
+	        (unsigned long long)r->g.cache_entries, fmt_bytes( f[0], r->g.cache_bytes ) );
+
+	for( i = 0; i < HIST_BUCKETS; i++ ) { /* interval only, in place */
+		h->counts[i] -= last->latency.counts[i];
+	}
+	h->count -= last->latency.count;
+	h->sum -= last->latency.sum;
+	printf( "latency     p50 %s   p90 %s   p99 %s   p99.9 %s   mean %s\n",
+	        fmt_time( f[0], hist_percentile( h, 50 ) ), fmt_time( f[1], hist_percentile( h, 90 ) ),
+	        fmt_time( f[2], hist_percentile( h, 99 ) ), fmt_time( f[3], hist_percentile( h, 99.9 ) ),
+	        fmt_time( f[4], hist_mean( h ) ) );
+	for( i = 0; i < HIST_BUCKETS; i++ ) { /* back to totals, for the next interval */
+		h->counts[i] += last->latency.counts[i];
+	}
+	h->count += last->latency.count;
+	h->sum += last->latency.sum;
+}
+
+
+/* This function is where the program starts running.  It maps the
+ *    server's segment, checks that its layout is the one known here, and
+ *    shows a reading every interval until the server goes away.
+ * Parameters:
+ *    argc : number of command line parameters (including program name
+ *    argv : array of pointers to command line parameters
+ * Returns: an integer status code, 0 for success, something else for error.
+ */
+int main( int argc, char **argv ) {
+	struct timespec pause; /* time between readings */
+	char name[NAME_MAX_LEN]; /* segment's name */
+	double interval = 1; /* seconds between readings */
+	int count = 0; /* readings to print, 0 to redraw forever */
+	int port = -1; /* server's port */
+	int cur = 0; /* index of latest reading */
+	int opt; /* command line option */
+	int fd; /* shared memory object */
+	int i; /* reading # */
+
+	while( ( opt = getopt( argc, argv, "i:n:" ) ) != -1 ) {
+		if( ( opt == 'i' ) && ( sscanf( optarg, "%lf", &interval ) == 1 ) && ( interval > 0 ) ) {
+			continue; /* seconds between readings */
+		} else if( ( opt == 'n' ) && ( sscanf( optarg, "%d", &count ) == 1 ) && ( count > 0 ) ) {
+			continue; /* readings to print */
+		}
+		optind = argc; /* bad option, show usage */
+		break;
+	}
+	if( ( optind != argc - 1 ) || ( sscanf( argv[optind], "%d", &port ) < 1 ) ) {
+		printf( "usage: sws-top [-i interval_secs] [-n count] <port>\n" );
+		return 1;
+	}
+
+	snprintf( name, NAME_MAX_LEN, STATS_NAME, port );
+	fd = shm_open( name, O_RDONLY, 0 );
+	if( fd < 0 ) {
+		printf( "sws-top: no server publishing stats on port %d\n", port );
+		return 1;
+	}
+	seg = mmap( NULL, sizeof( struct stats_segment ), PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if( seg == MAP_FAILED ) {
+		perror( "Error while mapping stats segment" );
+		return 1;
+	} else if( ( seg->magic != STATS_MAGIC ) || ( seg->version != STATS_VERSION ) ||
+	           ( seg->size != sizeof( struct stats_segment ) ) ) {
+		printf( "sws-top: stats segment of port %d is from another version of sws\n", port );
+		return 1;
+	}
+
+	pause.tv_sec = (time_t)interval;
+	pause.tv_nsec = (long)( ( interval - pause.tv_sec ) * 1e9 );
+	take_reading( &readings[cur], NULL );
+	for( i = 0; !count || ( i < count ); i++ ) {
+		nanosleep( &pause, NULL );
+		if( kill( seg->pid, 0 ) && ( errno == ESRCH ) ) {
+			printf( "sws-top: server on port %d has exited\n", port );
+			return 1;
+		}
+		cur = !cur;
+		take_reading( &readings[cur], &readings[!cur] );
+		if( !count ) {
+			printf( "\033[H\033[J" ); /* redraw from the top */
+		} else if( i ) {
+			printf( "\n" );
+		}
+		show( port, &readings[!cur], &readings[cur] );
+		fflush( stdout );
+	}
+	return 0;
+}
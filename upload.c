@@ -0,0 +1,423 @@
+/*
+ * File: upload.c
+ * Author: agent
+ * Purpose: This file contains the upload module, which stores files sent to
+ *         the server with PUT or POST.
+ *         Please see upload.h for documentation on how to use this module.
+ */
+
+#define _GNU_SOURCE /* for splice() and pipe2() */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "http.h"
+#include "meta.h"
+#include "upload.h"
+#include "util.h"
+
+#define UPLOAD_CHUNK 65536 /* most bytes moved per splice(), a pipe's worth */
+#define UPLOAD_QUANTUM 65536 /* most bytes received per quantum */
+#define UPLOAD_TIMEOUT_NS 10000000000LL /* ns of waiting before giving up */
+#define UPLOAD_RESPONSE 64 /* size of response buffer */
+#define TEMP_NAME_MAX 48 /* room for a temporary file name */
+#define TEMP_TRIES 16 /* names to try before giving up */
+
+/* An upload in progress. */
+struct upload {
+	struct site *site; /* site upload is for */
+	int fd;            /* client connection */
+	int file;          /* temporary file, -1 until created */
+	int pipe[2];       /* pipe the body passes through */
+	int stored;        /* renamed into place? */
+	long long expiry;  /* when it stops waiting for the body, ns */
+	int status;        /* status answered with, 0 until finished */
+	long long length;  /* bytes of body */
+	long long left;    /* bytes of body still to receive */
+	size_t head_len;   /* bytes of body read with the headers */
+	char *head;        /* those bytes */
+	char *tmp;         /* path of temporary file */
+	char path[];       /* path of target */
+};
+
+static int sync_policy = UPLOAD_SYNC_FILE; /* UPLOAD_SYNC_* */
+static atomic_size_t temp_seq; /* numbers temporary files */
+
+static atomic_size_t started; /* counters for upload_stats() */
+static atomic_size_t completed;
+static atomic_size_t failed;
+static atomic_size_t bytes;
+static atomic_size_t spliced;
+
+
+/* This function maps the errno of a failed file operation to a status.
+ * Parameters:
+ *    err : the errno
+ * Returns: The HTTP status code.
+ */
+static int error_status( int err ) {
+	if( ( err == ENOENT ) || ( err == ENOTDIR ) ) {
+		return 404;
+	} else if( ( err == EACCES ) || ( err == EPERM ) || ( err == EROFS ) || ( err == EISDIR ) ) {
+		return 403;
+	}
+	return 500;
+}
+
+
+/* This function returns the reason phrase of a status.
+ * Parameters:
+ *    status : the HTTP status code
+ * Returns: The reason phrase.
+ */
+static const char *reason( int status ) {
+	switch( status ) {
+	case 200: return "OK";
+	case 201: return "Created";
+	case 403: return "Forbidden";
+	case 404: return "File not found";
+	case 408: return "Request timeout";
+	case 500: return "Internal server error";
+	default: return "Bad request";
+	}
+}
+
+
+/* This function creates the temporary file and the pipe for an upload,
+ *    and writes the start of the body that came with the headers.
+ * Parameters:
+ *    up : the upload
+ * Returns: 0 on success, or the HTTP status code to fail the upload with.
+ */
+static int upload_open( struct upload *up ) {
+	size_t done = 0; /* bytes written */
+	ssize_t len; /* length of data written */
+	char *name = strchr( up->tmp, '\0' ); /* where name goes */
+	int i; /* names tried */
+
+	for( i = 0; ( up->file < 0 ) && ( i < TEMP_TRIES ); i++ ) { /* pick a name */
+		sprintf( name, ".sws-upload-%d-%zu", (int)getpid(), atomic_fetch_add( &temp_seq, 1 ) );
+		up->file = openat( up->site->dir, up->tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644 );
+		if( ( up->file < 0 ) && ( errno != EEXIST ) ) {
+			break;
+		}
+	}
+	if( up->file < 0 ) {
+		return error_status( errno );
+	}
+	if( pipe2( up->pipe, O_CLOEXEC ) ) {
+		up->pipe[0] = up->pipe[1] = -1;
+		return 500;
+	}
+
+	while( done < up->head_len ) {
+		len = write( up->file, up->head + done, up->head_len - done );
+		if( ( len < 0 ) && ( errno == EINTR ) ) {
+			continue;
+		} else if( len < 0 ) {
+			return error_status( errno );
+		}
+		done += len;
+	}
+	free( up->head ); /* no longer needed */
+	up->head = NULL;
+	return 0;
+}
+
+
+/* This function moves bytes that were spliced into the pipe on into the
+ *    temporary file.
+ * Parameters:
+ *    up  : the upload
+ *    len : the number of bytes in the pipe
+ * Returns: 0 on success, or -1 if the file could not be written.
+ */
+static int upload_drain( struct upload *up, ssize_t len ) {
+	ssize_t moved; /* bytes moved */
+
+	while( len > 0 ) {
+		moved = splice( up->pipe[0], NULL, up->file, NULL, len, SPLICE_F_MOVE );
+		if( ( moved < 0 ) && ( errno == EINTR ) ) {
+			continue;
+		} else if( moved <= 0 ) {
+			return -1;
+		}
+		len -= moved;
+	}
+	return 0;
+}
+
+
+/* This function puts an upload whose whole body has arrived into place:
+ *    the temporary file is synced according to the policy and renamed over
+ *    the target, and the target is dropped from the site's cache and header
+ *    cache.
+ * Parameters:
+ *    up : the upload
+ * Returns: 201 if the target is new, 200 if it was replaced, or the HTTP
+ *          status code to fail the upload with.
+ */
+static int upload_store( struct upload *up ) {
+	struct stat st; /* status of old target */
+	char *slash; /* end of directory */
+	int existed; /* did the target exist? */
+	int dir; /* directory of target */
+
+	if( ( sync_policy >= UPLOAD_SYNC_FILE ) && fsync( up->file ) ) {
+		return 500;
+	}
+	existed = !fstatat( up->site->dir, up->path, &st, 0 );
+	if( renameat( up->site->dir, up->tmp, up->site->dir, up->path ) ) {
+		return error_status( errno );
+	}
+	up->stored = 1;
+
+	if( sync_policy >= UPLOAD_SYNC_FULL ) { /* make the rename durable too */
+		slash = strrchr( up->tmp, '/' );
+		if( slash ) {
+			*slash = '\0';
+		}
+		dir = openat( up->site->dir, slash ? up->tmp : ".", O_RDONLY | O_DIRECTORY );
+		if( dir >= 0 ) {
+			fsync( dir );
+			close( dir );
+		}
+	}
+
+	cache_invalidate( up->site->cache, up->path );
+	meta_invalidate( up->site->dir, up->path );
+	return existed ? 200 : 201;
+}
+
+
+/* This function ends an upload, storing it if there was no error, and
+ *    sends the response to the client.
+ * Parameters:
+ *    up     : the upload
+ *    status : 0 if the whole body has arrived, else the HTTP status code to
+ *             fail the upload with
+ * Returns: 0, for upload_step() to return.
+ */
+static int upload_finish( struct upload *up, int status ) {
+	char buffer[UPLOAD_RESPONSE]; /* response */
+	int len; /* length of response */
+
+	if( !status ) {
+		status = upload_store( up );
+	}
+	if( up->stored ) {
+		atomic_fetch_add( &completed, 1 );
+		atomic_fetch_add( &bytes, up->length );
+	} else {
+		atomic_fetch_add( &failed, 1 );
+	}
+	up->status = status;
+
+	len = sprintf( buffer, "HTTP/1.1 %d %s\n\n", status, reason( status ) );
+	send( up->fd, buffer, len, MSG_NOSIGNAL ); /* client may be gone */
+	return 0;
+}
+
+
+/* This function sets the sync policy of uploads.  Until it is called, the
+ *    policy is UPLOAD_SYNC_FILE.
+ * Parameters:
+ *    sync : UPLOAD_SYNC_NONE, UPLOAD_SYNC_FILE or UPLOAD_SYNC_FULL
+ * Returns: None
+ */
+extern void upload_init( int sync ) {
+	sync_policy = sync;
+}
+
+
+/* This function decides whether an upload may go ahead.
+ * Parameters:
+ *    site   : the site the upload is for
+ *    path   : the requested path, with leading /
+ *    length : the Content-Length of the body, -1 if not given
+ * Returns: 0 if it may, or the HTTP status code to refuse it with: 400 if
+ *          the site does not take uploads, 403 if the path is not a file
+ *          or leaves the site's root (see http_path_safe()), 411 if there
+ *          is no length, or 413 if the body is too large.
+ */
+extern int upload_check( struct site *site, const char *path, long long length ) {
+	if( !site->upload_limit ) {
+		return 400;
+	} else if( !http_path_safe( path ) || ( path[strlen( path ) - 1] == '/' ) ) {
+		return 403; /* not a file name, or outside the site's root */
+	} else if( length < 0 ) { /* e.g., chunked */
+		return 411;
+	} else if( (unsigned long long)length > site->upload_limit ) {
+		return 413;
+	}
+	return 0;
+}
+
+
+/* This function starts an upload that upload_check() allowed, copying the
+ *    start of the body out of the request's buffers.  The socket must be
+ *    non-blocking.  This function will abort the program if memory cannot
+ *    be allocated.
+ * Parameters:
+ *    fd     : the file descriptor to the client connection
+ *    site   : the site the upload is for
+ *    path   : the requested path, with leading /
+ *    length : the Content-Length of the body
+ *    chain  : the buffers holding the request
+ *    off    : offset of the body within the chain
+ * Returns: The upload.
+ */
+extern struct upload *upload_new( int fd, struct site *site, const char *path,
+                                  long long length, struct buffer *chain, size_t off ) {
+	struct upload *up; /* new upload */
+	size_t len = strlen( ++path ); /* length of path, without leading / */
+	char *slash = strrchr( path, '/' ); /* end of directory */
+	size_t dir_len = slash ? slash - path + 1 : 0; /* length of directory */
+	size_t head_len; /* bytes of body already read */
+
+	/* the read that completed the headers was into a single buffer, so
+	 * no more than a buffer of the body can have come with them */
+	head_len = length < BUFFER_SIZE ? length : BUFFER_SIZE;
+	up = malloc( sizeof( struct upload ) + len + 1 );
+	if( up ) {
+		up->tmp = malloc( dir_len + TEMP_NAME_MAX );
+		up->head = malloc( head_len + 1 );
+	}
+	if( !up || !up->tmp || !up->head ) { /* error check */
+		perror( "Error while allocating memory" );
+		abort();
+	}
+
+	up->site = site;
+	up->fd = fd;
+	up->file = -1;
+	up->pipe[0] = up->pipe[1] = -1;
+	up->stored = 0;
+	up->expiry = util_now_ns() + UPLOAD_TIMEOUT_NS;
+	up->status = 0;
+	strcpy( up->path, path );
+	memcpy( up->tmp, path, dir_len ); /* name is added when file is created */
+	up->tmp[dir_len] = '\0';
+
+	up->head_len = buffer_copy( chain, off, up->head, head_len );
+	up->length = length;
+	up->left = length - up->head_len;
+
+	atomic_fetch_add( &started, 1 );
+	return up;
+}
+
+
+/* This function receives the next piece of an upload, without waiting for
+ *    it.  Once the whole body is in, or the upload fails, the response is
+ *    sent to the client.  The connection is not closed.
+ * Parameters:
+ *    up   : the upload
+ *    wait : if nothing more has arrived, set to the ns until the upload
+ *           times out
+ * Returns: 1 if there is more to receive, 0 if the upload is finished.  If
+ *          *wait was set, the caller is to call again once the socket is
+ *          readable, or once *wait ns have passed.
+ */
+extern int upload_step( struct upload *up, long long *wait ) {
+	size_t moved = 0; /* bytes moved this quantum */
+	ssize_t len = 0; /* bytes spliced */
+	int status; /* result of open */
+	long long now; /* current time */
+
+	if( up->file < 0 ) { /* 1st quantum, create file */
+		status = upload_open( up );
+		if( status ) {
+			return upload_finish( up, status );
+		}
+	}
+
+	while( ( up->left > 0 ) && ( moved < UPLOAD_QUANTUM ) ) {
+		len = splice( up->fd, NULL, up->pipe[1], NULL,
+		              up->left < UPLOAD_CHUNK ? up->left : UPLOAD_CHUNK,
+		              SPLICE_F_MOVE | SPLICE_F_NONBLOCK );
+		if( ( len < 0 ) && ( errno == EINTR ) ) {
+			continue;
+		} else if( ( len < 0 ) && ( errno == EAGAIN ) ) { /* nothing more yet */
+			break;
+		} else if( len <= 0 ) { /* client gone before the end */
+			return upload_finish( up, 400 );
+		}
+
+		if( upload_drain( up, len ) ) {
+			return upload_finish( up, 500 );
+		}
+		atomic_fetch_add_explicit( &spliced, len, memory_order_relaxed );
+		up->left -= len;
+		moved += len;
+	}
+
+	if( up->left == 0 ) {
+		return upload_finish( up, 0 );
+	}
+	now = util_now_ns();
+	if( moved > 0 ) { /* client still sending, start the timeout again */
+		up->expiry = now + UPLOAD_TIMEOUT_NS;
+	} else if( now >= up->expiry ) { /* waited too long */
+		return upload_finish( up, 408 );
+	}
+	if( len < 0 ) { /* wait for more, but no longer than the timeout */
+		*wait = up->expiry - now;
+	}
+	return 1;
+}
+
+
+/* This function gets the status a finished upload was answered with.
+ * Parameters:
+ *    up : the upload
+ * Returns: The HTTP status code, or 0 if the upload is not finished.
+ */
+extern int upload_status( const struct upload *up ) {
+	return up->status;
+}
+
+
+/* This function frees an upload, removing its temporary file if it was not
+ *    stored.
+ * Parameters:
+ *    up : the upload
+ * Returns: None
+ */
+extern void upload_free( struct upload *up ) {
+	if( up->pipe[0] >= 0 ) {
+		close( up->pipe[0] );
+		close( up->pipe[1] );
+	}
+	if( up->file >= 0 ) {
+		close( up->file );
+		if( !up->stored ) {
+			unlinkat( up->site->dir, up->tmp, 0 );
+		}
+	}
+	free( up->head );
+	free( up->tmp );
+	free( up );
+}
+
+
+/* This function reports how uploads are going.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void upload_stats( struct upload_stats *stats ) {
+	stats->started = atomic_load( &started );
+	stats->completed = atomic_load( &completed );
+	stats->failed = atomic_load( &failed );
+	stats->bytes = atomic_load( &bytes );
+	stats->spliced = atomic_load( &spliced );
+}
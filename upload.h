@@ -0,0 +1,141 @@
+/*
+ * File: upload.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          upload module, which stores files sent to the server with PUT or
+ *          POST.
+ */
+
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include <stddef.h>
+
+#include "buffer.h"
+#include "site.h"
+
+#define UPLOAD_SYNC_NONE 0 /* leave flushing to the kernel */
+#define UPLOAD_SYNC_FILE 1 /* fsync() each file before it is renamed */
+#define UPLOAD_SYNC_FULL 2 /* ... and its directory after */
+
+/*
+ * This module has seven functions:
+ *   upload_init()   : set the sync policy of uploads
+ *   upload_check()  : decide whether an upload may go ahead
+ *   upload_new()    : start an upload
+ *   upload_step()   : receive the next piece of an upload
+ *   upload_status() : get the status an upload was answered with
+ *   upload_free()   : free an upload
+ *   upload_stats()  : report how uploads are going
+ *
+ * The body of an upload is never held in memory.  It is moved from the
+ * socket into a pipe and from the pipe into a temporary file with
+ * splice(), so it stays in the kernel's pages the whole way.  Only the
+ * start of the body, read along with the headers, is copied: upload_new()
+ * takes it from the request's buffers so that they can go back to the
+ * pool at once.  upload_new() does no disk I/O, so it is safe to call from
+ * the thread running the event loop; upload_step() is called by the
+ * workers, one quantum at a time, so uploads are served alongside
+ * downloads.  It never waits for the body: when nothing more has arrived
+ * it says so, and the upload is put aside, taking no worker's time, until
+ * the socket is readable.
+ *
+ * Each site sets the largest upload it accepts, or turns uploads off.
+ * The temporary file is created in the same directory as the target and
+ * is renamed over it once the whole body has arrived, so readers see
+ * either the old file or the new one, never part of one.  How hard it is
+ * pushed to disk first depends on the sync policy.  The target is then
+ * dropped from the site's cache and header cache, and the client is told
+ * 201 (created) or 200 (replaced).  If the client stops sending for 10
+ * seconds, or goes away, the temporary file is removed.
+ */
+
+struct upload;
+
+struct upload_stats {
+	size_t started;   /* # of uploads started */
+	size_t completed; /* # of uploads stored */
+	size_t failed;    /* # of uploads abandoned */
+	size_t bytes;     /* bytes of bodies stored */
+	size_t spliced;   /* bytes moved with splice() */
+};
+
+
+/* This function sets the sync policy of uploads.  Until it is called, the
+ *    policy is UPLOAD_SYNC_FILE.
+ * Parameters:
+ *    sync : UPLOAD_SYNC_NONE, UPLOAD_SYNC_FILE or UPLOAD_SYNC_FULL
+ * Returns: None
+ */
+extern void upload_init( int sync );
+
+
+/* This function decides whether an upload may go ahead.
+ * Parameters:
+ *    site   : the site the upload is for
+ *    path   : the requested path, with leading /
+ *    length : the Content-Length of the body, -1 if not given
+ * Returns: 0 if it may, or the HTTP status code to refuse it with: 400 if
+ *          the site does not take uploads, 403 if the path is not a file
+ *          or leaves the site's root (see http_path_safe()), 411 if there
+ *          is no length, or 413 if the body is too large.
+ */
+extern int upload_check( struct site *site, const char *path, long long length );
+
+
+/* This function starts an upload that upload_check() allowed, copying the
+ *    start of the body out of the request's buffers.  The socket must be
+ *    non-blocking.  This function will abort the program if memory cannot
+ *    be allocated.
+ * Parameters:
+ *    fd     : the file descriptor to the client connection
+ *    site   : the site the upload is for
+ *    path   : the requested path, with leading /
+ *    length : the Content-Length of the body
+ *    chain  : the buffers holding the request
+ *    off    : offset of the body within the chain
+ * Returns: The upload.
+ */
+extern struct upload *upload_new( int fd, struct site *site, const char *path,
+                                  long long length, struct buffer *chain, size_t off );
+
+
+/* This function receives the next piece of an upload, without waiting for
+ *    it.  Once the whole body is in, or the upload fails, the response is
+ *    sent to the client.  The connection is not closed.
+ * Parameters:
+ *    up   : the upload
+ *    wait : if nothing more has arrived, set to the ns until the upload
+ *           times out
+ * Returns: 1 if there is more to receive, 0 if the upload is finished.  If
+ *          *wait was set, the caller is to call again once the socket is
+ *          readable, or once *wait ns have passed.
+ */
+extern int upload_step( struct upload *up, long long *wait );
+
+
+/* This function gets the status a finished upload was answered with.
+ * Parameters:
+ *    up : the upload
+ * Returns: The HTTP status code, or 0 if the upload is not finished.
+ */
+extern int upload_status( const struct upload *up );
+
+
+/* This function frees an upload, removing its temporary file if it was not
+ *    stored.
+ * Parameters:
+ *    up : the upload
+ * Returns: None
+ */
+extern void upload_free( struct upload *up );
+
+
+/* This function reports how uploads are going.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void upload_stats( struct upload_stats *stats );
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * File: util.c
+ * Author: agent
+ * Purpose: This file contains the util module, the clock and hash that the
+ *         other modules share.
+ *         Please see util.h for documentation on how to use this module.
+ */
+
+#include <time.h>
+
+#include "util.h"
+
+#define FNV_PRIME 16777619u /* FNV-1a multiplier */
+
+
+/* This function gets the time on the monotonic clock.
+ * Parameters: None
+ * Returns: The time, in nanoseconds.
+ */
+extern long long util_now_ns() {
+	struct timespec now; /* current time */
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+/* This function hashes some bytes (FNV-1a).
+ * Parameters:
+ *    h    : the start of the hash, UTIL_HASH_BASIS for a new one
+ *    data : the bytes
+ *    len  : # of bytes
+ * Returns: The hash.
+ */
+extern unsigned util_hash( unsigned h, const void *data, size_t len ) {
+	const unsigned char *byte = data; /* next byte to hash */
+
+	for( ; len > 0; len--, byte++ ) {
+		h = ( h ^ *byte ) * FNV_PRIME;
+	}
+	return h;
+}
+
+
+/* This function hashes a string (FNV-1a), without its terminating nul.
+ * Parameters:
+ *    h   : the start of the hash, UTIL_HASH_BASIS for a new one
+ *    str : the string
+ * Returns: The hash.
+ */
+extern unsigned util_hash_str( unsigned h, const char *str ) {
+	for( ; *str; str++ ) {
+		h = ( h ^ (unsigned char)*str ) * FNV_PRIME;
+	}
+	return h;
+}
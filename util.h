@@ -0,0 +1,57 @@
+/*
+ * File: util.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          util module, the clock and hash that the other modules share.
+ */
+
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stddef.h>
+
+#define UTIL_HASH_BASIS 2166136261u /* FNV-1a offset basis, to start a hash */
+
+/*
+ * This module has three functions:
+ *   util_now_ns()   : get the time on the monotonic clock
+ *   util_hash()     : hash some bytes (FNV-1a)
+ *   util_hash_str() : hash a string (FNV-1a)
+ *
+ * The clock is the one timeouts and deadlines are measured against: it does
+ * not jump when the wall clock is set.  A hash is started from
+ * UTIL_HASH_BASIS, or from it mixed with something that keeps apart keys
+ * that would otherwise collide (e.g., the directory a path is in), and may
+ * be continued by passing one hash as the start of the next.  FNV-1a is
+ * quick on the short keys used here, paths, host names and addresses, and
+ * spreads them well enough for tables that mask off the low bits.  All
+ * functions are thread safe.
+ */
+
+
+/* This function gets the time on the monotonic clock.
+ * Parameters: None
+ * Returns: The time, in nanoseconds.
+ */
+extern long long util_now_ns();
+
+
+/* This function hashes some bytes (FNV-1a).
+ * Parameters:
+ *    h    : the start of the hash, UTIL_HASH_BASIS for a new one
+ *    data : the bytes
+ *    len  : # of bytes
+ * Returns: The hash.
+ */
+extern unsigned util_hash( unsigned h, const void *data, size_t len );
+
+
+/* This function hashes a string (FNV-1a), without its terminating nul.
+ * Parameters:
+ *    h   : the start of the hash, UTIL_HASH_BASIS for a new one
+ *    str : the string
+ * Returns: The hash.
+ */
+extern unsigned util_hash_str( unsigned h, const char *str );
+
+#endif
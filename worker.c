@@ -0,0 +1,691 @@
+/*
+ * File: worker.c
+ * Author: agent
+ * Purpose: This file contains the worker module, a pool of threads that
+ *         serve requests handed to them by the thread accepting clients.
+ *         Please see worker.h for documentation on how to use this module.
+ */
+
+#define _GNU_SOURCE /* for pthread_attr_setaffinity_np() */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "probes.h"
+#include "queue.h"
+#include "util.h"
+#include "worker.h"
+
+#define SPIN_MAX_NS 50000 /* longest a worker spins before parking */
+#define SPIN_CHECK 64 /* pauses between looks at the clock */
+#define GAP_SHIFT 3 /* arrival gap average weighs new gaps 1/8 */
+#define GROW_DELAY_NS 1000000 /* queue delay above which the pool grows */
+#define GROW_UTIL 0.7 /* ... if the workers are at least this busy */
+#define SHRINK_DELAY_NS 100000 /* queue delay below which the pool shrinks */
+#define SHRINK_UTIL 0.4 /* ... if the workers are at most this busy */
+#define GROW_TICKS 2 /* ticks in a row the pool must be short to grow */
+#define SHRINK_TICKS 30 /* ticks in a row it must be idle to shrink */
+#define COOLDOWN_TICKS 5 /* ticks after a resize before another */
+
+static struct queue *run_queue[WORKER_CLASSES]; /* requests waiting, by class */
+static int class_weights[WORKER_CLASSES]; /* quanta per round, by class */
+static int weighted; /* weighted, rather than strict, priority? */
+static int (*serve_fn)( void *req ); /* serves one quantum */
+static int wake_fd = -1; /* eventfd sleeping workers wait on */
+static atomic_int num_workers; /* # of worker threads serving, not on standby */
+static int busy_workers; /* # of busy poll workers */
+static atomic_int max_spinners; /* most workers spinning at once */
+static int min_workers; /* fewest worker threads serving, when scaling */
+static int max_workers; /* most worker threads, when scaling */
+static int threads; /* # of worker threads started */
+static atomic_int scaling; /* is the pool scaled to the load? */
+static atomic_int retire; /* # of workers asked to stand by */
+static pthread_mutex_t standby_lock = PTHREAD_MUTEX_INITIALIZER; /* guards standing_by, recalled */
+static pthread_cond_t standby_cond = PTHREAD_COND_INITIALIZER; /* workers on standby wait on */
+static int standing_by; /* # of workers on standby */
+static int recalled; /* # of them called back, but not yet back */
+static int tick_fd = -1; /* timer for worker_tick() */
+
+static atomic_int sleepers; /* # of workers asleep */
+static atomic_int spinners; /* # of workers spinning */
+static atomic_int pollers; /* # of busy poll workers idle */
+static atomic_long arrival_gap; /* avg ns between requests */
+static struct timespec last_arrival; /* time of last submit */
+static size_t pending; /* # submitted since last flush */
+
+static atomic_size_t submitted; /* counters for worker_stats() */
+static atomic_size_t quanta;
+static atomic_size_t wakeups;
+static atomic_size_t parks;
+static atomic_size_t spin_hits;
+static atomic_size_t class_quanta[WORKER_CLASSES];
+static atomic_llong busy_ns; /* time spent serving, when scaling */
+static atomic_llong wait_ns; /* time requests waited on the run queues, when scaling */
+static atomic_size_t waited; /* # of waits timed */
+static atomic_long queue_delay; /* queue delay over the last tick, ns */
+static atomic_int utilisation; /* % of time spent serving over the last tick */
+static atomic_size_t grows; /* # of times the pool grew */
+static atomic_size_t shrinks; /* # of times it shrank */
+
+
+/* This function tells the CPU that we are in a spin loop, so that it can
+ *    save power and let a sibling hyperthread run.
+ * Parameters: None
+ * Returns: None
+ */
+static inline void cpu_relax() {
+#if defined( __x86_64__ ) || defined( __i386__ )
+	__builtin_ia32_pause();
+#elif defined( __aarch64__ )
+	__asm__ __volatile__( "yield" );
+#endif
+}
+
+
+/* This function returns the time elapsed between two instants.
+ * Parameters:
+ *    start : the earlier instant
+ *    end   : the later instant
+ * Returns: The elapsed time, in nanoseconds.
+ */
+static long elapsed_ns( struct timespec *start, struct timespec *end ) {
+	return ( end->tv_sec - start->tv_sec ) * 1000000000L + ( end->tv_nsec - start->tv_nsec );
+}
+
+
+/* This function takes the next request off the run queues, by the
+ *    workers' policy: the highest class with a request waiting under strict
+ *    priority, or under weighted priority, the highest class with a request
+ *    waiting and turns left in the calling worker's round.
+ * Parameters:
+ *    class : set to the class of the request
+ * Returns: A request, or NULL if all the run queues are empty.
+ */
+static void *next_request( int *class ) {
+	static _Thread_local int turns[WORKER_CLASSES]; /* left in this round */
+	void *req = NULL; /* request found */
+	long long stamp; /* when it was queued, 0 if not timed */
+	int c; /* class index */
+
+	for( c = 0; ( c < WORKER_CLASSES ) && !req; c++ ) { /* classes with turns */
+		if( !weighted || ( turns[c] > 0 ) ) {
+			req = queue_pop( run_queue[c], &stamp );
+		}
+	}
+	if( !req && weighted ) { /* none waiting, new round */
+		for( c = 0; c < WORKER_CLASSES; c++ ) {
+			turns[c] = class_weights[c];
+		}
+		for( c = 0; ( c < WORKER_CLASSES ) && !req; c++ ) {
+			req = queue_pop( run_queue[c], &stamp );
+		}
+	}
+
+	if( req ) {
+		*class = c - 1; /* loop went one past */
+		turns[*class] -= weighted;
+		if( stamp ) { /* time its wait, for worker_tick() */
+			atomic_fetch_add_explicit( &wait_ns, util_now_ns() - stamp, memory_order_relaxed );
+			atomic_fetch_add_explicit( &waited, 1, memory_order_relaxed );
+		}
+	}
+	return req;
+}
+
+
+/* This function spins on the run queue for a while, in case a request
+ *    arrives soon.  How long it spins depends on how often requests have
+ *    been arriving: twice the average gap between them, up to SPIN_MAX_NS.
+ *    If requests are further apart than that, a worker would mostly spin
+ *    for nothing, so it does not spin at all.
+ * Parameters:
+ *    class : set to the class of the request
+ * Returns: A request, or NULL if none arrived in time.
+ */
+static void *worker_spin( int *class ) {
+	struct timespec start, now; /* spin time */
+	long budget; /* ns to spin */
+	void *req = NULL; /* request found */
+	int i; /* pause count */
+
+	budget = 2 * atomic_load_explicit( &arrival_gap, memory_order_relaxed );
+	if( budget > 2 * SPIN_MAX_NS ) { /* arrivals too rare */
+		return NULL;
+	} else if( budget > SPIN_MAX_NS ) {
+		budget = SPIN_MAX_NS;
+	}
+
+	if( atomic_fetch_add( &spinners, 1 ) >=
+	    atomic_load_explicit( &max_spinners, memory_order_relaxed ) ) { /* enough spinning */
+		atomic_fetch_sub( &spinners, 1 );
+		return NULL;
+	}
+
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	do {
+		for( i = 0; ( i < SPIN_CHECK ) && !req; i++ ) {
+			cpu_relax();
+			req = next_request( class );
+		}
+		clock_gettime( CLOCK_MONOTONIC, &now );
+	} while( !req && ( elapsed_ns( &start, &now ) < budget ) );
+
+	atomic_fetch_sub( &spinners, 1 );
+	if( req ) {
+		atomic_fetch_add_explicit( &spin_hits, 1, memory_order_relaxed );
+	}
+	return req;
+}
+
+
+/* This function checks whether the calling worker is to stand by, taking
+ *    one of the requests to if so.
+ * Parameters: None
+ * Returns: 1 if the worker is to stand by, 0 if not.
+ */
+static int retiring() {
+	int r = atomic_load_explicit( &retire, memory_order_relaxed ); /* asked to stand by */
+
+	while( r > 0 ) {
+		if( atomic_compare_exchange_weak( &retire, &r, r - 1 ) ) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+/* This function puts the calling worker on standby until the pool grows
+ *    again.
+ * Parameters: None
+ * Returns: None
+ */
+static void worker_standby() {
+	pthread_mutex_lock( &standby_lock );
+	standing_by++;
+	while( !recalled ) {
+		pthread_cond_wait( &standby_cond, &standby_lock );
+	}
+	recalled--;
+	standing_by--;
+	pthread_mutex_unlock( &standby_lock );
+}
+
+
+/* This function takes the next request off the run queues.  If there is
+ *    none, the calling worker spins briefly and then goes to sleep until
+ *    one is available.
+ * Parameters:
+ *    class : set to the class of the request
+ * Returns: The request, or NULL if the worker is to stand by.
+ */
+static void *worker_take( int *class ) {
+	uint64_t val; /* eventfd count */
+	void *req; /* request to serve */
+
+	for( ;; ) {
+		if( retiring() ) { /* pool is shrinking */
+			return NULL;
+		}
+		req = next_request( class );
+		if( !req ) { /* nothing yet, wait a bit */
+			req = worker_spin( class );
+		}
+		if( req ) { /* got one */
+			return req;
+		}
+
+		/* announce ourselves before the last look, so that a request
+		 * pushed after it is sure to see us and signal */
+		atomic_fetch_add( &sleepers, 1 );
+		atomic_thread_fence( memory_order_seq_cst );
+		req = next_request( class );
+		if( !req ) { /* still empty, sleep */
+			atomic_fetch_add_explicit( &parks, 1, memory_order_relaxed );
+			while( ( read( wake_fd, &val, sizeof( val ) ) < 0 ) && ( errno == EINTR ) ) {
+				continue;
+			}
+		}
+		atomic_fetch_sub( &sleepers, 1 );
+
+		if( req ) {
+			return req;
+		}
+	}
+}
+
+
+/* This function serves a request until it is finished or has been put
+ *    back on the run queue of its class for another turn.
+ * Parameters:
+ *    req   : the request
+ *    class : the class of the request
+ * Returns: None
+ */
+static void worker_serve( void *req, int class ) {
+	long long start, end = 0; /* time serving, and requeued, when scaling */
+	int more; /* needs another quantum? */
+
+	do { /* requeue unfinished req, keep serving it if queue full */
+		PROBE( dispatch, PROBE_PTR( req ), class );
+		start = atomic_load_explicit( &scaling, memory_order_relaxed ) ? util_now_ns() : 0;
+		more = serve_fn( req );
+		if( start ) {
+			end = util_now_ns();
+			atomic_fetch_add_explicit( &busy_ns, end - start, memory_order_relaxed );
+		}
+		atomic_fetch_add_explicit( &quanta, 1, memory_order_relaxed );
+		atomic_fetch_add_explicit( &class_quanta[class], 1, memory_order_relaxed );
+	} while( more && queue_push( run_queue[class], req, end ) );
+}
+
+
+/* This function is where each worker thread starts running.  It serves
+ *    requests from the run queue one quantum at a time, forever, standing
+ *    by whenever the pool shrinks.
+ * Parameters:
+ *    arg : not used
+ * Returns: Never returns.
+ */
+static void *worker_main( void *arg ) {
+	void *req; /* request to serve */
+	int class; /* its class */
+
+	(void)arg;
+	for( ;; ) {
+		req = worker_take( &class );
+		if( req ) {
+			worker_serve( req, class );
+		} else {
+			worker_standby();
+		}
+	}
+	return NULL;
+}
+
+
+/* This function starts a worker thread.  This function will abort the
+ *    program if the thread cannot be created.
+ * Parameters:
+ *    start : function the thread starts running
+ *    arg   : its argument
+ * Returns: None
+ */
+static void worker_start( void *(*start)( void *arg ), void *arg ) {
+	pthread_t tid; /* new thread */
+
+	if( pthread_create( &tid, NULL, start, arg ) ) {
+		perror( "Error while creating worker thread" );
+		abort();
+	}
+	pthread_detach( tid );
+}
+
+
+/* This function is where the first worker thread starts running.  It
+ *    starts the rest of the pool, so that the thread calling worker_init()
+ *    does not wait for them, and then serves like the others.
+ * Parameters:
+ *    arg : # of workers to start, cast to a pointer
+ * Returns: Never returns.
+ */
+static void *worker_first( void *arg ) {
+	intptr_t others; /* workers left to start */
+
+	for( others = (intptr_t)arg; others > 0; others-- ) {
+		worker_start( worker_main, NULL );
+	}
+	return worker_main( NULL );
+}
+
+
+/* This function is where each busy poll worker thread starts running.
+ *    Like worker_main(), it serves requests from the run queue forever,
+ *    but it never sleeps: when the queue is empty it keeps polling it.
+ * Parameters:
+ *    arg : not used
+ * Returns: Never returns.
+ */
+static void *worker_busy_main( void *arg ) {
+	void *req; /* request to serve */
+	int class; /* its class */
+
+	(void)arg;
+	atomic_fetch_add( &pollers, 1 );
+	for( ;; ) {
+		req = next_request( &class );
+		if( !req ) { /* nothing yet, poll again */
+			cpu_relax();
+			continue;
+		}
+
+		atomic_fetch_sub( &pollers, 1 );
+		worker_serve( req, class );
+		atomic_fetch_add( &pollers, 1 );
+	}
+	return NULL;
+}
+
+
+/* This function starts the pool of worker threads.  It must be called once,
+ *    before worker_submit().  Only the first thread is started by the
+ *    caller; it starts the others.  This function will abort the program if
+ *    the threads cannot be created.
+ * Parameters:
+ *    workers : the number of threads to start
+ *    serve   : function that serves one quantum of a request and returns
+ *              non-zero if the request needs more
+ *    weights : quanta per round of each class, or NULL for strict priority
+ * Returns: None
+ */
+extern void worker_init( int workers, int (*serve)( void *req ), const int *weights ) {
+	int i; /* class index */
+
+	for( i = 0; i < WORKER_CLASSES; i++ ) {
+		run_queue[i] = queue_new( WORKER_QUEUE );
+		class_weights[i] = weights ? weights[i] : 0;
+	}
+	weighted = weights != NULL;
+	serve_fn = serve;
+	atomic_init( &max_spinners, ( workers + 3 ) / 4 ); /* a quarter of them, at least 1 */
+	atomic_init( &arrival_gap, 2 * SPIN_MAX_NS + 1 ); /* no spinning yet */
+	clock_gettime( CLOCK_MONOTONIC, &last_arrival );
+
+	wake_fd = eventfd( 0, EFD_SEMAPHORE );
+	if( wake_fd < 0 ) {
+		perror( "Error while creating eventfd" );
+		abort();
+	}
+
+	if( workers > 0 ) {
+		worker_start( worker_first, (void *)(intptr_t)( workers - 1 ) );
+	}
+	threads = workers;
+	atomic_init( &num_workers, workers );
+	min_workers = workers;
+}
+
+
+/* This function starts scaling the pool to the load, from the number of
+ *    workers given to worker_init() up to a most.  It must be called once,
+ *    after worker_init().  This function will abort the program if the
+ *    timer cannot be created.
+ * Parameters:
+ *    most : the most worker threads
+ * Returns: A timer descriptor that becomes readable every WORKER_TICK_MS,
+ *          for the event loop to call worker_tick().
+ */
+extern int worker_scale( int most ) {
+	struct itimerspec period = { { 0, WORKER_TICK_MS * 1000000L },
+	                             { 0, WORKER_TICK_MS * 1000000L } }; /* timer period */
+
+	tick_fd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+	if( ( tick_fd < 0 ) || timerfd_settime( tick_fd, 0, &period, NULL ) ) {
+		perror( "Error while creating worker timer" );
+		abort();
+	}
+	max_workers = most;
+	atomic_store( &scaling, 1 );
+	return tick_fd;
+}
+
+
+/* This function grows the pool: it cancels requests to stand by that have
+ *    not been taken up yet, then calls back workers on standby, and then
+ *    starts new ones, up to max_workers threads.
+ * Parameters:
+ *    n : # of workers to add
+ * Returns: None
+ */
+static void grow( int n ) {
+	int r = atomic_load( &retire ); /* requests to stand by outstanding */
+	int k; /* # taken care of */
+
+	do { /* cancel requests to stand by */
+		k = r < n ? r : n;
+	} while( ( k > 0 ) && !atomic_compare_exchange_weak( &retire, &r, r - k ) );
+	n -= k > 0 ? k : 0;
+
+	pthread_mutex_lock( &standby_lock ); /* call back */
+	k = standing_by - recalled < n ? standing_by - recalled : n;
+	if( k > 0 ) {
+		recalled += k;
+		n -= k;
+		pthread_cond_broadcast( &standby_cond );
+	}
+	pthread_mutex_unlock( &standby_lock );
+
+	for( ; ( n > 0 ) && ( threads < max_workers ); n-- ) { /* start more */
+		worker_start( worker_main, NULL );
+		threads++;
+	}
+}
+
+
+/* This function shrinks the pool by asking workers to stand by.  Sleeping
+ *    workers are woken so that they see the request.
+ * Parameters:
+ *    n : # of workers to stand by
+ * Returns: None
+ */
+static void shrink( int n ) {
+	uint64_t wake = n; /* # of workers to wake */
+
+	atomic_fetch_add( &retire, n );
+	if( write( wake_fd, &wake, sizeof( wake ) ) < 0 ) {
+		perror( "Error while waking worker" );
+	}
+}
+
+
+/* This function decides whether to resize the pool, once the timer
+ *    returned by worker_scale() is readable.  It must be called by the
+ *    thread that submits requests.
+ * Parameters: None
+ * Returns: None
+ */
+extern void worker_tick() {
+	static struct timespec last; /* time of last tick */
+	static long long last_busy; /* time spent serving by then */
+	static int short_ticks, idle_ticks, cooldown; /* hysteresis */
+	struct timespec now; /* time of tick */
+	uint64_t ticks; /* expirations of the timer */
+	size_t timed; /* # of waits timed since last tick */
+	long long total; /* their total */
+	size_t depth = 0; /* requests waiting now */
+	long long busy; /* time spent serving since last tick */
+	long dt; /* time since last tick */
+	long delay; /* queue delay */
+	double util; /* fraction of time spent serving */
+	int n = atomic_load( &num_workers ); /* # of workers serving */
+	int i; /* class index */
+
+	if( read( tick_fd, &ticks, sizeof( ticks ) ) < 0 ) { /* rearm the timer */
+		ticks = 0;
+	}
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	total = atomic_exchange( &wait_ns, 0 );
+	timed = atomic_exchange( &waited, 0 );
+	busy = atomic_load( &busy_ns );
+	if( !last.tv_sec ) { /* first tick, nothing to compare with */
+		last = now;
+		last_busy = busy;
+		return;
+	}
+	dt = elapsed_ns( &last, &now );
+	for( i = 0; i < WORKER_CLASSES; i++ ) {
+		depth += queue_depth( run_queue[i] );
+	}
+
+	/* the mean wait of the requests taken off the run queues since the
+	 * last tick; if requests are waiting but none was taken, the workers
+	 * are stuck, and the wait is counted as the whole tick */
+	delay = timed ? (long)( total / timed ) : depth ? dt : 0;
+	util = ( busy - last_busy ) / ( (double)dt * ( n + busy_workers ) );
+	atomic_store( &queue_delay, delay );
+	atomic_store( &utilisation, (int)( util * 100 + 0.5 ) );
+	last = now;
+	last_busy = busy;
+
+	short_ticks = ( delay > GROW_DELAY_NS ) && ( util > GROW_UTIL ) ? short_ticks + 1 : 0;
+	idle_ticks = ( delay < SHRINK_DELAY_NS ) && ( util < SHRINK_UTIL ) &&
+	             ( util * n / ( n - 1 ) < GROW_UTIL ) ? idle_ticks + 1 : 0;
+	if( cooldown > 0 ) {
+		cooldown--;
+	} else if( ( short_ticks >= GROW_TICKS ) && ( n < max_workers ) ) {
+		i = n / 4 > 1 ? n / 4 : 1; /* a quarter more, catch up fast */
+		i = n + i > max_workers ? max_workers - n : i;
+		grow( i );
+		n += i;
+		atomic_fetch_add( &grows, 1 );
+		cooldown = COOLDOWN_TICKS;
+	} else if( ( idle_ticks >= SHRINK_TICKS ) && ( n > min_workers ) ) {
+		shrink( 1 ); /* one at a time, step down slowly */
+		n--;
+		atomic_fetch_add( &shrinks, 1 );
+		cooldown = COOLDOWN_TICKS;
+	} else {
+		return;
+	}
+	short_ticks = idle_ticks = 0;
+	atomic_store( &num_workers, n );
+	atomic_store( &max_spinners, ( n + 3 ) / 4 );
+}
+
+
+/* This function starts a busy poll worker, pinned to a CPU of its own, that
+ *    never sleeps.  It must be called after worker_init().  This function
+ *    will abort the program if the thread cannot be created.
+ * Parameters:
+ *    cpu : the CPU to run the worker on
+ * Returns: None
+ */
+extern void worker_busy( int cpu ) {
+	pthread_attr_t attr; /* thread attributes */
+	pthread_t tid; /* new thread */
+	cpu_set_t cpus; /* CPU to run on */
+
+	CPU_ZERO( &cpus );
+	CPU_SET( cpu, &cpus );
+	pthread_attr_init( &attr );
+	pthread_attr_setaffinity_np( &attr, sizeof( cpus ), &cpus );
+	pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED );
+
+	if( pthread_create( &tid, &attr, worker_busy_main, NULL ) ) {
+		perror( "Error while creating busy poll worker thread" );
+		abort();
+	}
+	pthread_attr_destroy( &attr );
+	busy_workers++;
+}
+
+
+/* This function hands a request to the workers.  Sleeping workers are not
+ *    woken until worker_flush() is called.  If the class's run queue is
+ *    full, the caller waits for room.
+ * Parameters:
+ *    req   : the request, must not be NULL
+ *    class : the request's priority class, 0 being the highest
+ * Returns: None
+ */
+extern void worker_submit( void *req, int class ) {
+	struct timespec now; /* arrival time */
+	long long stamp = 0; /* when it was queued, if timed */
+	long gap; /* ns since last arrival */
+	long avg; /* average gap */
+
+	if( atomic_load_explicit( &scaling, memory_order_relaxed ) ) {
+		stamp = util_now_ns(); /* time its wait */
+	}
+	while( queue_push( run_queue[class], req, stamp ) ) { /* full, let workers drain it */
+		worker_flush();
+		sched_yield();
+	}
+	PROBE( enqueue, PROBE_PTR( req ), class );
+	atomic_fetch_add_explicit( &submitted, 1, memory_order_relaxed );
+	pending++;
+
+	clock_gettime( CLOCK_MONOTONIC, &now ); /* track arrival rate */
+	gap = elapsed_ns( &last_arrival, &now );
+	last_arrival = now;
+	avg = atomic_load_explicit( &arrival_gap, memory_order_relaxed );
+	avg += ( gap - avg ) >> GAP_SHIFT;
+	atomic_store_explicit( &arrival_gap, avg, memory_order_relaxed );
+}
+
+
+/* This function wakes as many sleeping workers as there are requests
+ *    submitted since the last call, less those that spinning and busy poll
+ *    workers will pick up, but no more than are asleep, using a single
+ *    write to the eventfd.
+ * Parameters: None
+ * Returns: None
+ */
+extern void worker_flush() {
+	uint64_t wake; /* # of workers to wake */
+	size_t awake; /* # of workers polling */
+	int asleep; /* # of workers asleep */
+
+	if( !pending ) { /* nothing submitted */
+		return;
+	}
+
+	/* pairs with the fence in worker_take(): either the worker sees our
+	 * requests on its last look, or we see it counted as a sleeper */
+	atomic_thread_fence( memory_order_seq_cst );
+	asleep = atomic_load_explicit( &sleepers, memory_order_relaxed );
+	awake = atomic_load_explicit( &spinners, memory_order_relaxed ) +
+	        atomic_load_explicit( &pollers, memory_order_relaxed );
+	wake = pending > awake ? pending - awake : 0;
+	wake = wake < (size_t)asleep ? wake : (size_t)asleep;
+	pending = 0;
+
+	if( wake > 0 ) {
+		atomic_fetch_add_explicit( &wakeups, wake, memory_order_relaxed );
+		if( write( wake_fd, &wake, sizeof( wake ) ) < 0 ) {
+			perror( "Error while waking worker" );
+		}
+	}
+}
+
+
+/* This function reports what the workers have been doing.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void worker_stats( struct worker_stats *stats ) {
+	int i; /* class index */
+
+	stats->workers = atomic_load( &num_workers );
+	stats->threads = threads;
+	stats->max = atomic_load( &scaling ) ? max_workers : stats->workers;
+	stats->queue_delay = atomic_load( &queue_delay );
+	stats->utilisation = atomic_load( &utilisation );
+	stats->grows = atomic_load( &grows );
+	stats->shrinks = atomic_load( &shrinks );
+	stats->busy = busy_workers;
+	stats->sleeping = atomic_load( &sleepers );
+	stats->spinning = atomic_load( &spinners );
+	stats->depth = 0;
+	for( i = 0; i < WORKER_CLASSES; i++ ) {
+		stats->class_depth[i] = run_queue[i] ? queue_depth( run_queue[i] ) : 0;
+		stats->class_quanta[i] = atomic_load( &class_quanta[i] );
+		stats->depth += stats->class_depth[i];
+	}
+	stats->arrival_gap = atomic_load( &arrival_gap );
+	stats->submitted = atomic_load( &submitted );
+	stats->quanta = atomic_load( &quanta );
+	stats->wakeups = atomic_load( &wakeups );
+	stats->parks = atomic_load( &parks );
+	stats->spin_hits = atomic_load( &spin_hits );
+}
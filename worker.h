@@ -0,0 +1,184 @@
+/*
+ * File: worker.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          worker module, a pool of threads that serve requests handed to
+ *          them by the thread accepting clients.
+ */
+
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <stddef.h>
+
+#define WORKER_QUEUE 4096 /* slots in each run queue */
+#define WORKER_CLASSES 3 /* # of priority classes, and run queues */
+#define WORKER_TICK_MS 100 /* period of worker_tick() when scaling */
+
+/*
+ * This module has seven functions:
+ *   worker_init()   : start the pool of worker threads
+ *   worker_scale()  : start scaling the pool to the load
+ *   worker_tick()   : resize the pool if the load calls for it
+ *   worker_busy()   : start a worker that never sleeps
+ *   worker_submit() : hand a request to the workers
+ *   worker_flush()  : wake sleeping workers for the requests just submitted
+ *   worker_stats()  : report what the workers have been doing
+ *
+ * Requests are passed to the workers through a lock-free run queue (see
+ * queue.h).  Each worker takes a request off the queue and calls the serve
+ * function given to worker_init() on it.  The serve function does one
+ * quantum of work and returns non-zero if the request needs more; in that
+ * case the worker puts it at the back of the queue, so that long requests
+ * take turns with short ones.
+ *
+ * There is a run queue for each of WORKER_CLASSES priority classes, class
+ * 0 being the highest, and a request stays in the queue of the class it
+ * was submitted in.  Workers serve the classes either by strict priority,
+ * always taking from the highest class with a request waiting, or by
+ * weight: each worker takes up to a class's weight in requests from it per
+ * round, highest class first, and starts a new round when no class with
+ * turns left has a request waiting, so no class starves and none of the
+ * workers' time goes unused.
+ *
+ * A worker that finds the queue empty first spins on it for a little while,
+ * since being woken from sleep adds a futex call and a trip through the
+ * scheduler to the request that wakes it.  How long it spins follows how
+ * often requests have been arriving: when they come closer together than
+ * a worker would take to fall asleep and wake up again, spinning pays off;
+ * when they are far apart, or the server is idle, workers go straight to
+ * sleep.  Only a quarter of the workers may spin at once.
+ *
+ * A worker that is done spinning goes to sleep on an eventfd.  It first
+ * announces itself in a count of sleeping workers and checks the queue once
+ * more, so that a request can never be left in the queue with every worker
+ * asleep.  Requests are submitted in batches: worker_submit() only queues a
+ * request, and worker_flush(), called once at the end of the batch, wakes
+ * one sleeping worker per request submitted (and no more than are asleep)
+ * with a single write to the eventfd.  Spinning workers pick requests up
+ * without being woken at all.
+ *
+ * For the lowest latency, worker_busy() adds workers that never sleep or
+ * give up their CPU: each is pinned to a CPU of its own (ideally one kept
+ * free of other work with isolcpus) and polls the run queue nonstop.
+ * They take requests alongside the ordinary workers.
+ *
+ * The pool may also be scaled to the load, between the number of workers it
+ * was started with and a most given to worker_scale().  Every
+ * WORKER_TICK_MS, worker_tick() measures the queue delay, the mean time
+ * requests waited on the run queues, each being stamped when it is put on
+ * one and timed when it is taken off, and the utilisation, the fraction of
+ * the workers' time spent serving.  If requests are waiting but none was
+ * taken off in a whole tick, the workers are stuck, and the delay is taken
+ * to be the tick.  When requests wait over a millisecond and the workers
+ * are over 70% busy for two ticks in a row, the pool grows by a quarter;
+ * when requests hardly wait, the workers are under 40% busy, and would
+ * still be under 70% with one fewer, for three seconds in a row, it shrinks
+ * by one.  After either, the pool is left alone for half a second, so it
+ * settles rather than swings.
+ *
+ * A worker that the pool sheds is put on standby, waiting on a condition
+ * variable, rather than ended: it takes no CPU and no part in the run
+ * queues, but keeps its thread and what it has set up (e.g., its slot in
+ * the stats segment), so growing again is a signal, and new threads are
+ * only started when more are needed than have ever been.  worker_stats()
+ * counts the resizes.
+ */
+
+struct worker_stats {
+	int workers;      /* # of worker threads serving */
+	int busy;         /* # of busy poll worker threads */
+	int sleeping;     /* # of workers asleep right now */
+	int spinning;     /* # of workers spinning right now */
+	size_t depth;     /* # of requests in the run queues */
+	long arrival_gap; /* average ns between requests */
+	size_t submitted; /* # of requests handed to the workers */
+	size_t quanta;    /* # of quanta served */
+	size_t wakeups;   /* # of times a sleeping worker was signalled */
+	size_t parks;     /* # of times a worker went to sleep */
+	size_t spin_hits; /* # of requests found while spinning */
+	size_t class_depth[WORKER_CLASSES];  /* # of requests in each run queue */
+	size_t class_quanta[WORKER_CLASSES]; /* # of quanta served, by class */
+	int threads;      /* # of worker threads started, including those on standby */
+	int max;          /* most worker threads, workers if not scaling */
+	long queue_delay; /* mean ns requests waited on the run queues, last tick */
+	int utilisation;  /* % of the workers' time spent serving, last tick */
+	size_t grows;     /* # of times the pool grew */
+	size_t shrinks;   /* # of times it shrank */
+};
+
+
+/* This function starts the pool of worker threads.  It must be called once,
+ *    before worker_submit().  Only the first thread is started by the
+ *    caller; it starts the others.  This function will abort the program if
+ *    the threads cannot be created.
+ * Parameters:
+ *    workers : the number of threads to start
+ *    serve   : function that serves one quantum of a request and returns
+ *              non-zero if the request needs more
+ *    weights : quanta per round of each class, or NULL for strict priority
+ * Returns: None
+ */
+extern void worker_init( int workers, int (*serve)( void *req ), const int *weights );
+
+
+/* This function starts scaling the pool to the load, from the number of
+ *    workers given to worker_init() up to a most.  It must be called once,
+ *    after worker_init().  This function will abort the program if the
+ *    timer cannot be created.
+ * Parameters:
+ *    most : the most worker threads
+ * Returns: A timer descriptor that becomes readable every WORKER_TICK_MS,
+ *          for the event loop to call worker_tick().
+ */
+extern int worker_scale( int most );
+
+
+/* This function decides whether to resize the pool, once the timer
+ *    returned by worker_scale() is readable.  It must be called by the
+ *    thread that submits requests.
+ * Parameters: None
+ * Returns: None
+ */
+extern void worker_tick();
+
+
+/* This function starts a busy poll worker, pinned to a CPU of its own, that
+ *    never sleeps.  It must be called after worker_init().  This function
+ *    will abort the program if the thread cannot be created.
+ * Parameters:
+ *    cpu : the CPU to run the worker on
+ * Returns: None
+ */
+extern void worker_busy( int cpu );
+
+
+/* This function hands a request to the workers.  Sleeping workers are not
+ *    woken until worker_flush() is called.  If the class's run queue is
+ *    full, the caller waits for room.
+ * Parameters:
+ *    req   : the request, must not be NULL
+ *    class : the request's priority class, 0 being the highest
+ * Returns: None
+ */
+extern void worker_submit( void *req, int class );
+
+
+/* This function wakes as many sleeping workers as there are requests
+ *    submitted since the last call, less those that spinning and busy poll
+ *    workers will pick up, but no more than are asleep, using a single
+ *    write to the eventfd.
+ * Parameters: None
+ * Returns: None
+ */
+extern void worker_flush();
+
+
+/* This function reports what the workers have been doing.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void worker_stats( struct worker_stats *stats );
+
+#endif
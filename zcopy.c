@@ -0,0 +1,124 @@
+/*
+ * File: zcopy.c
+ * Author: agent
+ * Purpose: This file contains the zcopy module, which sends data from memory
+ *         to a client without copying it into the socket buffer.
+ *         Please see zcopy.h for documentation on how to use this module.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+
+#include "zcopy.h"
+
+#define NOTICES 8 /* notices read per recvmsg() */
+
+static atomic_size_t sends; /* counters for zcopy_stats() */
+static atomic_size_t bytes;
+static atomic_size_t reaped;
+static atomic_size_t copied;
+static atomic_size_t refused;
+
+
+/* This function allows zero-copy sends on a socket.
+ * Parameters:
+ *    fd : the socket
+ * Returns: 0 on success, or -1 if the socket does not support it.
+ */
+extern int zcopy_enable( int fd ) {
+	int yes = 1; /* config variable */
+
+	if( setsockopt( fd, SOL_SOCKET, SO_ZEROCOPY, &yes, sizeof( int ) ) ) {
+		atomic_fetch_add_explicit( &refused, 1, memory_order_relaxed );
+		return -1;
+	}
+	return 0;
+}
+
+
+/* This function makes one zero-copy send of some data.  If it returns a
+ *    positive count, the send must later be reaped with zcopy_reap().
+ * Parameters:
+ *    fd  : the socket, on which zcopy_enable() succeeded
+ *    buf : the data, which must not change until the send is reaped
+ *    len : the number of bytes to send
+ * Returns: The number of bytes sent, or -1 on error (as for send()).
+ */
+extern ssize_t zcopy_send( int fd, const void *buf, size_t len ) {
+	ssize_t sent; /* bytes sent */
+
+	do {
+		sent = send( fd, buf, len, MSG_ZEROCOPY | MSG_NOSIGNAL );
+	} while( ( sent < 0 ) && ( errno == EINTR ) );
+
+	if( sent > 0 ) {
+		atomic_fetch_add_explicit( &sends, 1, memory_order_relaxed );
+		atomic_fetch_add_explicit( &bytes, sent, memory_order_relaxed );
+	}
+	return sent;
+}
+
+
+/* This function collects notices of completed zero-copy sends from a
+ *    socket's error queue, waiting up to a timeout for the first one.
+ * Parameters:
+ *    fd      : the socket
+ *    timeout : ms to wait if no notice is ready, 0 to not wait
+ * Returns: The number of sends reported complete, 0 if none.
+ */
+extern int zcopy_reap( int fd, int timeout ) {
+	char control[NOTICES * CMSG_SPACE( sizeof( struct sock_extended_err ) )]; /* notices */
+	struct sock_extended_err *err; /* one notice */
+	struct pollfd pfd; /* wait for notice */
+	struct msghdr msg; /* message header */
+	struct cmsghdr *cm; /* control message */
+	int done = 0; /* # of sends completed */
+
+	if( timeout > 0 ) { /* notices show up as POLLERR */
+		pfd.fd = fd;
+		pfd.events = 0;
+		poll( &pfd, 1, timeout );
+	}
+
+	for( ;; ) {
+		memset( &msg, 0, sizeof( msg ) );
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof( control );
+		if( recvmsg( fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT ) < 0 ) { /* queue empty */
+			break;
+		}
+
+		for( cm = CMSG_FIRSTHDR( &msg ); cm; cm = CMSG_NXTHDR( &msg, cm ) ) {
+			err = (struct sock_extended_err *)CMSG_DATA( cm );
+			if( ( err->ee_errno != 0 ) || ( err->ee_origin != SO_EE_ORIGIN_ZEROCOPY ) ) {
+				continue; /* not ours */
+			}
+			done += err->ee_data - err->ee_info + 1; /* sends ee_info..ee_data */
+			if( err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED ) {
+				atomic_fetch_add_explicit( &copied, err->ee_data - err->ee_info + 1,
+				                           memory_order_relaxed );
+			}
+		}
+	}
+
+	atomic_fetch_add_explicit( &reaped, done, memory_order_relaxed );
+	return done;
+}
+
+
+/* This function reports how zero-copy sending is going.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void zcopy_stats( struct zcopy_stats *stats ) {
+	stats->sends = atomic_load( &sends );
+	stats->bytes = atomic_load( &bytes );
+	stats->reaped = atomic_load( &reaped );
+	stats->copied = atomic_load( &copied );
+	stats->refused = atomic_load( &refused );
+}
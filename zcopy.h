@@ -0,0 +1,84 @@
+/*
+ * File: zcopy.h
+ * Author: agent
+ * Purpose: This file contains the prototypes and describes how to use the
+ *          zcopy module, which sends data from memory to a client without
+ *          copying it into the socket buffer (MSG_ZEROCOPY).
+ */
+
+#ifndef ZCOPY_H
+#define ZCOPY_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define ZCOPY_MIN 16384 /* smallest send worth doing without a copy */
+
+/*
+ * This module has four functions:
+ *   zcopy_enable() : allow zero-copy sends on a socket
+ *   zcopy_send()   : send data without copying it
+ *   zcopy_reap()   : collect notices of zero-copy sends that have completed
+ *   zcopy_stats()  : report how zero-copy sending is going
+ *
+ * A zero-copy send returns as soon as the kernel has pinned the pages of
+ * the data, long before the data has been sent.  Until the kernel is done
+ * with them, the pages must not be changed or freed.  The kernel numbers
+ * the zero-copy sends on a socket 0, 1, 2, ... and, once it is done with
+ * some of them, posts a notice on the socket's error queue naming the range
+ * of sends that completed; zcopy_reap() reads these and returns how many
+ * sends they covered.  The caller counts its sends and keeps the data
+ * alive until as many have been reaped.
+ *
+ * Zero-copy only pays off for large sends (see ZCOPY_MIN), since pinning
+ * pages and posting notices cost more than copying a few pages.  When the
+ * kernel cannot avoid the copy after all (e.g., over loopback), it copies
+ * and still posts a notice; these are counted in zcopy_stats().
+ */
+
+struct zcopy_stats {
+	size_t sends;   /* # of zero-copy sends */
+	size_t bytes;   /* bytes sent without a copy */
+	size_t reaped;  /* # of sends reported complete */
+	size_t copied;  /* # of sends the kernel copied anyway */
+	size_t refused; /* # of sockets that refused zero-copy */
+};
+
+
+/* This function allows zero-copy sends on a socket.
+ * Parameters:
+ *    fd : the socket
+ * Returns: 0 on success, or -1 if the socket does not support it.
+ */
+extern int zcopy_enable( int fd );
+
+
+/* This function makes one zero-copy send of some data.  If it returns a
+ *    positive count, the send must later be reaped with zcopy_reap().
+ * Parameters:
+ *    fd  : the socket, on which zcopy_enable() succeeded
+ *    buf : the data, which must not change until the send is reaped
+ *    len : the number of bytes to send
+ * Returns: The number of bytes sent, or -1 on error (as for send()).
+ */
+extern ssize_t zcopy_send( int fd, const void *buf, size_t len );
+
+
+/* This function collects notices of completed zero-copy sends from a
+ *    socket's error queue, waiting up to a timeout for the first one.
+ * Parameters:
+ *    fd      : the socket
+ *    timeout : ms to wait if no notice is ready, 0 to not wait
+ * Returns: The number of sends reported complete, 0 if none.
+ */
+extern int zcopy_reap( int fd, int timeout );
+
+
+/* This function reports how zero-copy sending is going.
+ * Parameters:
+ *    stats : structure to be filled in
+ * Returns: None
+ */
+extern void zcopy_stats( struct zcopy_stats *stats );
+
+#endif